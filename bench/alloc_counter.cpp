@@ -0,0 +1,46 @@
+// std
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+// bench
+#include "bench.hpp"
+
+namespace {
+std::atomic<size_t> kallocation_count{0};
+} // namespace
+
+#if defined(__GLIBC__)
+// 替换malloc系列函数，动态链接的OpenCV中的分配也会被统计
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size) {
+    kallocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    kallocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    kallocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    kallocation_count.fetch_add(1, std::memory_order_relaxed);
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+}
+}
+#endif
+
+size_t AllocationCount() {
+    return kallocation_count.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,158 @@
+#pragma once
+// std
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 基准测试状态，提供命令行选项并记录指标
+ *
+ */
+class BenchState {
+  public:
+    BenchState(std::string case_name, std::vector<std::string> args)
+        : case_name_(std::move(case_name)), args_(std::move(args)) {}
+
+    /**
+     * @brief 读取形如 --name=value 的选项
+     *
+     * @param name 选项名
+     * @param default_val 默认值
+     * @return std::string
+     */
+    std::string option(const std::string &name,
+                       const std::string &default_val) const;
+
+    /**
+     * @brief 读取整数选项
+     *
+     * @param name 选项名
+     * @param default_val 默认值
+     * @return long long
+     */
+    long long option(const std::string &name, long long default_val) const;
+
+    /**
+     * @brief 记录一项指标
+     *
+     * @param metric 指标名
+     * @param value 值
+     * @param unit 单位
+     * @param lower_is_better 越小越好（延迟、分配次数），否则越大越好
+     */
+    void report(const std::string &metric, double value,
+                const std::string &unit, bool lower_is_better = true);
+
+  private:
+    std::string case_name_;
+    std::vector<std::string> args_;
+};
+
+/**
+ * @brief 一项指标结果
+ *
+ */
+struct BenchResult {
+    std::string case_name;
+    std::string metric;
+    double value = 0.0;
+    std::string unit;
+    bool lower_is_better = true;
+};
+
+/**
+ * @brief 本次运行记录的所有指标
+ *
+ * @return std::vector<BenchResult>&
+ */
+std::vector<BenchResult> &BenchResults();
+
+using BenchFunc = std::function<void(BenchState &)>;
+
+/**
+ * @brief 基准测试用例
+ *
+ */
+struct BenchCase {
+    std::string name;
+    BenchFunc func;
+};
+
+/**
+ * @brief 所有注册的用例
+ *
+ * @return std::vector<BenchCase>&
+ */
+std::vector<BenchCase> &BenchCases();
+
+/**
+ * @brief 静态注册器
+ *
+ */
+struct BenchRegistrar {
+    BenchRegistrar(const std::string &name, BenchFunc func) {
+        BenchCases().push_back({name, std::move(func)});
+    }
+};
+
+/**
+ * @brief 定义并注册一个基准测试用例
+ *
+ */
+#define BENCH_CASE(case_name)                                                  \
+    static void case_name##_bench(BenchState &state);                          \
+    static BenchRegistrar case_name##_registrar(#case_name,                    \
+                                                case_name##_bench);            \
+    static void case_name##_bench(BenchState &state)
+
+/**
+ * @brief 进程启动以来的堆分配次数（malloc/calloc/realloc/posix_memalign）
+ * 仅glibc下可用，其他平台恒为0
+ *
+ * @return size_t
+ */
+size_t AllocationCount();
+
+/**
+ * @brief 计时，返回每次调用的平均纳秒数
+ *
+ * @tparam Func 被测函数类型
+ * @param func 被测函数
+ * @param iterations 次数
+ * @return double
+ */
+template <typename Func> double MeasureNs(Func &&func, size_t iterations) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+        func();
+    const auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() /
+           static_cast<double>(std::max<size_t>(iterations, 1));
+}
+
+/**
+ * @brief 预热一轮后统计每帧的延迟和堆分配次数
+ *
+ * @tparam Func 处理一帧的函数类型
+ * @param state 基准测试状态
+ * @param prefix 指标名前缀
+ * @param frames 帧数，预热和计时各调用这么多次
+ * @param func 处理一帧
+ * @return double 每帧的堆分配次数
+ */
+template <typename Func>
+double ReportSteadyState(BenchState &state, const std::string &prefix,
+                         size_t frames, Func &&func) {
+    for (size_t i = 0; i < frames; ++i)
+        func();
+    const auto allocations = AllocationCount();
+    const auto ns = MeasureNs(func, frames);
+    const auto frame_allocations =
+        static_cast<double>(AllocationCount() - allocations) /
+        static_cast<double>(std::max<size_t>(frames, 1));
+    state.report(prefix + "latency", ns / 1e6, "ms/frame");
+    state.report(prefix + "allocations", frame_allocations, "allocs/frame");
+    return frame_allocations;
+}
@@ -0,0 +1,99 @@
+#pragma once
+// std
+#include <random>
+#include <string>
+
+// bench
+#include "bench.hpp"
+
+// custom
+#include "detector.hpp"
+
+// 与配置默认值一致的检测参数
+constexpr float kbench_conf_threshold = 0.8f;
+constexpr float kbench_nms_threshold = 0.3f;
+constexpr int kbench_top_k = 30;
+
+/**
+ * @brief YuNet模型路径，选项 --yunet=<文件>
+ *
+ */
+inline std::string BenchYuNetPath(const BenchState &state) {
+    return state.option("yunet", std::string(__DATA_DIR__) +
+                                     "face_detection_yunet_2023mar.onnx");
+}
+
+/**
+ * @brief SFace模型路径，选项 --sface=<文件>
+ *
+ */
+inline std::string BenchSFacePath(const BenchState &state) {
+    return state.option("sface", std::string(__DATA_DIR__) +
+                                     "face_recognition_sface_2021dec.onnx");
+}
+
+inline YuNet MakeBenchYuNet(const BenchState &state) {
+    return YuNet(BenchYuNetPath(state), cv::Size(320, 320),
+                 kbench_conf_threshold, kbench_nms_threshold, kbench_top_k,
+                 cv::dnn::DNN_BACKEND_OPENCV, cv::dnn::DNN_TARGET_CPU);
+}
+
+inline SFace MakeBenchSFace(const BenchState &state) {
+    return SFace(BenchSFacePath(state), cv::dnn::DNN_BACKEND_OPENCV,
+                 cv::dnn::DNN_TARGET_CPU, cv::FaceRecognizerSF::FR_COSINE);
+}
+
+/**
+ * @brief 随机噪声图像，只关心计算开销，不关心检测结果
+ *
+ */
+inline cv::Mat BenchImage(const cv::Size &size) {
+    cv::Mat image(size, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    return image;
+}
+
+/**
+ * @brief 生成YuNet格式的人脸，按网格排列，关键点取SFace对齐模板
+ *
+ * @param count 人脸数
+ * @param image_size 图像大小
+ * @return cv::Mat count×15
+ */
+inline cv::Mat BenchFaces(int count, const cv::Size &image_size) {
+    static const float landmarks[] = {38.29f, 51.70f, 73.53f, 51.50f,
+                                      56.03f, 71.74f, 41.55f, 92.37f,
+                                      70.73f, 92.20f};
+    constexpr float face_size = 112.f;
+    const int per_row =
+        std::max(static_cast<int>(image_size.width / face_size), 1);
+    cv::Mat faces(count, 15, CV_32F);
+    for (int i = 0; i < count; ++i) {
+        float *face = faces.ptr<float>(i);
+        const float x = (i % per_row) * face_size;
+        const float y = static_cast<float>(
+            static_cast<int>((i / per_row) * face_size) %
+            std::max(image_size.height - static_cast<int>(face_size), 1));
+        face[0] = x;
+        face[1] = y;
+        face[2] = face_size;
+        face[3] = face_size;
+        for (int k = 0; k < 10; k += 2) {
+            face[4 + k] = x + landmarks[k];
+            face[5 + k] = y + landmarks[k + 1];
+        }
+        face[14] = 0.9f;
+    }
+    return faces;
+}
+
+/**
+ * @brief 随机特征，模拟不同的人
+ *
+ */
+inline void RandomFeature(cv::Mat &feature, std::mt19937 &rng) {
+    std::normal_distribution<float> normal;
+    feature.create(1, SFace::kfeature_dim, CV_32F);
+    for (int i = 0; i < SFace::kfeature_dim; ++i)
+        feature.at<float>(i) = normal(rng);
+}
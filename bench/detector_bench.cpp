@@ -0,0 +1,516 @@
+// std
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <thread>
+
+// opencv
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+// bench
+#include "bench.hpp"
+#include "bench_models.hpp"
+
+// custom
+#include "align_crop.hpp"
+#include "recognition_service.hpp"
+
+namespace {
+/**
+ * @brief 读取一帧真实画面，打不开时使用随机图像
+ *
+ */
+cv::Mat BenchFrame(const BenchState &state, const cv::Size &size) {
+    cv::VideoCapture video_capture(
+        state.option("video", std::string(__DATA_DIR__) + "demo.mp4"));
+    cv::Mat frame;
+    if (!video_capture.read(frame))
+        return BenchImage(size);
+    cv::Mat resized;
+    cv::resize(frame, resized, size);
+    return resized;
+}
+
+/**
+ * @brief 录入目标文件夹中的所有图片
+ *
+ */
+void EnrollBenchTargets(Detector &detector) {
+    std::vector<std::string> targets_path;
+    cv::glob(std::string(__DATA_DIR__) + "targets", targets_path, false);
+    for (const auto &target_path : targets_path) {
+        const auto image = cv::imread(target_path);
+        if (image.empty())
+            continue;
+        const auto detect_result =
+            detector.detectFaceLetterbox(image, cv::Size(640, 640));
+        if (detect_result.faces.empty())
+            continue;
+        detector.addTargetData(
+            {target_path, detect_result.features.row(0).clone()});
+    }
+}
+} // namespace
+
+/**
+ * @brief YuNet::infer在不同分辨率下的延迟
+ * 选项：--iters=20 --video=<视频> --yunet=<模型>
+ *
+ */
+BENCH_CASE(yunet_infer) {
+    const auto iterations = state.option("iters", 20LL);
+    auto yunet = MakeBenchYuNet(state);
+    cv::Mat faces;
+    for (const auto &size : {cv::Size(320, 240), cv::Size(640, 480),
+                             cv::Size(1280, 720), cv::Size(1920, 1080)}) {
+        const auto frame = BenchFrame(state, size);
+        yunet.setInputSize(size);
+        yunet.infer(frame, faces);
+        const auto ns =
+            MeasureNs([&] { yunet.infer(frame, faces); }, iterations);
+        state.report(std::to_string(size.width) + "x" +
+                         std::to_string(size.height) + "/latency",
+                     ns / 1e6, "ms/frame");
+    }
+}
+
+/**
+ * @brief SFace逐张与批量特征提取的延迟
+ * 选项：--iters=20 --sface=<模型>
+ *
+ */
+BENCH_CASE(sface_extract) {
+    const auto iterations = state.option("iters", 20LL);
+    auto sface = MakeBenchSFace(state);
+    const cv::Size image_size(1280, 720);
+    const auto image = BenchImage(image_size);
+    cv::Mat feature, features;
+    for (const int face_count : {1, 4, 16, 30}) {
+        const auto faces = BenchFaces(face_count, image_size);
+        const auto prefix = "faces=" + std::to_string(face_count) + "/";
+        const auto single_ns = MeasureNs(
+            [&] {
+                for (int i = 0; i < faces.rows; ++i)
+                    sface.extractFeatures(image, faces.row(i), feature);
+            },
+            iterations);
+        sface.extractFeaturesBatch(image, faces, features);
+        const auto batch_ns = MeasureNs(
+            [&] { sface.extractFeaturesBatch(image, faces, features); },
+            iterations);
+        state.report(prefix + "single_latency", single_ns / 1e6, "ms/frame");
+        state.report(prefix + "batch_latency", batch_ns / 1e6, "ms/frame");
+    }
+}
+
+/**
+ * @brief alignCrop加blobFromImages与融合的对齐裁剪写入SFace输入的延迟、
+ * 堆分配次数，以及两者输入的最大差异（warpAffine为定点插值并取整到8位）
+ * 选项：--frames=100 --sface=<模型>
+ *
+ */
+BENCH_CASE(align_crop) {
+    const auto frame_count =
+        static_cast<size_t>(state.option("frames", 100LL));
+    const auto recognizer =
+        cv::FaceRecognizerSF::create(BenchSFacePath(state), "");
+    const cv::Size image_size(1280, 720);
+    const auto image = BenchImage(image_size);
+    const BlobNormalization norm;
+    std::vector<cv::Mat> crops;
+    cv::Mat opencv_blob, fused_blob;
+    for (const int face_count : {1, 4, 16, 30}) {
+        const auto faces = BenchFaces(face_count, image_size);
+        const auto prefix = "faces=" + std::to_string(face_count) + "/";
+        crops.resize(face_count);
+        ReportSteadyState(state, prefix + "opencv/", frame_count, [&] {
+            for (int i = 0; i < faces.rows; ++i)
+                recognizer->alignCrop(image, faces.row(i), crops[i]);
+            cv::dnn::blobFromImages(crops, opencv_blob, 1.0,
+                                    cv::Size(kalign_size, kalign_size),
+                                    cv::Scalar(), true, false);
+        });
+        const int blob_shape[] = {face_count, 3, kalign_size, kalign_size};
+        ReportSteadyState(state, prefix + "fused/", frame_count, [&] {
+            fused_blob.create(4, blob_shape, CV_32F);
+            for (int i = 0; i < faces.rows; ++i)
+                AlignCropToBlob(image, faces.ptr<float>(i), norm,
+                                fused_blob.ptr<float>(i));
+        });
+        const auto *a = opencv_blob.ptr<float>();
+        const auto *b = fused_blob.ptr<float>();
+        float max_diff = 0.f;
+        for (size_t i = 0; i < fused_blob.total(); ++i)
+            max_diff = std::max(max_diff, std::abs(a[i] - b[i]));
+        state.report(prefix + "max_diff", max_diff, "levels");
+    }
+}
+
+/**
+ * @brief Detector::matchTargetFace在不同特征库规模下的延迟
+ * 选项：--max-size=1000000 --faces=10 --iters=20 --index=0
+ *
+ */
+BENCH_CASE(match_target_face) {
+    const auto max_size = state.option("max-size", 1000000LL);
+    const auto face_count = state.option("faces", 10LL);
+    const auto iterations = state.option("iters", 20LL);
+    Detector detector(MakeBenchYuNet(state), MakeBenchSFace(state));
+    detector.setGalleryIndex(
+        CreateGalleryIndex(static_cast<int>(state.option("index", 0LL))));
+    std::mt19937 rng(7);
+
+    DetectResult detect_result;
+    detect_result.faces =
+        BenchFaces(static_cast<int>(face_count), cv::Size(1280, 720));
+    cv::Mat feature;
+    for (long long i = 0; i < face_count; ++i) {
+        RandomFeature(feature, rng);
+        detect_result.features.push_back(feature);
+    }
+
+    long long size = 0;
+    for (long long target_size = 100; target_size <= max_size;
+         target_size *= 10) {
+        // 逐步扩充特征库，不一次性生成全部目标
+        for (; size < target_size; ++size) {
+            RandomFeature(feature, rng);
+            detector.addTargetData({std::to_string(size), feature});
+        }
+        detector.matchTargetFace(detect_result);
+        const auto ns = MeasureNs(
+            [&] { detector.matchTargetFace(detect_result); }, iterations);
+        state.report("n=" + std::to_string(size) + "/latency", ns / 1e3,
+                     "us/frame");
+    }
+}
+
+/**
+ * @brief visualize在不同人脸数下的延迟
+ * 选项：--iters=100
+ *
+ */
+BENCH_CASE(visualize) {
+    const auto iterations = state.option("iters", 100LL);
+    const cv::Size image_size(640, 480);
+    const auto image = BenchImage(image_size);
+    cv::Mat output_image;
+    for (const int face_count : {1, 10, 30}) {
+        const auto faces = BenchFaces(face_count, image_size);
+        MatchDataVec match_data_vec(face_count);
+        for (int i = 0; i < face_count; ++i) {
+            match_data_vec[i].face = faces.row(i);
+            match_data_vec[i].name = "target";
+            match_data_vec[i].match = i % 2 == 0;
+        }
+        const auto ns = MeasureNs(
+            [&] {
+                visualize(image, match_data_vec, output_image, "FPS:30.00",
+                          true);
+            },
+            iterations);
+        state.report("faces=" + std::to_string(face_count) + "/latency",
+                     ns / 1e6, "ms/frame");
+    }
+}
+
+/**
+ * @brief 读帧→检测→识别→渲染的端到端吞吐，分别测试不跟踪和跟踪
+ * 选项：--frames=300 --video=data/demo.mp4
+ *
+ */
+BENCH_CASE(end_to_end) {
+    const auto frame_count = state.option("frames", 300LL);
+    const auto video_path =
+        state.option("video", std::string(__DATA_DIR__) + "demo.mp4");
+    Detector detector(MakeBenchYuNet(state), MakeBenchSFace(state));
+    EnrollBenchTargets(detector);
+
+    for (const bool tracking : {false, true}) {
+        cv::VideoCapture video_capture(video_path);
+        if (!video_capture.isOpened()) {
+            std::cerr << "[end_to_end]:打开<" << video_path << ">失败\n";
+            return;
+        }
+        FaceTracker tracker;
+        FrameContext context;
+        auto &faces = context.detect_result.faces;
+        cv::Mat frame;
+        long long frames = 0;
+        const auto ns = MeasureNs(
+            [&] {
+                while (frames < frame_count && video_capture.read(frame)) {
+                    if (tracking) {
+                        detector.detectFaceBoxes(frame, kbench_top_k, 1.f,
+                                                 faces);
+                        detector.matchTrackedFace(frame, faces, tracker,
+                                                  context);
+                    } else {
+                        detector.detectFace(frame, kbench_top_k, 1.f,
+                                            context.detect_result);
+                        detector.matchTargetFace(context.detect_result,
+                                                 context);
+                    }
+                    visualize(frame, context.match_data_vec,
+                              context.output_image);
+                    ++frames;
+                }
+            },
+            1);
+        if (frames == 0)
+            continue;
+        const auto prefix = tracking ? "tracking/" : "no_tracking/";
+        state.report(std::string(prefix) + "latency", ns / 1e6 / frames,
+                     "ms/frame");
+        state.report(std::string(prefix) + "fps", frames * 1e9 / ns, "FPS",
+                     false);
+    }
+}
+
+/**
+ * @brief 多个线程并发提交时识别服务的吞吐和平均批大小，与单线程同步
+ * detectFace加matchTargetFace比较，并统计与同步结果不一致的人脸
+ * 选项：--frames=64 --threads=0 --batch=8 --video=data/demo.mp4
+ *
+ */
+BENCH_CASE(recognition_service) {
+    const auto frame_count = state.option("frames", 64LL);
+    const auto video_path =
+        state.option("video", std::string(__DATA_DIR__) + "demo.mp4");
+    RecognitionOptions options;
+    options.thread_count = static_cast<size_t>(state.option("threads", 0LL));
+    // 推理线程间已经并行，与RunBatch一致关闭OpenCV内部并行
+    if (options.thread_count != 1)
+        options.cv_threads = 1;
+    options.max_batch = static_cast<size_t>(state.option("batch", 8LL));
+    options.top_k = kbench_top_k;
+    auto detector_ptr =
+        cv::makePtr<Detector>(MakeBenchYuNet(state), MakeBenchSFace(state));
+    EnrollBenchTargets(*detector_ptr);
+
+    std::vector<cv::Mat> frames;
+    cv::VideoCapture video_capture(video_path);
+    cv::Mat frame;
+    while (static_cast<long long>(frames.size()) < frame_count &&
+           video_capture.read(frame))
+        frames.push_back(frame.clone());
+    while (static_cast<long long>(frames.size()) < frame_count)
+        frames.push_back(BenchImage(cv::Size(1280, 720)));
+
+    // 同步结果作为基准
+    std::vector<MatchDataVec> expected(frames.size());
+    FrameContext context;
+    const auto sync_ns = MeasureNs(
+        [&, index = size_t(0)]() mutable {
+            detector_ptr->detectFace(frames[index], options.top_k,
+                                     options.scale, context.detect_result);
+            detector_ptr->matchTargetFace(context.detect_result, context);
+            expected[index++] = context.match_data_vec;
+        },
+        frames.size());
+    state.report("sync/latency", sync_ns / 1e6, "ms/frame");
+
+    RecognitionService service(options, [&state, detector_ptr] {
+        auto worker_detector =
+            cv::makePtr<Detector>(MakeBenchYuNet(state), MakeBenchSFace(state));
+        worker_detector->setGalleryStore(detector_ptr->galleryStore());
+        return worker_detector;
+    });
+    // 预热，每个识别器配置一次网络
+    for (size_t i = 0; i < service.threadCount(); ++i)
+        service.submit(frames[i % frames.size()]).wait();
+
+    for (const size_t client_count : {1, 4, 16}) {
+        std::vector<std::future<RecognitionResult>> futures(frames.size());
+        const auto before = service.stats();
+        const auto ns = MeasureNs(
+            [&] {
+                std::vector<std::thread> clients;
+                for (size_t c = 0; c < client_count; ++c)
+                    clients.emplace_back([&, c] {
+                        for (size_t i = c; i < frames.size();
+                             i += client_count)
+                            futures[i] = service.submit(frames[i]);
+                    });
+                for (auto &client : clients)
+                    client.join();
+                for (auto &future : futures)
+                    future.wait();
+            },
+            1);
+        const auto after = service.stats();
+        size_t mismatches = 0;
+        for (size_t i = 0; i < frames.size(); ++i) {
+            const auto result = futures[i].get();
+            const auto &match_data_vec = result.match_data_vec;
+            if (!result.ok || match_data_vec.size() != expected[i].size()) {
+                mismatches += std::max(match_data_vec.size(),
+                                       expected[i].size());
+                continue;
+            }
+            for (size_t j = 0; j < match_data_vec.size(); ++j)
+                mismatches += match_data_vec[j].name != expected[i][j].name ||
+                              match_data_vec[j].match != expected[i][j].match;
+        }
+        const auto prefix = "clients=" + std::to_string(client_count) + "/";
+        state.report(prefix + "latency", ns / 1e6 / frames.size(),
+                     "ms/frame");
+        state.report(prefix + "avg_batch",
+                     static_cast<double>(after.completed - before.completed) /
+                         std::max<size_t>(after.batches - before.batches, 1),
+                     "frames", false);
+        state.report(prefix + "mismatches", static_cast<double>(mismatches),
+                     "faces");
+    }
+}
+
+/**
+ * @brief 质量门控在真实视频上省掉的SFace特征提取，以及开关门控的每帧延迟
+ * 选项：--frames=300 --video=data/demo.mp4
+ *
+ */
+BENCH_CASE(quality_gate) {
+    const auto frame_count = state.option("frames", 300LL);
+    const auto video_path =
+        state.option("video", std::string(__DATA_DIR__) + "demo.mp4");
+    Detector detector(MakeBenchYuNet(state), MakeBenchSFace(state));
+    EnrollBenchTargets(detector);
+
+    for (const bool gate : {false, true}) {
+        cv::VideoCapture video_capture(video_path);
+        if (!video_capture.isOpened()) {
+            std::cerr << "[quality_gate]:打开<" << video_path << ">失败\n";
+            return;
+        }
+        QualityParams params;
+        params.enabled = gate;
+        detector.setQualityParams(params);
+        FrameContext context;
+        cv::Mat frame;
+        long long frames = 0;
+        size_t faces = 0, extracted = 0;
+        std::vector<size_t> reasons(kquality_blur + 1, 0);
+        const auto ns = MeasureNs(
+            [&] {
+                while (frames < frame_count && video_capture.read(frame)) {
+                    detector.detectFace(frame, kbench_top_k, 1.f,
+                                        context.detect_result);
+                    detector.matchTargetFace(context.detect_result,
+                                             context);
+                    for (const auto &match_data : context.match_data_vec) {
+                        ++reasons[match_data.quality.reason];
+                        extracted += match_data.quality.verdict ==
+                                     kquality_extract;
+                    }
+                    faces += context.match_data_vec.size();
+                    ++frames;
+                }
+            },
+            1);
+        if (frames == 0)
+            continue;
+        const std::string prefix = gate ? "gate_on/" : "gate_off/";
+        state.report(prefix + "latency", ns / 1e6 / frames, "ms/frame");
+        state.report(prefix + "sface_calls", static_cast<double>(extracted),
+                     "faces");
+        if (!gate)
+            continue;
+        state.report("faces", static_cast<double>(faces), "faces", false);
+        state.report("sface_saved",
+                     faces > 0 ? 1.0 - static_cast<double>(extracted) / faces
+                               : 0.0,
+                     "", false);
+        for (int reason = kquality_low_score; reason <= kquality_blur;
+             ++reason)
+            state.report(std::string("skipped/") +
+                             QualityReasonName(
+                                 static_cast<QualityReason>(reason)),
+                         static_cast<double>(reasons[reason]), "faces", false);
+    }
+}
+
+/**
+ * @brief 复用FrameContext时各环节稳态下每帧的堆分配次数
+ * match、track、predict只有我们自己的代码，应为0；render和full包含OpenCV
+ * 绘制与DNN内部的分配，仅作对比
+ * 选项：--frames=100 --faces=10 --targets=1000 --video=data/demo.mp4
+ *
+ */
+BENCH_CASE(frame_allocations) {
+    const auto frame_count =
+        static_cast<size_t>(state.option("frames", 100LL));
+    const auto face_count = static_cast<int>(state.option("faces", 10LL));
+    const auto target_count = state.option("targets", 1000LL);
+    Detector detector(MakeBenchYuNet(state), MakeBenchSFace(state));
+    std::mt19937 rng(7);
+    cv::Mat feature;
+    TargetDataVec target_data_vec;
+    for (long long i = 0; i < target_count; ++i) {
+        RandomFeature(feature, rng);
+        // 名字长于短字符串优化的长度，确认匹配时复用了字符串内存
+        target_data_vec.push_back(
+            {"targets/bench_target_" + std::to_string(i) + ".jpg",
+             feature.clone()});
+    }
+    detector.addTargetDatas(target_data_vec);
+
+    const cv::Size image_size(1280, 720);
+    const auto image = BenchFrame(state, image_size);
+    DetectResult detect_result;
+    detect_result.faces = BenchFaces(face_count, image_size);
+    for (int i = 0; i < face_count; ++i) {
+        RandomFeature(feature, rng);
+        detect_result.features.push_back(feature);
+    }
+    // 人脸不动，轨迹建立后不再定期复核，只统计关联和身份复用
+    TrackParams track_params;
+    track_params.reverify_interval = std::numeric_limits<int>::max();
+    FaceTracker tracker(track_params), predict_tracker(track_params);
+
+    // 每个环节使用各自的帧缓冲
+    FrameContext match_context, track_context, predict_context,
+        render_context, full_context;
+    predict_tracker.update(detect_result.faces, predict_context.assignments);
+    detector.matchTargetFace(detect_result, render_context);
+    const std::vector<std::pair<std::string, std::function<void()>>>
+        stages = {
+            {"match",
+             [&] { detector.matchTargetFace(detect_result, match_context); }},
+            {"track",
+             [&] {
+                 detector.matchTrackedFace(image, detect_result.faces,
+                                           tracker, track_context);
+             }},
+            {"predict",
+             [&] {
+                 detector.matchPredictedFace(predict_tracker,
+                                             predict_context);
+             }},
+            {"render",
+             [&] {
+                 visualize(image, render_context.match_data_vec,
+                           render_context.output_image, "FPS:30.00");
+             }},
+            {"full",
+             [&] {
+                 detector.detectFace(image, kbench_top_k, 1.f,
+                                     full_context.detect_result);
+                 detector.matchTargetFace(full_context.detect_result,
+                                          full_context);
+             }},
+        };
+    for (const auto &[stage, func] : stages) {
+        const auto frame_allocations =
+            ReportSteadyState(state, stage + "/", frame_count, func);
+        const bool own_code_only =
+            stage == "match" || stage == "track" || stage == "predict";
+        if (own_code_only && frame_allocations > 0.0)
+            std::cerr << "[frame_allocations]:<" << stage
+                      << ">稳态下每帧仍有" << frame_allocations << "次分配\n";
+    }
+}
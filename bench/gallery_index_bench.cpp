@@ -0,0 +1,180 @@
+// std
+#include <random>
+
+// bench
+#include "bench.hpp"
+
+// custom
+#include "hnsw_index.hpp"
+
+namespace {
+constexpr int kfeature_dim = 128;
+
+/**
+ * @brief 生成随机单位特征，模拟不同的人
+ *
+ */
+cv::Mat RandomFeature(std::mt19937 &rng) {
+    std::normal_distribution<float> normal;
+    cv::Mat feature(1, kfeature_dim, CV_32F);
+    for (int i = 0; i < kfeature_dim; ++i)
+        feature.at<float>(i) = normal(rng);
+    return feature;
+}
+
+/**
+ * @brief 在目标特征上加噪声，模拟同一个人的另一张照片
+ *
+ */
+cv::Mat NoisyCopy(const float *target, float noise, std::mt19937 &rng) {
+    std::normal_distribution<float> normal(0.f, noise);
+    cv::Mat feature(1, kfeature_dim, CV_32F);
+    for (int i = 0; i < kfeature_dim; ++i)
+        feature.at<float>(i) = target[i] + normal(rng);
+    return feature;
+}
+} // namespace
+
+/**
+ * @brief 不同特征库规模下HNSW相对暴力搜索的recall@1与单次查询延迟
+ * 选项：--max-size=100000 --queries=1000 --noise=0.05
+ *
+ */
+BENCH_CASE(gallery_index) {
+    const auto max_size = state.option("max-size", 100000LL);
+    const auto query_count = state.option("queries", 1000LL);
+    const auto noise =
+        std::stof(state.option("noise", std::string("0.05")));
+    const std::vector<int> ef_search_list = {16, 32, 64, 128};
+    std::mt19937 rng(7);
+
+    for (long long size = 1000; size <= max_size; size *= 10) {
+        BruteForceIndex brute_force;
+        HnswIndex hnsw;
+        brute_force.reserve(size);
+        for (long long i = 0; i < size; ++i)
+            brute_force.add(std::to_string(i), RandomFeature(rng));
+
+        const auto &gallery = brute_force.gallery();
+        const auto build_ns = MeasureNs(
+            [&] {
+                hnsw.reserve(size);
+                for (long long i = 0; i < size; ++i) {
+                    cv::Mat feature(1, kfeature_dim, CV_32F,
+                                    const_cast<float *>(gallery.row(i)));
+                    hnsw.add(std::string(gallery.name(i)), feature);
+                }
+            },
+            1);
+
+        cv::Mat queries;
+        std::uniform_int_distribution<long long> pick(0, size - 1);
+        for (long long i = 0; i < query_count; ++i)
+            queries.push_back(NoisyCopy(gallery.row(pick(rng)), noise, rng));
+        cv::Mat packed_queries;
+        gallery.packQueries(queries, packed_queries);
+
+        const GallerySearchParams params;
+        std::vector<GallerySearchResult> truth;
+        const auto brute_ns = MeasureNs(
+            [&] {
+                brute_force.search(packed_queries,
+                                   cv::FaceRecognizerSF::FR_COSINE, params,
+                                   truth);
+            },
+            1);
+        const auto prefix = "n=" + std::to_string(size) + "/";
+        state.report(prefix + "brute_force_latency", brute_ns / query_count,
+                     "ns/query");
+        state.report(prefix + "hnsw_build", build_ns / 1e6, "ms");
+
+        for (const int ef_search : ef_search_list) {
+            hnsw.setEfSearch(ef_search);
+            std::vector<GallerySearchResult> approx;
+            const auto hnsw_ns = MeasureNs(
+                [&] {
+                    hnsw.search(packed_queries,
+                                cv::FaceRecognizerSF::FR_COSINE, params,
+                                approx);
+                },
+                1);
+            size_t hits = 0;
+            for (size_t i = 0; i < truth.size(); ++i)
+                hits += !approx[i].candidates.empty() &&
+                        approx[i].candidates.front().index ==
+                            truth[i].candidates.front().index;
+            const auto ef_prefix =
+                prefix + "ef=" + std::to_string(ef_search) + "/";
+            state.report(ef_prefix + "hnsw_latency", hnsw_ns / query_count,
+                         "ns/query");
+            state.report(ef_prefix + "recall@1",
+                         static_cast<double>(hits) / truth.size(), "", false);
+        }
+    }
+}
+
+/**
+ * @brief 每个身份录入多张图片时，身份中心剪枝相对完整扫描的延迟，
+ * 并检查两者的前top_k个候选完全一致
+ * 选项：--identities=10000 --images=8 --queries=1000 --top-k=2
+ *
+ */
+BENCH_CASE(gallery_centroid_pruning) {
+    const auto identity_count = state.option("identities", 10000LL);
+    const auto image_count = state.option("images", 8LL);
+    const auto query_count = state.option("queries", 1000LL);
+    GallerySearchParams params;
+    params.top_k = static_cast<int>(state.option("top-k", 2LL));
+    std::mt19937 rng(11);
+
+    BruteForceIndex brute_force;
+    brute_force.reserve(identity_count * image_count);
+    for (long long i = 0; i < identity_count; ++i) {
+        const auto identity = RandomFeature(rng);
+        const auto *target = identity.ptr<float>();
+        for (long long j = 0; j < image_count; ++j)
+            brute_force.add(std::to_string(i), NoisyCopy(target, 0.3f, rng));
+    }
+    const auto &gallery = brute_force.gallery();
+
+    cv::Mat queries;
+    std::uniform_int_distribution<size_t> pick(0, gallery.size() - 1);
+    for (long long i = 0; i < query_count; ++i)
+        queries.push_back(NoisyCopy(gallery.row(pick(rng)), 0.3f, rng));
+    cv::Mat packed_queries;
+    gallery.packQueries(queries, packed_queries);
+
+    std::vector<GallerySearchResult> truth;
+    const auto full_ns = MeasureNs(
+        [&] {
+            brute_force.search(packed_queries,
+                               cv::FaceRecognizerSF::FR_COSINE, params,
+                               truth);
+        },
+        3);
+    params.centroid_pruning = true;
+    std::vector<GallerySearchResult> pruned;
+    // 身份中心在发布前构建，不计入延迟
+    brute_force.prepare();
+    const auto pruned_ns = MeasureNs(
+        [&] {
+            brute_force.search(packed_queries,
+                               cv::FaceRecognizerSF::FR_COSINE, params,
+                               pruned);
+        },
+        3);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < truth.size(); ++i) {
+        const auto &expected = truth[i].candidates;
+        const auto &actual = pruned[i].candidates;
+        bool same = expected.size() == actual.size();
+        for (size_t j = 0; same && j < expected.size(); ++j)
+            same = gallery.name(expected[j].index) ==
+                   gallery.name(actual[j].index);
+        mismatches += !same;
+    }
+    state.report("full_scan_latency", full_ns / query_count, "ns/query");
+    state.report("pruned_latency", pruned_ns / query_count, "ns/query");
+    state.report("mismatches", static_cast<double>(mismatches), "");
+}
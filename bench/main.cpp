@@ -0,0 +1,182 @@
+// std
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+
+// bench
+#include "bench.hpp"
+
+std::vector<BenchCase> &BenchCases() {
+    static std::vector<BenchCase> bench_cases;
+    return bench_cases;
+}
+
+std::vector<BenchResult> &BenchResults() {
+    static std::vector<BenchResult> bench_results;
+    return bench_results;
+}
+
+std::string BenchState::option(const std::string &name,
+                               const std::string &default_val) const {
+    const auto prefix = "--" + name + "=";
+    for (const auto &arg : args_)
+        if (arg.rfind(prefix, 0) == 0)
+            return arg.substr(prefix.size());
+    return default_val;
+}
+
+long long BenchState::option(const std::string &name,
+                             long long default_val) const {
+    const auto value = option(name, std::string());
+    return value.empty() ? default_val : std::stoll(value);
+}
+
+void BenchState::report(const std::string &metric, double value,
+                        const std::string &unit, bool lower_is_better) {
+    std::cout << case_name_ << "/" << metric << ": " << value << " " << unit
+              << "\n";
+    BenchResults().push_back({case_name_, metric, value, unit,
+                              lower_is_better});
+}
+
+namespace {
+std::string JsonEscape(const std::string &text) {
+    std::string escaped;
+    for (const char c : text) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+/**
+ * @brief 写出JSON结果，每项指标一行，便于CI逐行比较
+ *
+ */
+bool WriteJson(const std::string &file_path,
+               const std::vector<BenchResult> &results) {
+    std::ofstream file(file_path);
+    if (!file) {
+        std::cerr << "[bench->WriteJson]:无法写入<" << file_path << ">\n";
+        return false;
+    }
+    file << "{\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &result = results[i];
+        file << "    {\"case\": \"" << JsonEscape(result.case_name)
+             << "\", \"metric\": \"" << JsonEscape(result.metric)
+             << "\", \"value\": " << result.value << ", \"unit\": \""
+             << JsonEscape(result.unit) << "\", \"lower_is_better\": "
+             << (result.lower_is_better ? "true" : "false") << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+    return true;
+}
+
+/**
+ * @brief 读取WriteJson写出的基线文件
+ *
+ */
+bool ReadJson(const std::string &file_path,
+              std::map<std::string, BenchResult> &results) {
+    std::ifstream file(file_path);
+    if (!file) {
+        std::cerr << "[bench->ReadJson]:无法读取<" << file_path << ">\n";
+        return false;
+    }
+    static const std::regex line_regex(
+        R"re("case": "((?:[^"\\]|\\.)*)", "metric": "((?:[^"\\]|\\.)*)", )re"
+        R"re("value": ([^,]+), "unit": "((?:[^"\\]|\\.)*)", )re"
+        R"re("lower_is_better": (true|false))re");
+    std::string line;
+    std::smatch match;
+    while (std::getline(file, line)) {
+        if (!std::regex_search(line, match, line_regex))
+            continue;
+        BenchResult result{match[1], match[2], std::stod(match[3]), match[4],
+                           match[5] == "true"};
+        results[result.case_name + "/" + result.metric] = result;
+    }
+    return true;
+}
+
+/**
+ * @brief 与基线比较，变差超过容差的指标视为退化
+ *
+ * @return size_t 退化的指标个数
+ */
+size_t CompareBaseline(const std::vector<BenchResult> &results,
+                       const std::map<std::string, BenchResult> &baseline,
+                       double tolerance) {
+    size_t regressions = 0;
+    for (const auto &result : results) {
+        const auto key = result.case_name + "/" + result.metric;
+        const auto it = baseline.find(key);
+        if (it == baseline.end()) {
+            std::cout << "[new]:" << key << "\n";
+            continue;
+        }
+        const double base = it->second.value;
+        if (base == 0.0)
+            continue;
+        const double change = (result.value - base) / std::abs(base);
+        const bool regressed =
+            result.lower_is_better ? change > tolerance : change < -tolerance;
+        if (!regressed)
+            continue;
+        ++regressions;
+        std::cout << "[regression]:" << key << " " << base << " -> "
+                  << result.value << " " << result.unit << " ("
+                  << change * 100.0 << "%)\n";
+    }
+    return regressions;
+}
+} // namespace
+
+/**
+ * @brief 用法：bench [用例名...] [--选项=值...]，不指定用例时运行全部
+ * --json=<文件> 写出JSON结果；--baseline=<文件> 与基线比较，
+ * 变差超过--tolerance（默认0.1即10%）时返回1
+ *
+ */
+int main(int argc, char *argv[]) {
+    std::vector<std::string> names;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) == 0)
+            args.push_back(arg);
+        else
+            names.push_back(arg);
+    }
+    for (const auto &bench_case : BenchCases()) {
+        if (!names.empty() &&
+            std::find(names.begin(), names.end(), bench_case.name) ==
+                names.end())
+            continue;
+        std::cout << "[bench]:" << bench_case.name << "\n";
+        BenchState state(bench_case.name, args);
+        bench_case.func(state);
+    }
+
+    const BenchState options("", args);
+    const auto json_path = options.option("json", std::string());
+    if (!json_path.empty() && !WriteJson(json_path, BenchResults()))
+        return 1;
+    const auto baseline_path = options.option("baseline", std::string());
+    if (!baseline_path.empty()) {
+        std::map<std::string, BenchResult> baseline;
+        if (!ReadJson(baseline_path, baseline))
+            return 1;
+        const auto tolerance =
+            std::stod(options.option("tolerance", std::string("0.1")));
+        if (CompareBaseline(BenchResults(), baseline, tolerance) > 0)
+            return 1;
+    }
+    return 0;
+}
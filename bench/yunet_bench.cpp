@@ -0,0 +1,146 @@
+// bench
+#include "bench.hpp"
+#include "bench_models.hpp"
+
+// custom
+#include "motion_gate.hpp"
+#include "tiled_detector.hpp"
+
+namespace {
+/**
+ * @brief 依次处理每一帧，统计稳态延迟和堆分配次数
+ *
+ */
+template <typename Func>
+void ReportFrames(BenchState &state, const std::string &prefix,
+                  const std::vector<cv::Mat> &frames, Func &&func) {
+    size_t index = 0;
+    ReportSteadyState(state, prefix, frames.size(), [&] {
+        func(frames[index]);
+        index = (index + 1) % frames.size();
+    });
+}
+} // namespace
+
+/**
+ * @brief 每帧重新配置输入尺寸（旧实现）与按尺寸缓存检测器、填充到固定尺寸
+ * 的稳态延迟和堆分配次数
+ * 选项：--frames=60 --yunet=<模型>
+ *
+ */
+BENCH_CASE(yunet_input_size) {
+    const auto frame_count = state.option("frames", 60LL);
+    const auto model_path = BenchYuNetPath(state);
+
+    // 单路视频：尺寸不变；多种尺寸：多路视频或录入图片
+    const std::vector<std::pair<std::string, std::vector<cv::Size>>>
+        workloads = {
+            {"video", {cv::Size(640, 480)}},
+            {"mixed",
+             {cv::Size(640, 480), cv::Size(1280, 720), cv::Size(800, 600)}},
+        };
+    for (const auto &[workload, sizes] : workloads) {
+        std::vector<cv::Mat> frames;
+        for (long long i = 0; i < frame_count; ++i)
+            frames.push_back(BenchImage(sizes[i % sizes.size()]));
+        const auto prefix = workload + "/";
+
+        auto raw = cv::FaceDetectorYN::create(
+            model_path, "", sizes[0], kbench_conf_threshold,
+            kbench_nms_threshold, kbench_top_k);
+        ReportFrames(state, prefix + "reconfigure/", frames,
+                     [&raw](const cv::Mat &frame) {
+                         cv::Mat faces;
+                         raw->setInputSize(frame.size());
+                         raw->setTopK(kbench_top_k);
+                         raw->detect(frame, faces);
+                     });
+
+        auto yunet = MakeBenchYuNet(state);
+        cv::Mat faces;
+        ReportFrames(state, prefix + "cached/", frames,
+                     [&yunet, &faces](const cv::Mat &frame) {
+                         yunet.setInputSize(frame.size());
+                         yunet.setTopK(kbench_top_k);
+                         yunet.infer(frame, faces);
+                     });
+        ReportFrames(state, prefix + "letterbox/", frames,
+                     [&yunet](const cv::Mat &frame) {
+                         yunet.inferLetterbox(frame, cv::Size(640, 640));
+                     });
+    }
+}
+
+/**
+ * @brief 4K图像整图检测与分块检测（单线程、多线程、限制每帧图块数）的延迟
+ * 选项：--frames=10 --tile=640 --threads=0 --yunet=<模型>
+ *
+ */
+BENCH_CASE(yunet_tiled) {
+    const auto frame_count = state.option("frames", 10LL);
+    const auto tile_size = static_cast<int>(state.option("tile", 640LL));
+    const auto thread_count =
+        static_cast<size_t>(state.option("threads", 0LL));
+    const auto image = BenchImage(cv::Size(3840, 2160));
+
+    auto yunet = MakeBenchYuNet(state);
+    yunet.setInputSize(image.size());
+    cv::Mat faces;
+    const auto full_ns =
+        MeasureNs([&] { yunet.infer(image, faces); }, frame_count);
+    state.report("full_frame/latency", full_ns / 1e6, "ms/frame");
+
+    const std::vector<std::pair<std::string, TileOptions>> variants = [&] {
+        TileOptions single;
+        single.tile_size = tile_size;
+        single.thread_count = 1;
+        TileOptions parallel = single;
+        parallel.thread_count = thread_count;
+        TileOptions bounded = parallel;
+        bounded.max_tiles = 4;
+        bounded.coarse_scale = 0.25f;
+        return std::vector<std::pair<std::string, TileOptions>>{
+            {"tiled_single", single},
+            {"tiled_parallel", parallel},
+            {"tiled_bounded", bounded}};
+    }();
+    for (const auto &[name, options] : variants) {
+        TiledDetector tiled(options, [&state] {
+            return cv::makePtr<YuNet>(MakeBenchYuNet(state));
+        });
+        // 第一帧配置各线程的网络，不计入延迟
+        tiled.detect(image, kbench_top_k, faces);
+        const auto ns = MeasureNs(
+            [&] { tiled.detect(image, kbench_top_k, faces); }, frame_count);
+        state.report(name + "/latency", ns / 1e6, "ms/frame");
+    }
+}
+
+/**
+ * @brief 静止画面上运动门控与整图检测每帧的延迟，以及门控后实际检测的比例
+ * 选项：--frames=100 --width=1920 --height=1080 --yunet=<模型>
+ *
+ */
+BENCH_CASE(motion_gate) {
+    const auto frame_count = state.option("frames", 100LL);
+    const cv::Size size(static_cast<int>(state.option("width", 1920LL)),
+                        static_cast<int>(state.option("height", 1080LL)));
+    const auto image = BenchImage(size);
+
+    auto yunet = MakeBenchYuNet(state);
+    yunet.setInputSize(size);
+    cv::Mat faces;
+    const auto detect_ns =
+        MeasureNs([&] { yunet.infer(image, faces); }, 10);
+    state.report("detect/latency", detect_ns / 1e6, "ms/frame");
+
+    MotionParams params;
+    params.enabled = true;
+    MotionGate gate(params);
+    size_t detected = 0;
+    const auto gate_ns = MeasureNs(
+        [&] { detected += gate.update(image, faces).detect; }, frame_count);
+    state.report("gate/latency", gate_ns / 1e6, "ms/frame");
+    state.report("gate/detect_ratio",
+                 static_cast<double>(detected) / frame_count, "");
+}
@@ -0,0 +1,115 @@
+#pragma once
+// std
+#include <cstddef>
+#include <mutex>
+
+// opencv
+#include <opencv2/core.hpp>
+
+/**
+ * @brief 自适应控制参数
+ *
+ */
+struct AdaptiveParams {
+    bool enabled = false;
+    // 检测阶段每帧平均耗时预算，如30FPS为33ms
+    float budget_ms = 33.f;
+    // 检测输入相对原图的缩放范围和步长
+    float min_scale = 0.25f;
+    float max_scale = 1.f;
+    float scale_step = 0.1f;
+    // 最多每几帧做一次完整检测，其余帧用跟踪预测或沿用上次结果
+    int max_skip = 4;
+    // 检测输入上人脸高度低于该值时认为小脸可能漏检，提高分辨率
+    float min_face_px = 24.f;
+    // 每隔多少帧调整一次，避免来回振荡
+    int adjust_interval = 10;
+};
+
+/**
+ * @brief 一帧的控制决策
+ *
+ */
+struct AdaptiveDecision {
+    // 是否做完整检测
+    bool detect = true;
+    // 检测输入缩放
+    float scale = 1.f;
+    // 当前每几帧检测一次
+    int skip = 1;
+};
+
+/**
+ * @brief 控制器的当前状态和累计统计
+ *
+ */
+struct AdaptiveStats {
+    float scale = 1.f;
+    int skip = 1;
+    // 每帧平均耗时（指数滑动平均）与预算
+    double avg_cost_ms = 0.0;
+    double budget_ms = 0.0;
+    size_t detect_frames = 0;
+    size_t skipped_frames = 0;
+    // 因小脸提高分辨率的次数
+    size_t small_face_raises = 0;
+};
+
+/**
+ * @brief 自适应检测分辨率与跳帧控制器
+ * 超出预算时先降低检测分辨率，画面中有小脸时改为增加跳帧；
+ * 预算宽裕时先减少跳帧，再提高分辨率
+ * 所有接口线程安全，参数可在运行时热更新
+ *
+ */
+class AdaptiveController {
+  public:
+    explicit AdaptiveController(const AdaptiveParams &params = {}) {
+        setParams(params);
+    }
+
+    /**
+     * @brief 更新参数，当前缩放和跳帧会被限制在新的范围内
+     *
+     * @param params 参数
+     */
+    void setParams(const AdaptiveParams &params);
+
+    /**
+     * @brief 决定当前帧是否检测以及检测分辨率
+     *
+     * @return AdaptiveDecision
+     */
+    AdaptiveDecision decide();
+
+    /**
+     * @brief 报告当前帧的处理结果
+     *
+     * @param decision decide()的返回值
+     * @param cost_ms 当前帧耗时
+     * @param faces 检测到的人脸（原图坐标），未检测时忽略
+     */
+    void report(const AdaptiveDecision &decision, double cost_ms,
+                const cv::Mat &faces);
+
+    /**
+     * @brief 当前状态和累计统计
+     *
+     * @return AdaptiveStats
+     */
+    AdaptiveStats stats() const;
+
+  private:
+    void adjust();
+
+    mutable std::mutex mutex_;
+    AdaptiveParams params_;
+    float scale_ = 1.f;
+    int skip_ = 1;
+    int frames_since_detect_ = 0;
+    int frames_since_adjust_ = 0;
+    bool first_frame_ = true;
+    // 最近一次检测是否有小脸
+    bool small_face_ = false;
+    AdaptiveStats stats_;
+};
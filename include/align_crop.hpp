@@ -0,0 +1,41 @@
+#pragma once
+// opencv
+#include <opencv2/core.hpp>
+
+// 对齐后的人脸图像边长，与SFace的输入一致
+constexpr int kalign_size = 112;
+
+/**
+ * @brief 写入网络输入时的归一化参数，输出=(像素-均值)×比例
+ *
+ */
+struct BlobNormalization {
+    double scale = 1.0;
+    // 按输出通道顺序
+    cv::Scalar mean;
+    // 输出按RGB顺序
+    bool swap_rb = true;
+};
+
+/**
+ * @brief 由5个关键点估计到SFace对齐模板的相似变换（最小二乘闭式解）
+ *
+ * @param face YuNet格式的一行人脸（原图坐标）
+ * @param transform 输出2×3矩阵，按行存放，原图坐标映射到对齐图像坐标
+ */
+void EstimateAlignTransform(const float *face, float transform[6]);
+
+/**
+ * @brief 对齐裁剪一张人脸，直接写入NCHW浮点网络输入
+ * 由对齐图像的每个像素反算原图坐标，双线性采样后归一化、交换通道，
+ * 省去alignCrop的中间BGR图像和blobFromImage的转换；内部像素每次
+ * 处理8个（AVX2 gather），靠近图像边缘的按越界像素为0逐个计算，
+ * 与warpAffine的常数边界一致
+ *
+ * @param image 原图，BGR，其他格式先转换
+ * @param face YuNet格式的一行人脸
+ * @param norm 归一化参数
+ * @param blob 输出，3×kalign_size×kalign_size，可以是批量输入中的一张
+ */
+void AlignCropToBlob(const cv::Mat &image, const float *face,
+                     const BlobNormalization &norm, float *blob);
@@ -0,0 +1,60 @@
+#pragma once
+// std
+#include <string>
+
+// custom
+#include "detector.hpp"
+#include "enrollment.hpp"
+
+/**
+ * @brief 离线批处理参数
+ *
+ */
+struct BatchOptions {
+    // 线程数，0表示使用所有核心；不超过GalleryStore::kmax_readers
+    size_t thread_count = 0;
+    // 处理期间OpenCV全局的内部线程数（cv::setNumThreads），结束后恢复；
+    // 负数表示不修改
+    int cv_threads = -1;
+    // 每段最多包含的帧数（或图片数），每段由一个线程独立解码和识别
+    int chunk_frames = 300;
+    int top_k = 5000;
+    // 检测输入相对原图的缩放，结果仍为原图坐标
+    float scale = 1.f;
+};
+
+/**
+ * @brief 离线批处理统计
+ *
+ */
+struct BatchStats {
+    size_t frames = 0;
+    size_t faces = 0;
+    size_t chunks = 0;
+    // 读取失败的帧或图片
+    size_t failed = 0;
+    double seconds = 0.0;
+};
+
+/**
+ * @brief 离线处理视频或图片文件夹，无界面
+ * 输入按帧序切分为若干段，各线程使用独立的识别器并行处理，
+ * 结果按帧序逐段写出为JSONL，每行一帧：
+ * {"frame":帧序号,"time":秒（视频）或"file":路径（图片）,
+ *  "faces":[{"box":[x,y,w,h],"landmarks":[[x,y]...],"score":检测置信度,
+ *            "name":名字,"conf":匹配分数,"match":是否匹配,
+ *            "quality":质量不合格没有识别的原因（仅此时输出）}]}
+ *
+ * @param source 视频文件或图片文件夹路径
+ * @param output_path 输出文件路径
+ * @param detector_ptr 已加载特征库的识别器，作为第一个工作线程使用
+ * @param detector_factory 为其余工作线程创建共享同一特征库的识别器
+ * @param options 参数
+ * @param stats 输出统计
+ * @return true 成功
+ * @return false 输入无法打开或输出无法写入
+ */
+bool ProcessBatch(const std::string &source, const std::string &output_path,
+                  cv::Ptr<Detector> detector_ptr,
+                  const DetectorFactory &detector_factory,
+                  const BatchOptions &options, BatchStats &stats);
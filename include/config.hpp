@@ -1,62 +1,102 @@
 #pragma once
-
-#include <any>
-#include <map>
-
-#include "config_reader.hpp"
+// std
+#include <string>
+#include <vector>
 
 constexpr const char *kconfig_name = "val.yml";
 
-// 配置数据类型
-using ConfigBasicType = std::any;
-using ConfigMap = std::map<std::string, ConfigBasicType>;
-
-// 配置数据表包含数据名和默认值
-const ConfigMap kconfig_map = {
-    {"debug", 1},
-    {"cap_or_video", 0},
-    {"cap_index", 0},
-    {"video_name", std::string("face_test.mp4")},
-    {"zoom", 1.0f},
-    {"backend_target", 0},
-    {"detection_onnx", std::string("face_detection_yunet_2023mar.onnx")},
-    {"sface_onnx", std::string("face_recognition_sface_2021dec.onnx")},
-    {"detect_threshold", 0.8f},
-    {"nms_threshold", 0.3f},
-    {"top_k", 5000},
-    {"distance_type", 0},
-    {"cosine_threshold", 0.363f},
-    {"norml2_threshold", 1.128f},
-    {"targets_dir_name", std::string("targets")},
-    {"draw_face_points", true},
-};
-
 /**
- * @brief 配置基本数据转为原始数据
- * 对原始数据类型进行强匹配如：const char* 不能 -> std::string 反之亦然
+ * @brief 配置项列表：类型、名称（与val.yml中的键相同）、默认值
+ * 新增配置只需在此添加一行，并在val.yml中补充说明
  *
- * @tparam T 原始数据类型
- * @param data 配置基本类型数据
- * @return auto 数据
  */
-template <typename T> auto ConfigBasicTypeToRaw(ConfigBasicType data) {
-    std::any data_copy = data;
-    if (data.has_value())
-        return std::any_cast<T>(data_copy);
-    else
-        return T();
-}
+#define CONFIG_FIELDS(X)                                                       \
+    X(int, debug, 1)                                                           \
+    X(int, cap_or_video, 0)                                                    \
+    X(int, cap_index, 0)                                                       \
+    X(std::string, video_name, "face_test.mp4")                                \
+    X(float, zoom, 1.0f)                                                       \
+    X(int, capture_backend, 0)                                                 \
+    X(int, decode_threads, 0)                                                  \
+    X(std::string, hw_decode, "")                                              \
+    X(int, backend_target, 0)                                                  \
+    X(std::string, detection_onnx, "face_detection_yunet_2023mar.onnx")        \
+    X(std::string, sface_onnx, "face_recognition_sface_2021dec.onnx")          \
+    X(std::string, detection_int8_onnx,                                        \
+      "face_detection_yunet_2023mar_int8.onnx")                                \
+    X(std::string, sface_int8_onnx,                                            \
+      "face_recognition_sface_2021dec_int8.onnx")                              \
+    X(int, precision, 0)                                                       \
+    X(float, detect_threshold, 0.8f)                                           \
+    X(float, nms_threshold, 0.3f)                                              \
+    X(int, top_k, 5000)                                                        \
+    X(int, tile_size, 0)                                                       \
+    X(float, tile_overlap, 0.2f)                                               \
+    X(int, tile_threads, 0)                                                    \
+    X(int, tile_max, 0)                                                        \
+    X(float, tile_coarse_scale, 0.f)                                           \
+    X(int, distance_type, 0)                                                   \
+    X(float, cosine_threshold, 0.363f)                                         \
+    X(float, norml2_threshold, 1.128f)                                         \
+    X(float, match_margin, 0.f)                                                \
+    X(int, match_top_k, 2)                                                     \
+    X(bool, centroid_pruning, false)                                           \
+    X(bool, quality_gate, false)                                               \
+    X(float, quality_min_size, 24.f)                                           \
+    X(float, quality_min_score, 0.85f)                                         \
+    X(float, quality_max_yaw, 0.5f)                                            \
+    X(float, quality_skip_yaw, 0.8f)                                           \
+    X(float, quality_max_pitch, 0.6f)                                          \
+    X(float, quality_min_sharpness, 20.f)                                      \
+    X(std::string, targets_dir_name, "targets")                                \
+    X(std::string, gallery_name, "targets.gallery")                            \
+    X(std::string, enroll_cache_name, "targets.cache")                         \
+    X(int, enroll_threads, 0)                                                  \
+    X(int, gallery_index, 0)                                                   \
+    X(int, hnsw_m, 16)                                                         \
+    X(int, hnsw_ef_construction, 200)                                          \
+    X(int, hnsw_ef_search, 64)                                                 \
+    X(int, pipeline_queue_size, 4)                                             \
+    X(int, pipeline_backpressure, 0)                                           \
+    X(std::vector<std::string>, streams, {})                                   \
+    X(int, stream_workers, 2)                                                  \
+    X(int, stream_batch_size, 8)                                               \
+    X(int, stream_report_interval, 5)                                          \
+    X(int, metrics_port, 0)                                                    \
+    X(std::string, metrics_file, "")                                           \
+    X(int, metrics_interval, 10)                                               \
+    X(int, batch_threads, 0)                                                   \
+    X(int, batch_chunk_frames, 300)                                            \
+    X(bool, tracking, true)                                                    \
+    X(float, track_iou_threshold, 0.3f)                                        \
+    X(float, track_reverify_iou, 0.5f)                                         \
+    X(int, track_reverify_interval, 30)                                        \
+    X(float, track_max_box_change, 0.3f)                                       \
+    X(int, track_max_missed, 10)                                               \
+    X(bool, adaptive, false)                                                   \
+    X(float, adaptive_budget_ms, 33.f)                                         \
+    X(float, adaptive_min_scale, 0.25f)                                        \
+    X(float, adaptive_max_scale, 1.f)                                          \
+    X(float, adaptive_scale_step, 0.1f)                                        \
+    X(int, adaptive_max_skip, 4)                                               \
+    X(float, adaptive_min_face_px, 24.f)                                       \
+    X(int, adaptive_adjust_interval, 10)                                       \
+    X(bool, motion_gate, false)                                                \
+    X(int, motion_width, 160)                                                  \
+    X(int, motion_threshold, 20)                                               \
+    X(float, motion_cell_ratio, 0.2f)                                          \
+    X(int, motion_background_shift, 2)                                         \
+    X(int, motion_full_interval, 30)                                           \
+    X(bool, draw_face_points, true)
 
 /**
- * @brief 传入读取器，读取指定配置数据
+ * @brief 配置快照，启动和热更新时整体解析一次，之后只读
+ * 配置文件中缺少的项使用默认值
  *
- * @tparam T 配置数据类型
- * @param reader 读取器
- * @param data_name 数据名
- * @return T 数据
  */
-template <typename T>
-T GetConfigData(const ConfigReader &reader, const std::string &data_name) {
-    auto raw_data = ConfigBasicTypeToRaw<T>(kconfig_map.at(data_name));
-    return reader.readData(kconfig_name, data_name, raw_data);
-}
+struct ConfigSnapshot {
+#define CONFIG_FIELD_DECLARE(type, name, default_value)                        \
+    type name = default_value;
+    CONFIG_FIELDS(CONFIG_FIELD_DECLARE)
+#undef CONFIG_FIELD_DECLARE
+};
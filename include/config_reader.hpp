@@ -1,14 +1,19 @@
 #pragma once
 
 // std
-#include <chrono>
+#include <atomic>
 #include <filesystem>
 #include <iostream>
-#include <thread>
+#include <memory>
+#include <vector>
 
 // opencv
 #include <opencv2/core/persistence.hpp>
 
+// custom
+#include "config.hpp"
+#include "file_watcher.hpp"
+
 namespace cv {
 /**
  * @brief 定义新的bool类型解析器
@@ -33,17 +38,38 @@ template <> inline void operator>>(const cv::FileNode &n, bool &value) {
 
 /**
  * @brief 配置读取器
+ * 构造时将kconfig_name解析为快照，热更新时整体替换快照，
+ * 读取快照无锁且不访问文件
  *
  */
 class ConfigReader {
   public:
+    ConfigReader() { reload(); }
+
     /**
-     * @brief 设置配置文件文件夹
+     * @brief 设置配置文件文件夹，并重新解析快照
      *
      * @param dir_path 文件夹路径
      */
     void setConfigPath(std::string dir_path);
 
+    /**
+     * @brief 重新解析kconfig_name，成功后原子替换快照
+     *
+     * @return true 解析成功
+     * @return false 文件不存在或格式错误，保留原快照
+     */
+    bool reload();
+
+    /**
+     * @brief 当前配置快照，持有期间内容不变
+     *
+     * @return std::shared_ptr<const ConfigSnapshot>
+     */
+    std::shared_ptr<const ConfigSnapshot> snapshot() const {
+        return snapshot_.load(std::memory_order_acquire);
+    }
+
     /**
      * @brief 读取配置文件中指定数据
      *
@@ -78,39 +104,34 @@ class ConfigReader {
     }
 
     /**
-     * @brief 热更新，配置文件修改时，执行回调函数
+     * @brief 热更新，配置文件修改时重新解析快照，成功后在共享的监听线程中
+     * 执行回调函数；读取器析构时自动注销
      *
      * @tparam CallBack 回调函数类型
-     * @param file_name 文件名
      * @param f 回调函数
-     * @param fps 刷新频率
      * @return true 注册成功
      * @return false 注册失败
      */
-    template <typename CallBack>
-    bool registerHotUpdate(const std::string &file_name, CallBack &&f,
-                           size_t fps = 10) const {
-        auto file_path = config_path_ + file_name;
-        if (!std::filesystem::exists(file_path))
+    template <typename CallBack> bool registerHotUpdate(CallBack &&f) {
+        auto handle = FileWatcher::Shared()->watch(
+            config_path_ + kconfig_name,
+            [this, f = std::forward<CallBack>(f)] {
+                if (reload())
+                    f();
+            });
+        if (!handle)
             return false;
-        std::thread([file_path, f, fps] {
-            auto last_time = std::filesystem::last_write_time(file_path);
-            while (true) {
-                std::this_thread::sleep_for(
-                    std::chrono::milliseconds(1000 / fps));
-                auto now_time = std::filesystem::last_write_time(file_path);
-                if (last_time.time_since_epoch() == now_time.time_since_epoch())
-                    continue;
-                last_time = std::filesystem::last_write_time(file_path);
-                f();
-            }
-        }).detach();
+        hot_update_handles_.push_back(std::move(handle));
         return true;
     }
 
   private:
     // 默认配置文件文件夹路径
     std::string config_path_ = __CONFIG_DIR__;
+    std::atomic<std::shared_ptr<const ConfigSnapshot>> snapshot_{
+        std::make_shared<const ConfigSnapshot>()};
+    // 最后声明，先于快照析构，保证回调不会访问已析构的成员
+    std::vector<FileWatcher::Handle> hot_update_handles_;
 };
 
 /**
@@ -1,6 +1,9 @@
 #pragma once
 // std
 #include <cstdio>
+#include <list>
+#include <memory>
+#include <span>
 #include <string>
 
 // opencv
@@ -8,6 +11,16 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/objdetect/face.hpp>
 
+// custom
+#include "align_crop.hpp"
+#include "face_quality.hpp"
+#include "face_tracker.hpp"
+#include "gallery_file.hpp"
+#include "gallery_index.hpp"
+#include "gallery_store.hpp"
+
+class TiledDetector;
+
 /**
  * @brief 识别器后端处理方式表
  *
@@ -21,21 +34,27 @@ const std::vector<std::pair<int, int>> backend_target_pairs = {
 
 /**
  * @brief YuNet模型人脸检测器
+ * 每个输入尺寸对应一个已配置好的检测器，按最近使用顺序缓存，
+ * 输入尺寸不变时不再重新配置网络。模型文件只读取一次，缓存已满时
+ * 改用最久未使用的检测器，不再重新解析模型
  *
  */
 class YuNet {
   public:
+    // 按输入尺寸缓存的检测器个数
+    static constexpr size_t kinput_cache_capacity = 4;
+
     YuNet(const std::string &model_path, const cv::Size &input_size,
           const float conf_threshold, const float nms_threshold,
-          const int top_k, const int backend_id, const int target_id) {
-
-        detector_ = cv::FaceDetectorYN::create(model_path, "", input_size,
-                                               conf_threshold, nms_threshold,
-                                               top_k, backend_id, target_id);
+          const int top_k, const int backend_id, const int target_id)
+        : model_path_(model_path), model_buffer_(ReadModel(model_path)),
+          conf_threshold_(conf_threshold), nms_threshold_(nms_threshold),
+          top_k_(top_k), backend_id_(backend_id), target_id_(target_id) {
+        setInputSize(input_size);
     }
 
     /**
-     * @brief 设置输入图像大小
+     * @brief 设置输入图像大小，尺寸未变时不做任何事
      *
      * @param input_size
      */
@@ -52,12 +71,43 @@ class YuNet {
      * @brief 识别
      *
      * @param image 输入图像
-     * @return cv::Mat 返回检测到的所有人脸位置
+     * @param faces 输出检测到的所有人脸位置，复用内存
+     */
+    void infer(const cv::Mat &image, cv::Mat &faces);
+
+    /**
+     * @brief 将图像等比缩放并居中填充到固定尺寸后识别，结果映射回原图坐标
+     * 用于尺寸各异的图像（如录入图片），避免为每种尺寸配置网络
+     *
+     * @param image 输入图像
+     * @param canonical_size 固定尺寸
+     * @return cv::Mat 返回检测到的所有人脸位置（原图坐标）
      */
-    cv::Mat infer(const cv::Mat &image);
+    cv::Mat inferLetterbox(const cv::Mat &image,
+                           const cv::Size &canonical_size);
 
   private:
-    cv::Ptr<cv::FaceDetectorYN> detector_;
+    struct CachedDetector {
+        cv::Size input_size;
+        int top_k;
+        cv::Ptr<cv::FaceDetectorYN> detector;
+    };
+
+    static std::shared_ptr<const std::vector<uchar>>
+    ReadModel(const std::string &model_path);
+
+    std::string model_path_;
+    // 模型文件内容，复制的检测器之间共享；读取失败时为空，改从路径加载
+    std::shared_ptr<const std::vector<uchar>> model_buffer_;
+    float conf_threshold_;
+    float nms_threshold_;
+    int top_k_;
+    int backend_id_;
+    int target_id_;
+    // 表头为当前使用的检测器
+    std::list<CachedDetector> detectors_;
+    // 复用的填充图像
+    cv::Mat letterbox_;
 };
 
 /**
@@ -66,12 +116,19 @@ class YuNet {
  */
 class SFace {
   public:
+    // 特征维度
+    static constexpr int kfeature_dim = 128;
+    // 对齐后的人脸图像边长
+    static constexpr int kcrop_size = kalign_size;
+
     SFace(const std::string &model_path, const int backend_id,
           const int target_id, const int distance_type)
         : distance_type_(
               static_cast<cv::FaceRecognizerSF::DisType>(distance_type)) {
-        recognizer_ =
-            cv::FaceRecognizerSF::create(model_path, "", backend_id, target_id);
+        // 模型只加载一次，对齐裁剪和特征比较不依赖FaceRecognizerSF
+        net_ = cv::dnn::readNet(model_path);
+        net_.setPreferableBackend(backend_id);
+        net_.setPreferableTarget(target_id);
     }
 
     /**
@@ -79,10 +136,32 @@ class SFace {
      *
      * @param orig_image 原始图像
      * @param face_image 人脸图像
-     * @return cv::Mat 特征数据
+     * @param features 输出特征数据，尺寸不变时复用内存
      */
-    cv::Mat extractFeatures(const cv::Mat &orig_image,
-                            const cv::Mat &face_image);
+    void extractFeatures(const cv::Mat &orig_image, const cv::Mat &face_image,
+                         cv::Mat &features);
+
+    /**
+     * @brief 批量计算一张图像上所有人脸的特征数据
+     *
+     * @param orig_image 原始图像
+     * @param faces YuNet检测结果，每行一张人脸
+     * @param features 输出特征，faces.rows×kfeature_dim，尺寸不变时复用内存
+     */
+    void extractFeaturesBatch(const cv::Mat &orig_image, const cv::Mat &faces,
+                              cv::Mat &features);
+
+    /**
+     * @brief 批量计算多张图像（多帧或多路视频）上所有人脸的特征数据
+     * 所有人脸对齐裁剪后组成一个NCHW输入，只做一次前向
+     *
+     * @param orig_images 原始图像
+     * @param faces_vec 每张图像的YuNet检测结果
+     * @param features 输出特征，按图像顺序依次排列，尺寸不变时复用内存
+     */
+    void extractFeaturesBatch(const std::vector<cv::Mat> &orig_images,
+                              const std::vector<cv::Mat> &faces_vec,
+                              cv::Mat &features);
 
     /**
      * @brief 匹配目标特征量
@@ -94,6 +173,23 @@ class SFace {
     std::pair<double, bool> matchFeatures(const cv::Mat &target_features,
                                           const cv::Mat &query_features);
 
+    /**
+     * @brief 根据距离类型和阈值判断分数是否匹配成功
+     *
+     * @param score 相似度
+     * @return true 匹配成功
+     */
+    bool isMatched(double score) const;
+
+    /**
+     * @brief 获得距离类型
+     *
+     * @return cv::FaceRecognizerSF::DisType
+     */
+    cv::FaceRecognizerSF::DisType distanceType() const {
+        return distance_type_;
+    }
+
     /**
      * @brief 设置阈值
      *
@@ -108,20 +204,59 @@ class SFace {
      */
     void setThresholdNorml2(float norml2_threshold);
 
+    /**
+     * @brief 设置最佳与次佳身份分数的最小差距
+     *
+     * @param match_margin 与距离类型同单位，0表示不检查
+     */
+    void setMatchMargin(float match_margin);
+
+    /**
+     * @brief 最佳身份是否明显优于次佳身份，差距不足时不能确定是谁
+     *
+     * @param best_score 最佳身份的分数
+     * @param second_score 次佳身份的分数
+     * @return true 差距足够
+     */
+    bool isDistinct(double best_score, double second_score) const;
+
+    /**
+     * @brief 设置特征库搜索参数
+     *
+     * @param search_params
+     */
+    void setSearchParams(const GallerySearchParams &search_params) {
+        search_params_ = search_params;
+    }
+
+    const GallerySearchParams &searchParams() const { return search_params_; }
+
   private:
-    cv::Ptr<cv::FaceRecognizerSF> recognizer_;
+    cv::dnn::Net net_;
+    // 复用的NCHW输入，对齐裁剪直接写入
+    cv::Mat blob_;
+    // 复用的网络输出
+    cv::Mat output_;
+    // 模型不支持批量输入时退回逐张前向
+    bool batch_forward_ = true;
     cv::FaceRecognizerSF::DisType distance_type_;
     float threshold_cosine_ = 0.363f;
     float threshold_norml2_ = 1.128f;
+    float match_margin_ = 0.f;
+    GallerySearchParams search_params_;
 };
 
 /**
  * @brief 人脸检测结果类型，包括人脸和特征值
+ * faces每行一张人脸，features的第i行为第i张人脸的特征
  *
  */
 struct DetectResult {
     cv::Mat faces;
-    std::vector<cv::Mat> features;
+    cv::Mat features;
+    // 与faces逐行对应的质量评估，未开启质量门控时为空；
+    // 不提取特征的人脸对应的特征行为0
+    std::vector<FaceQuality> qualities;
 };
 
 /**
@@ -134,7 +269,7 @@ struct TargetData {
 };
 
 /**
- * @brief 匹配的结果，包括名字、人脸框、置信度、是否匹配
+ * @brief 匹配的结果，包括名字、人脸框、置信度、是否匹配、轨迹ID
  *
  */
 struct MatchData {
@@ -142,11 +277,40 @@ struct MatchData {
     cv::Mat face;
     float conf = 0.f;
     bool match = false;
+    // 未使用跟踪时为-1
+    int track_id = -1;
+    // 提取特征前的质量评估，没有识别时说明原因
+    FaceQuality quality;
 };
 
 using TargetDataVec = std::vector<TargetData>;
 using MatchDataVec = std::vector<MatchData>;
 
+/**
+ * @brief 一路视频逐帧复用的缓冲，人脸数和图像尺寸不变时不再分配内存
+ * 各接口通过引用写入，同一时刻只应由一个线程使用
+ *
+ */
+struct FrameContext {
+    // 检测结果
+    DetectResult detect_result;
+    // 跟踪关联结果和预测人脸对应的轨迹
+    std::vector<TrackAssignment> assignments;
+    std::vector<int> track_ids;
+    // 需要重新识别的人脸的质量评估，与人脸逐行对应
+    std::vector<FaceQuality> qualities;
+    // 需要识别（重新识别或质量合格）的人脸及其匹配结果
+    DetectResult pending;
+    MatchDataVec pending_match_data_vec;
+    // 特征库查询
+    cv::Mat packed_queries;
+    std::vector<GallerySearchResult> search_results;
+    // 匹配结果，与人脸逐行对应
+    MatchDataVec match_data_vec;
+    // 可视化输出
+    cv::Mat output_image;
+};
+
 /**
  * @brief 完整的识别器
  *
@@ -156,6 +320,60 @@ class Detector {
     explicit Detector(YuNet yunet, SFace sface) {
         yunet_ptr_ = cv::makePtr<YuNet>(yunet);
         sface_ptr_ = cv::makePtr<SFace>(sface);
+        store_ptr_ =
+            cv::makePtr<GalleryStore>(cv::makePtr<BruteForceIndex>());
+    }
+
+    /**
+     * @brief 设置特征库索引，原有目标会被丢弃
+     *
+     * @param index_ptr 特征库索引
+     */
+    void setGalleryIndex(cv::Ptr<GalleryIndex> index_ptr);
+
+    /**
+     * @brief 使用共享的特征库，多个识别器看到同样的目标
+     *
+     * @param store_ptr 特征库
+     */
+    void setGalleryStore(cv::Ptr<GalleryStore> store_ptr) {
+        store_ptr_ = store_ptr;
+    }
+
+    /**
+     * @brief 特征库，增删目标后新版本立即对所有共享它的识别器生效
+     *
+     * @return cv::Ptr<GalleryStore>
+     */
+    cv::Ptr<GalleryStore> galleryStore() const { return store_ptr_; }
+
+    /**
+     * @brief 特征库版本号，每次增删目标后改变
+     *
+     * @return uint64_t
+     */
+    uint64_t galleryVersion() const { return store_ptr_->version(); }
+
+    /**
+     * @brief 设置质量门控参数，开启后质量不合格的人脸不提取特征
+     *
+     * @param params 参数
+     */
+    void setQualityParams(const QualityParams &params) {
+        quality_estimator_.setParams(params);
+    }
+
+    const QualityParams &qualityParams() const {
+        return quality_estimator_.params();
+    }
+
+    /**
+     * @brief 设置分块检测器，检测输入大于一个图块时分块并行检测
+     *
+     * @param tiled_ptr 分块检测器，为空时整图检测
+     */
+    void setTiledDetector(cv::Ptr<TiledDetector> tiled_ptr) {
+        tiled_ptr_ = tiled_ptr;
     }
 
     /**
@@ -178,14 +396,86 @@ class Detector {
      */
     void clearTargetDatas();
 
+    /**
+     * @brief 删除指定名字的目标
+     *
+     * @param name 名字
+     * @return size_t 删除的个数
+     */
+    size_t removeTargetData(const std::string &name);
+
+    /**
+     * @brief 从特征库文件映射目标数据，替换现有目标
+     *
+     * @param file_path 特征库文件路径
+     * @param model_hash 模型哈希
+     * @return true 加载成功
+     * @return false 加载失败
+     */
+    bool loadGallery(const std::string &file_path, uint64_t model_hash);
+
+    /**
+     * @brief 将现有目标保存为特征库文件
+     *
+     * @param file_path 特征库文件路径
+     * @param model_hash 模型哈希
+     * @return true 保存成功
+     * @return false 保存失败
+     */
+    bool saveGallery(const std::string &file_path, uint64_t model_hash) const;
+
+    /**
+     * @brief 目标个数
+     *
+     * @return size_t
+     */
+    size_t targetCount() const { return store_ptr_->acquire()->size(); }
+
     /**
      * @brief 人脸识别，获得一张图片上所有的人脸和对应特征值
      *
      * @param input 输入图像
      * @param top_k 最多几张人脸
-     * @return DetectResult 结果
+     * @param scale 检测前的缩放，特征仍在原图上计算
+     * @param detect_result 输出结果，复用内存
+     */
+    void detectFace(const cv::Mat &input, int top_k, float scale,
+                    DetectResult &detect_result);
+
+    /**
+     * @brief 只检测人脸框，不计算特征值
+     *
+     * @param input 输入图像
+     * @param top_k 最多几张人脸
+     * @param scale 检测前的缩放，小于1时在缩小的图像上检测
+     * @param faces 输出YuNet检测结果（原图坐标），每行一张人脸，复用内存
+     */
+    void detectFaceBoxes(const cv::Mat &input, int top_k, float scale,
+                         cv::Mat &faces);
+
+    /**
+     * @brief 人脸识别，检测前将图像填充到固定尺寸，特征仍在原图上计算
+     *
+     * @param input 输入图像
+     * @param canonical_size 检测使用的固定尺寸
+     * @param top_k 最多几张人脸
+     * @return DetectResult 结果（原图坐标）
+     */
+    DetectResult detectFaceLetterbox(const cv::Mat &input,
+                                     const cv::Size &canonical_size,
+                                     int top_k = 1);
+
+    /**
+     * @brief 多张图像的人脸识别，与逐张调用detectFace的结果相同（同样的缩放
+     * 和分块检测），所有质量合格人脸的特征一次批量计算
+     *
+     * @param inputs 输入图像
+     * @param top_k 每张图像最多几张人脸
+     * @param scale 检测前的缩放，特征仍在原图上计算
+     * @param detect_results 输出每张图像的结果，各自持有特征，复用内存
      */
-    DetectResult detectFace(const cv::Mat input, int top_k = 1);
+    void detectFaces(const std::vector<cv::Mat> &inputs, int top_k,
+                     float scale, std::vector<DetectResult> &detect_results);
 
     /**
      * @brief 使用识别到的数据进行人脸匹配
@@ -193,22 +483,126 @@ class Detector {
      * @param detect_result 识别到的人脸
      * @return MatchDataVec 匹配的结果
      */
-    MatchDataVec matchTargetFace(DetectResult detect_result);
+    MatchDataVec matchTargetFace(const DetectResult &detect_result);
+
+    /**
+     * @brief 使用识别到的数据进行人脸匹配，结果写入context.match_data_vec，
+     * 质量不合格的人脸不搜索特征库，直接记为未匹配
+     *
+     * @param detect_result 识别到的人脸
+     * @param context 帧缓冲
+     */
+    void matchTargetFace(const DetectResult &detect_result,
+                         FrameContext &context);
+
+    /**
+     * @brief 跟踪并匹配人脸，只对跟踪器要求重新识别的人脸计算特征并匹配，
+     * 其余人脸复用轨迹缓存的身份
+     *
+     * @param input 输入图像
+     * @param faces detectFaceBoxes的结果
+     * @param tracker 跟踪器
+     * @param context 帧缓冲，匹配结果写入match_data_vec，与faces逐行对应
+     */
+    void matchTrackedFace(const cv::Mat &input, const cv::Mat &faces,
+                          FaceTracker &tracker, FrameContext &context);
+
+    /**
+     * @brief 跳过检测的帧使用跟踪器预测人脸位置，直接复用轨迹缓存的身份
+     *
+     * @param tracker 跟踪器
+     * @param context 帧缓冲，预测的人脸写入detect_result.faces，
+     * 匹配结果写入match_data_vec
+     */
+    void matchPredictedFace(FaceTracker &tracker, FrameContext &context);
+
+    /**
+     * @brief 多张图像（多路视频）的跟踪与匹配，每张图像使用各自的跟踪器，
+     * 所有需要重新识别的人脸一次批量计算特征并匹配
+     *
+     * @param inputs 输入图像
+     * @param faces_vec 每张图像的detectFaceBoxes结果
+     * @param trackers 每张图像对应的跟踪器
+     * @return std::vector<MatchDataVec> 每张图像的匹配结果
+     */
+    std::vector<MatchDataVec>
+    matchTrackedFaces(const std::vector<cv::Mat> &inputs,
+                      const std::vector<cv::Mat> &faces_vec,
+                      const std::vector<FaceTracker *> &trackers);
 
   private:
-    TargetDataVec target_data_vec_;
+    /**
+     * @brief 所有特征与同一个版本的特征库比较
+     *
+     * @param faces 人脸
+     * @param features 与faces逐行对应的特征
+     * @param context 帧缓冲，使用其中的查询缓冲
+     * @param match_data_vec 输出匹配结果
+     */
+    void matchFeatures(const cv::Mat &faces, const cv::Mat &features,
+                       FrameContext &context, MatchDataVec &match_data_vec);
+
+    /**
+     * @brief 只为质量合格的人脸批量提取特征，其余人脸的特征为0
+     *
+     * @param inputs 输入图像
+     * @param faces_vec 每张图像的检测结果
+     * @param qualities 输出所有人脸的质量评估，按图像顺序排列
+     * @param features 输出特征，按图像顺序排列
+     */
+    void extractQualified(const std::vector<cv::Mat> &inputs,
+                          const std::vector<cv::Mat> &faces_vec,
+                          std::vector<FaceQuality> &qualities,
+                          cv::Mat &features);
+
+    /**
+     * @brief 评估跟踪器要求识别的人脸，不合格的本帧不识别，
+     * 推迟的在下一次检测时重试
+     *
+     * @param input 输入图像
+     * @param faces 检测结果
+     * @param tracker 跟踪器
+     * @param assignments 关联结果，不识别的人脸need_recognize置为false
+     * @param qualities 输出与faces逐行对应的质量评估
+     */
+    void gateRecognition(const cv::Mat &input, const cv::Mat &faces,
+                         FaceTracker &tracker,
+                         std::vector<TrackAssignment> &assignments,
+                         std::vector<FaceQuality> &qualities);
+
+    cv::Ptr<GalleryStore> store_ptr_ = nullptr;
     cv::Ptr<YuNet> yunet_ptr_ = nullptr;
     cv::Ptr<SFace> sface_ptr_ = nullptr;
+    cv::Ptr<TiledDetector> tiled_ptr_ = nullptr;
+    FaceQualityEstimator quality_estimator_;
+    // 缩放后的检测输入，复用内存
+    cv::Mat scaled_input_;
+    // 质量合格的人脸及其特征，复用内存
+    std::vector<cv::Mat> qualified_faces_vec_;
+    cv::Mat qualified_features_;
+    // 多张图像批量识别时的人脸、质量评估和特征，复用内存
+    std::vector<cv::Mat> batch_faces_vec_;
+    std::vector<FaceQuality> batch_qualities_;
+    cv::Mat batch_features_;
 };
 
+/**
+ * @brief 平移人脸框和关键点，用于把在子区域上检测到的人脸映射回原图
+ *
+ * @param faces YuNet格式的人脸，每行一张，原地修改
+ * @param offset 子区域左上角在原图中的位置
+ */
+void OffsetFaces(cv::Mat &faces, const cv::Point &offset);
+
 /**
  * @brief 可视化匹配结果
  *
  * @param image 输入图像
- * @param match_data_vec 匹配到的结果
+ * @param match_data 匹配到的结果
+ * @param output_image 输出图像，尺寸不变时复用内存
  * @param fps_text 显示帧率
- * @return cv::Mat
+ * @param draw_face_points 是否画出关键点
  */
-cv::Mat visualize(const cv::Mat &image, MatchDataVec match_data_vec,
-                  const std::string &fps_text = "",
-                  bool draw_face_points = true);
+void visualize(const cv::Mat &image, std::span<const MatchData> match_data,
+               cv::Mat &output_image, const std::string &fps_text = "",
+               bool draw_face_points = true);
@@ -0,0 +1,124 @@
+#pragma once
+// std
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// custom
+#include "detector.hpp"
+
+/**
+ * @brief 录入缓存中的一条记录，以图片路径为键
+ *
+ */
+struct EnrollmentCacheEntry {
+    uint64_t file_size = 0;
+    int64_t mtime = 0;
+    uint64_t content_hash = 0;
+    // 图片中没有检测到人脸时为空，同样缓存，避免每次重复推理
+    std::vector<float> feature;
+};
+
+/**
+ * @brief 录入统计：命中、未命中（重新推理）、淘汰（图片已删除）
+ *
+ */
+struct EnrollmentStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t no_face = 0;
+};
+
+/**
+ * @brief 录入缓存，与目标文件夹放在一起的旁路文件
+ * 图片路径、大小、修改时间一致时直接命中；大小或修改时间变化时再比较内容哈希
+ * 模型文件哈希变化时整个缓存失效
+ *
+ */
+class EnrollmentCache {
+  public:
+    EnrollmentCache(uint64_t yunet_hash, uint64_t sface_hash)
+        : yunet_hash_(yunet_hash), sface_hash_(sface_hash) {}
+
+    /**
+     * @brief 读取缓存文件，模型哈希不一致或文件损坏时缓存为空
+     *
+     * @param file_path 缓存文件路径
+     * @return true 读取成功
+     * @return false 读取失败
+     */
+    bool load(const std::string &file_path);
+
+    /**
+     * @brief 写入缓存文件
+     *
+     * @param file_path 缓存文件路径
+     * @return true 写入成功
+     * @return false 写入失败
+     */
+    bool save(const std::string &file_path) const;
+
+    std::unordered_map<std::string, EnrollmentCacheEntry> &entries() {
+        return entries_;
+    }
+
+  private:
+    uint64_t yunet_hash_;
+    uint64_t sface_hash_;
+    std::unordered_map<std::string, EnrollmentCacheEntry> entries_;
+};
+
+/**
+ * @brief 一次增量录入中变化的身份
+ *
+ */
+struct EnrollmentDelta {
+    // 有图片新增、修改或删除的名字，应先从特征库中删除
+    std::vector<std::string> names;
+    // 这些名字当前的所有目标，删除后重新添加
+    TargetDataVec targets;
+};
+
+using DetectorFactory = std::function<cv::Ptr<Detector>()>;
+
+// 录入时检测使用的固定输入尺寸
+const cv::Size kenroll_input_size(640, 640);
+
+/**
+ * @brief 增量录入目标图片：只对新增或修改过的图片推理，删除的图片从缓存中淘汰
+ * 需要推理的图片在多个线程上并行处理，每个线程使用独立的识别器，
+ * 不修改OpenCV的全局线程数
+ *
+ * @param image_paths 所有目标图片路径
+ * @param cache 录入缓存，函数返回后与image_paths一致
+ * @param detector_ptr 识别器，作为第一个工作线程使用
+ * @param detector_factory 为其余工作线程创建识别器
+ * @param stats 输出统计
+ * @param thread_count 线程数，0表示使用所有核心
+ * @return TargetDataVec 所有检测到人脸的目标，按image_paths顺序
+ */
+TargetDataVec EnrollTargets(const std::vector<std::string> &image_paths,
+                            EnrollmentCache &cache,
+                            cv::Ptr<Detector> detector_ptr,
+                            const DetectorFactory &detector_factory,
+                            EnrollmentStats &stats, size_t thread_count = 0);
+
+/**
+ * @brief 与EnrollTargets相同地增量录入，只输出有变化的身份，
+ * 用于运行期间按差异更新特征库
+ *
+ * @param image_paths 所有目标图片路径
+ * @param cache 录入缓存，函数返回后与image_paths一致
+ * @param detector_ptr 识别器，作为第一个工作线程使用
+ * @param detector_factory 为其余工作线程创建识别器
+ * @param stats 输出统计，no_face只统计变化的身份
+ * @param thread_count 线程数，0表示使用所有核心
+ * @return EnrollmentDelta 变化的身份及其当前的目标
+ */
+EnrollmentDelta EnrollChangedTargets(
+    const std::vector<std::string> &image_paths, EnrollmentCache &cache,
+    cv::Ptr<Detector> detector_ptr, const DetectorFactory &detector_factory,
+    EnrollmentStats &stats, size_t thread_count = 0);
@@ -0,0 +1,119 @@
+#pragma once
+// opencv
+#include <opencv2/core.hpp>
+
+/**
+ * @brief 质量评估的处理方式表
+ *
+ */
+enum QualityVerdict {
+    // 提取特征并匹配
+    kquality_extract = 0,
+    // 暂不提取，跟踪时下一次检测重试
+    kquality_defer = 1,
+    // 不提取，跟踪时按原计划复核
+    kquality_skip = 2,
+};
+
+/**
+ * @brief 质量不合格的原因表
+ *
+ */
+enum QualityReason {
+    kquality_ok = 0,
+    kquality_low_score = 1,
+    kquality_small = 2,
+    kquality_pose = 3,
+    kquality_blur = 4,
+};
+
+/**
+ * @brief 一张人脸的质量评估结果
+ *
+ */
+struct FaceQuality {
+    QualityVerdict verdict = kquality_extract;
+    QualityReason reason = kquality_ok;
+};
+
+/**
+ * @brief 质量门控参数
+ *
+ */
+struct QualityParams {
+    bool enabled = false;
+    // 人脸框短边低于该值（像素）时跳过
+    float min_size = 24.f;
+    // 检测置信度低于该值时推迟
+    float min_score = 0.85f;
+    // 由关键点估计的偏航、俯仰，范围约为-1~1，绝对值超过max时推迟，
+    // 偏航超过skip_yaw（接近侧脸）时跳过
+    float max_yaw = 0.5f;
+    float skip_yaw = 0.8f;
+    float max_pitch = 0.6f;
+    // 人脸中心区域的拉普拉斯方差低于该值时推迟，0表示不计算
+    float min_sharpness = 20.f;
+};
+
+/**
+ * @brief 质量不合格原因的名字，用于结果输出
+ *
+ * @param reason 原因
+ * @return const char*
+ */
+const char *QualityReasonName(QualityReason reason);
+
+/**
+ * @brief 提取特征前的人脸质量评估
+ * 置信度、人脸框大小和由5个关键点估计的姿态直接取自YuNet结果，
+ * 只有这些都合格时才在缩小到固定尺寸的人脸区域上计算清晰度
+ * 非线程安全，每个识别器一个
+ *
+ */
+class FaceQualityEstimator {
+  public:
+    // 计算清晰度时人脸区域缩放到的边长
+    static constexpr int ksharpness_size = 48;
+
+    explicit FaceQualityEstimator(const QualityParams &params = {})
+        : params_(params) {}
+
+    void setParams(const QualityParams &params) { params_ = params; }
+    const QualityParams &params() const { return params_; }
+    bool enabled() const { return params_.enabled; }
+
+    /**
+     * @brief 评估一张人脸
+     *
+     * @param image 原图
+     * @param face YuNet格式的一行人脸（原图坐标）
+     * @return FaceQuality
+     */
+    FaceQuality assess(const cv::Mat &image, const float *face);
+
+    /**
+     * @brief 由5个关键点估计偏航和俯仰
+     * 正脸时鼻尖在双眼和嘴角中点的连线上、约位于眼与嘴的中间
+     *
+     * @param face YuNet格式的一行人脸
+     * @param yaw 输出偏航，鼻尖相对中线的水平偏移与半眼距之比
+     * @param pitch 输出俯仰，鼻尖在眼与嘴之间的相对位置映射到-1~1
+     */
+    static void EstimatePose(const float *face, float &yaw, float &pitch);
+
+    /**
+     * @brief 人脸中心区域的清晰度
+     *
+     * @param image 原图
+     * @param face YuNet格式的一行人脸
+     * @return float 拉普拉斯方差，人脸框不在图像内时为0
+     */
+    float sharpness(const cv::Mat &image, const float *face);
+
+  private:
+    QualityParams params_;
+    // 复用的缩放图像、灰度图和拉普拉斯结果
+    cv::Mat patch_;
+    cv::Mat gray_;
+    cv::Mat laplacian_;
+};
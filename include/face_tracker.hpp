@@ -0,0 +1,188 @@
+#pragma once
+// std
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// opencv
+#include <opencv2/core.hpp>
+
+/**
+ * @brief 跟踪参数
+ *
+ */
+struct TrackParams {
+    // 预测框与检测框的IoU不低于该值才能关联
+    float iou_threshold = 0.3f;
+    // 关联IoU低于该值说明跟踪不可靠，需要重新识别
+    float reverify_iou = 0.5f;
+    // 每隔多少帧重新识别一次
+    int reverify_interval = 30;
+    // 人脸框尺寸相对上次识别时变化超过该比例时重新识别
+    float max_box_change = 0.3f;
+    // 连续多少帧未检测到就删除轨迹
+    int max_missed = 10;
+};
+
+/**
+ * @brief 轨迹缓存的身份
+ *
+ */
+struct TrackIdentity {
+    std::string name = "?";
+    float conf = 0.f;
+    bool match = false;
+};
+
+/**
+ * @brief 一张人脸的跟踪结果
+ *
+ */
+struct TrackAssignment {
+    int track_id = -1;
+    // 需要重新提取特征并匹配
+    bool need_recognize = true;
+};
+
+/**
+ * @brief 跟踪统计
+ *
+ */
+struct TrackerStats {
+    // 总人脸数
+    size_t faces = 0;
+    // 实际做了特征提取与匹配的人脸数
+    size_t recognized = 0;
+    // 创建过的轨迹数
+    size_t tracks = 0;
+};
+
+/**
+ * @brief 基于IoU关联和匀速卡尔曼预测的人脸跟踪器
+ * 每个轨迹有稳定的ID并缓存身份，只在新建、定期复核、关联变弱或人脸框
+ * 明显变化时要求重新识别，其余帧直接复用身份，省掉SFace和特征库匹配
+ * 非线程安全，应只在一个线程中使用
+ *
+ */
+class FaceTracker {
+  public:
+    explicit FaceTracker(const TrackParams &params = {}) : params_(params) {}
+
+    /**
+     * @brief 用一帧的检测结果更新所有轨迹
+     *
+     * @param faces YuNet检测结果，每行一张人脸
+     * @param assignments 输出与faces逐行对应的关联结果，复用内存
+     */
+    void update(const cv::Mat &faces,
+                std::vector<TrackAssignment> &assignments);
+
+    /**
+     * @brief 写入轨迹的识别结果
+     *
+     * @param track_id 轨迹ID
+     * @param name 名字，复制到轨迹已有的字符串中
+     * @param conf 置信度
+     * @param match 是否匹配成功
+     */
+    void setIdentity(int track_id, std::string_view name, float conf,
+                     bool match);
+
+    /**
+     * @brief 本次更新要求识别的人脸因质量不合格没有识别
+     *
+     * @param track_id 轨迹ID
+     * @param retry 是否在下一次更新时重新要求识别，否则按原计划复核
+     */
+    void cancelRecognition(int track_id, bool retry);
+
+    /**
+     * @brief 轨迹缓存的身份
+     *
+     * @param track_id 轨迹ID
+     * @return const TrackIdentity& 轨迹不存在时为未知身份
+     */
+    const TrackIdentity &identity(int track_id) const;
+
+    /**
+     * @brief 跳过检测的帧调用，所有轨迹前进一帧，输出当前可见轨迹的预测人脸
+     * 关键点随人脸框平移缩放
+     *
+     * @param faces 输出预测的人脸，格式同YuNet检测结果，复用内存
+     * @param track_ids 输出与faces逐行对应的轨迹ID
+     */
+    void predictFaces(cv::Mat &faces, std::vector<int> &track_ids);
+
+    /**
+     * @brief 删除所有轨迹
+     *
+     */
+    void reset();
+
+    /**
+     * @brief 特征库版本变化时，所有轨迹在下一次更新时重新识别
+     *
+     * @param version 特征库版本号
+     */
+    void setGalleryVersion(uint64_t version);
+
+    void setParams(const TrackParams &params) { params_ = params; }
+    const TrackerStats &stats() const { return stats_; }
+
+  private:
+    /**
+     * @brief 一维匀速卡尔曼滤波，状态为位置和速度
+     *
+     */
+    struct Kalman1D {
+        float pos = 0.f;
+        float vel = 0.f;
+        // 协方差矩阵[[p00, p01], [p01, p11]]
+        float p00 = 1.f, p01 = 0.f, p11 = 1.f;
+
+        void init(float value, float std);
+        void predict(float std_pos, float std_vel);
+        void correct(float value, float std);
+    };
+
+    struct Track {
+        int id = -1;
+        // 中心x、中心y、宽、高
+        std::array<Kalman1D, 4> state;
+        // 上次关联的检测结果，用于预测时推算关键点
+        std::array<float, 15> face{};
+        // 上次识别时的人脸框
+        cv::Rect2f verified_box;
+        int frames_since_verify = 0;
+        int missed = 0;
+        TrackIdentity identity;
+    };
+
+    // 关联候选
+    struct Candidate {
+        float iou;
+        size_t track;
+        int face;
+    };
+
+    static cv::Rect2f FaceBox(const cv::Mat &faces, int row);
+    static cv::Rect2f TrackBox(const Track &track);
+    static float Iou(const cv::Rect2f &a, const cv::Rect2f &b);
+
+    void predict(Track &track) const;
+    void correct(Track &track, const cv::Rect2f &box) const;
+    bool boxChanged(const Track &track, const cv::Rect2f &box) const;
+
+    TrackParams params_;
+    std::vector<Track> tracks_;
+    // 每帧复用的关联缓冲
+    std::vector<Candidate> candidates_;
+    std::vector<char> track_used_;
+    std::vector<char> face_used_;
+    int next_id_ = 0;
+    uint64_t gallery_version_ = 0;
+    TrackerStats stats_;
+};
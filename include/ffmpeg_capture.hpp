@@ -0,0 +1,113 @@
+#pragma once
+// std
+#include <string>
+
+// opencv
+#include <opencv2/core.hpp>
+
+struct AVBufferRef;
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+/**
+ * @brief 采集方式表
+ *
+ */
+enum CaptureBackend {
+    kcapture_opencv = 0,
+    kcapture_ffmpeg = 1,
+};
+
+/**
+ * @brief FFmpeg解码参数
+ *
+ */
+struct FFmpegCaptureOptions {
+    // 解码线程数，0表示由FFmpeg按核心数决定
+    int decode_threads = 0;
+    // 硬件解码设备类型，如cuda、vaapi、qsv，为空或不可用时软件解码
+    std::string hw_device;
+};
+
+/**
+ * @brief 基于FFmpeg的视频读取
+ * 解码后的YUV帧经一次sws_scale同时完成缩放和BGR转换，直接写入输出图像，
+ * 不产生原始分辨率的BGR帧；只有需要时才转换原始分辨率的图像
+ *
+ */
+class FFmpegCapture {
+  public:
+    FFmpegCapture() = default;
+    ~FFmpegCapture() { release(); }
+    FFmpegCapture(const FFmpegCapture &) = delete;
+    FFmpegCapture &operator=(const FFmpegCapture &) = delete;
+
+    /**
+     * @brief 打开视频文件或网络流
+     *
+     * @param source 路径或URL
+     * @param options 解码参数
+     * @return true 成功
+     * @return false 无法打开或没有视频流
+     */
+    bool open(const std::string &source,
+              const FFmpegCaptureOptions &options = FFmpegCaptureOptions());
+
+    /**
+     * @brief 释放所有资源
+     *
+     */
+    void release();
+
+    bool isOpened() const { return codec_context_ != nullptr; }
+
+    /**
+     * @brief 读取下一帧，缩放和颜色转换一次完成
+     *
+     * @param image 输出BGR图像，尺寸不变时复用内存
+     * @param scale 相对原始分辨率的缩放
+     * @return true 成功
+     * @return false 视频结束或解码失败
+     */
+    bool read(cv::Mat &image, float scale = 1.f);
+
+    /**
+     * @brief 将最近一次读取的帧以原始分辨率转换为BGR，供需要全分辨率
+     * 对齐裁剪时使用
+     *
+     * @param full_image 输出BGR图像，尺寸不变时复用内存
+     * @return true 成功
+     * @return false 还没有读取过帧
+     */
+    bool retrieveFull(cv::Mat &full_image);
+
+    /**
+     * @brief 原始分辨率
+     *
+     * @return cv::Size 未打开时为空
+     */
+    cv::Size frameSize() const;
+
+  private:
+    bool decodeFrame();
+    bool convert(SwsContext *&sws_context, const cv::Size &size,
+                 cv::Mat &image);
+
+    AVFormatContext *format_context_ = nullptr;
+    AVCodecContext *codec_context_ = nullptr;
+    AVBufferRef *hw_device_context_ = nullptr;
+    AVPacket *packet_ = nullptr;
+    AVFrame *frame_ = nullptr;
+    // 硬件解码时从显存下载的帧
+    AVFrame *sw_frame_ = nullptr;
+    // 当前帧，指向frame_或sw_frame_
+    AVFrame *current_ = nullptr;
+    // 缩放和原始分辨率转换各用一个，尺寸不变时复用
+    SwsContext *sws_context_ = nullptr;
+    SwsContext *full_sws_context_ = nullptr;
+    int stream_index_ = -1;
+    bool draining_ = false;
+};
@@ -0,0 +1,167 @@
+#pragma once
+// std
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 文件修改监听器，所有监听共享一个线程
+ * Linux上监听文件所在文件夹的inotify事件（编辑器常以重命名方式保存），
+ * 不可用时退化为定期比较修改时间；同一文件短时间内的多次事件合并为一次回调
+ * 须通过std::make_shared构造
+ *
+ */
+class FileWatcher : public std::enable_shared_from_this<FileWatcher> {
+  public:
+    using Callback = std::function<void()>;
+
+    /**
+     * @brief 监听句柄，析构时注销监听，返回后不会再有该监听的回调在执行
+     *
+     */
+    class Handle {
+      public:
+        Handle() = default;
+        Handle(Handle &&other) noexcept { *this = std::move(other); }
+        Handle &operator=(Handle &&other) noexcept;
+        Handle(const Handle &) = delete;
+        Handle &operator=(const Handle &) = delete;
+        ~Handle() { reset(); }
+
+        /**
+         * @brief 注销监听
+         *
+         */
+        void reset();
+
+        explicit operator bool() const { return watcher_ != nullptr; }
+
+      private:
+        friend class FileWatcher;
+        Handle(std::shared_ptr<FileWatcher> watcher, int id)
+            : watcher_(std::move(watcher)), id_(id) {}
+
+        std::shared_ptr<FileWatcher> watcher_;
+        int id_ = -1;
+    };
+
+    /**
+     * @brief 进程内共享的监听器，所有句柄释放后线程退出
+     *
+     * @return std::shared_ptr<FileWatcher>
+     */
+    static std::shared_ptr<FileWatcher> Shared();
+
+    /**
+     * @brief 构造监听器并启动监听线程
+     *
+     * @param debounce 最后一次事件后等待多久再回调
+     * @param poll_interval 无法使用inotify时比较修改时间的间隔
+     */
+    explicit FileWatcher(
+        std::chrono::milliseconds debounce = std::chrono::milliseconds(20),
+        std::chrono::milliseconds poll_interval =
+            std::chrono::milliseconds(100));
+    ~FileWatcher();
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    /**
+     * @brief 监听文件，文件被修改、替换或创建时在监听线程中执行回调；
+     * 监听文件夹时其中任何文件变化都会触发回调
+     *
+     * @param file_path 文件或文件夹路径
+     * @param callback 回调函数
+     * @return Handle 句柄，文件不存在时为空
+     */
+    Handle watch(const std::string &file_path, Callback callback);
+
+    /**
+     * @brief 是否使用inotify
+     *
+     * @return true 事件驱动
+     * @return false 定期比较修改时间
+     */
+    bool usingInotify() const { return inotify_fd_ >= 0; }
+
+  private:
+    struct Watch {
+        int id = -1;
+        std::filesystem::path dir;
+        // 为空时监听整个文件夹
+        std::string name;
+        Callback callback;
+        // inotify监听描述符，-1表示使用修改时间轮询
+        int wd = -1;
+        std::filesystem::file_time_type last_write;
+        bool pending = false;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    static std::mutex &SharedMutex();
+
+    void unwatch(int id);
+    void wake();
+    void run();
+    int pollTimeoutMs();
+    void readEvents();
+    void pollFiles();
+    void dispatch();
+
+    std::chrono::milliseconds debounce_;
+    std::chrono::milliseconds poll_interval_;
+    // 保护watches_和next_id_
+    std::mutex mutex_;
+    // 回调执行期间持有，注销时等待正在执行的回调结束
+    std::mutex dispatch_mutex_;
+    std::vector<Watch> watches_;
+    int next_id_ = 0;
+    int inotify_fd_ = -1;
+    // 用于唤醒监听线程的管道
+    int wake_fds_[2] = {-1, -1};
+    std::atomic<bool> running_{true};
+    // 回调中释放了最后一个句柄时，由监听线程退出前析构自身
+    std::shared_ptr<FileWatcher> last_owner_;
+    std::thread thread_;
+};
+
+/**
+ * @brief 在专用线程中执行回调的监听
+ * 回调耗时较长（如重新录入）时使用，不阻塞共享监听线程上的其他监听；
+ * 回调执行期间的多次变化合并为一次，析构时等待正在执行的回调结束
+ *
+ */
+class AsyncWatch {
+  public:
+    /**
+     * @brief 监听文件或文件夹，见FileWatcher::watch
+     *
+     * @param file_path 文件或文件夹路径
+     * @param callback 回调函数，在专用线程中执行
+     */
+    AsyncWatch(const std::string &file_path, FileWatcher::Callback callback);
+    ~AsyncWatch();
+    AsyncWatch(const AsyncWatch &) = delete;
+    AsyncWatch &operator=(const AsyncWatch &) = delete;
+
+    explicit operator bool() const { return static_cast<bool>(handle_); }
+
+  private:
+    void request();
+    void run();
+
+    FileWatcher::Callback callback_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool pending_ = false;
+    bool stop_ = false;
+    std::thread thread_;
+    FileWatcher::Handle handle_;
+};
@@ -0,0 +1,366 @@
+#pragma once
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// opencv
+#include <opencv2/objdetect/face.hpp>
+
+/**
+ * @brief 64字节对齐的内存释放器
+ *
+ */
+struct AlignedFree {
+    void operator()(float *ptr) const { std::free(ptr); }
+};
+
+using AlignedFloatPtr = std::unique_ptr<float[], AlignedFree>;
+
+/**
+ * @brief 申请64字节对齐的浮点内存
+ *
+ * @param count 元素个数
+ * @return AlignedFloatPtr
+ */
+AlignedFloatPtr AllocAlignedFloats(size_t count);
+
+/**
+ * @brief L2归一化特征值，写入dst（长度为dim，其余填0至stride）
+ *
+ * @param src 原始特征
+ * @param dim 维度
+ * @param stride 行跨度
+ * @param dst 输出
+ */
+void NormalizeFeature(const float *src, int dim, int stride, float *dst);
+
+/**
+ * @brief 计算两个归一化向量的点积，自动选择AVX-512/AVX2/标量实现
+ *
+ * @param a 向量a
+ * @param b 向量b
+ * @param n 长度，需为16的倍数
+ * @return float 点积
+ */
+float DotProduct(const float *a, const float *b, int n);
+
+using DotProductFunc = float (*)(const float *, const float *, int);
+
+/**
+ * @brief 获得当前CPU上最快的点积实现，热循环中直接调用避免重复分派
+ *
+ * @return DotProductFunc
+ */
+DotProductFunc GetDotProductFunc();
+
+/**
+ * @brief 获得指定的点积实现，用于比较各实现的结果
+ *
+ * @param isa "avx512"、"avx2"或"scalar"
+ * @return DotProductFunc 当前CPU不支持或名称未知时为nullptr
+ */
+DotProductFunc GetDotProductFunc(std::string_view isa);
+
+/**
+ * @brief 当前使用的点积实现名称
+ *
+ * @return const char* "avx512"、"avx2"或"scalar"
+ */
+const char *DotProductIsa();
+
+/**
+ * @brief 余弦相似度转换为对应距离类型的分数
+ *
+ * @param cosine 余弦相似度
+ * @param distance_type 距离类型
+ * @return float 分数
+ */
+inline float CosineToScore(float cosine,
+                           cv::FaceRecognizerSF::DisType distance_type) {
+    if (distance_type == cv::FaceRecognizerSF::DisType::FR_COSINE)
+        return cosine;
+    // 归一化向量：|a-b|^2 = 2 - 2cos
+    const float sq = 2.f - 2.f * cosine;
+    return sq > 0.f ? std::sqrt(sq) : 0.f;
+}
+
+/**
+ * @brief 特征库搜索的一个候选
+ *
+ */
+struct GalleryCandidate {
+    // 特征库行号
+    int index = -1;
+    // 搜索过程中为余弦相似度，返回时为对应距离类型的分数
+    float score = 0.f;
+};
+
+/**
+ * @brief 特征库搜索参数
+ *
+ */
+struct GallerySearchParams {
+    // 每个查询保留的候选个数，同名目标只保留最好的一个
+    int top_k = 2;
+    // 按身份中心估计每个身份的分数上界，只扫描可能进入前top_k的身份，
+    // 结果与完整扫描相同；同一身份录入多张图片时才能减少扫描量
+    bool centroid_pruning = false;
+};
+
+/**
+ * @brief 特征库搜索结果
+ *
+ */
+struct GallerySearchResult {
+    // 前top_k个不同身份的候选，从最佳到最差
+    std::vector<GalleryCandidate> candidates;
+};
+
+/**
+ * @brief 将一行加入候选，按余弦相似度从大到小保持前top_k个，
+ * 同名目标只保留相似度最大的一个
+ *
+ * @tparam NameOf std::string_view(int)，行号对应的名字
+ * @param result 搜索结果
+ * @param top_k 候选个数
+ * @param index 行号
+ * @param cosine 余弦相似度
+ * @param name_of 取名字的函数
+ */
+template <typename NameOf>
+void InsertCandidate(GallerySearchResult &result, int top_k, int index,
+                     float cosine, NameOf &&name_of) {
+    const auto k = static_cast<size_t>(std::max(top_k, 1));
+    auto &candidates = result.candidates;
+    if (candidates.size() >= k && cosine <= candidates.back().score)
+        return;
+    // 同名目标已是候选时只保留更好的一个
+    const std::string_view candidate_name = name_of(index);
+    const auto same = std::find_if(
+        candidates.begin(), candidates.end(),
+        [&](const GalleryCandidate &candidate) {
+            return name_of(candidate.index) == candidate_name;
+        });
+    if (same != candidates.end()) {
+        if (same->score >= cosine)
+            return;
+        candidates.erase(same);
+    }
+    const auto position = std::find_if(
+        candidates.begin(), candidates.end(),
+        [cosine](const GalleryCandidate &candidate) {
+            return candidate.score < cosine;
+        });
+    candidates.insert(position, {index, cosine});
+    if (candidates.size() > k)
+        candidates.pop_back();
+    return;
+}
+
+/**
+ * @brief 为count个查询准备结果，保留候选数组的内存
+ *
+ * @param results 结果
+ * @param count 查询个数
+ */
+void ResetSearchResults(std::vector<GallerySearchResult> &results,
+                        size_t count);
+
+/**
+ * @brief 将所有候选的余弦相似度转换为对应距离类型的分数，顺序不变
+ *
+ * @param results 结果
+ * @param distance_type 距离类型
+ */
+void CosinesToScores(std::vector<GallerySearchResult> &results,
+                     cv::FaceRecognizerSF::DisType distance_type);
+
+/**
+ * @brief 目标特征库
+ * 所有目标特征预先L2归一化，按行连续存放在64字节对齐的矩阵中，名字存放在平行数组中
+ * 数据既可以由自身持有，也可以直接引用外部内存（如mmap映射的特征库文件），
+ * 引用外部内存时第一次修改会先复制一份
+ *
+ */
+class Gallery {
+  public:
+    // 行跨度对齐的浮点数个数（64字节）
+    static constexpr int kstride_align = 16;
+
+    Gallery() = default;
+    Gallery(Gallery &&other) noexcept;
+    Gallery &operator=(Gallery &&other) noexcept;
+    Gallery(const Gallery &) = delete;
+    Gallery &operator=(const Gallery &) = delete;
+
+    /**
+     * @brief 复制一份，引用的外部数据只读，直接共享
+     *
+     * @return Gallery
+     */
+    Gallery clone() const;
+
+    /**
+     * @brief 添加一个目标
+     *
+     * @param name 名字
+     * @param feature 特征值(1×dim, CV_32F)
+     * @return size_t 新目标的行号
+     */
+    size_t add(const std::string &name, const cv::Mat &feature);
+
+    /**
+     * @brief 删除满足条件的目标，其余目标保持原有顺序
+     *
+     * @param pred 以行号为参数的判断函数
+     * @return size_t 删除的个数
+     */
+    size_t removeIf(const std::function<bool(size_t)> &pred);
+
+    /**
+     * @brief 删除所有目标
+     *
+     */
+    void clear();
+
+    /**
+     * @brief 预留空间
+     *
+     * @param capacity 目标个数
+     */
+    void reserve(size_t capacity);
+
+    /**
+     * @brief 引用外部只读数据，不复制
+     *
+     * @param holder 外部数据的所有者，保证数据在特征库生命周期内有效
+     * @param dim 特征维度
+     * @param stride 行跨度
+     * @param count 目标个数
+     * @param features 已归一化的特征矩阵，64字节对齐
+     * @param name_offsets 名字偏移表，长度为count+1
+     * @param name_data 名字字符数据
+     */
+    void attach(std::shared_ptr<const void> holder, int dim, int stride,
+                size_t count, const float *features,
+                const uint64_t *name_offsets, const char *name_data);
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    int dim() const { return dim_; }
+    int stride() const { return stride_; }
+    bool isAttached() const { return holder_ != nullptr; }
+    std::string_view name(size_t index) const {
+        return {name_data_ + name_offsets_[index],
+                name_offsets_[index + 1] - name_offsets_[index]};
+    }
+    const float *row(size_t index) const { return data_ + index * stride_; }
+    const float *data() const { return data_; }
+    const uint64_t *nameOffsets() const { return name_offsets_; }
+    const char *nameData() const { return name_data_; }
+
+    /**
+     * @brief 将一批查询特征归一化并按行跨度打包
+     *
+     * @param queries 查询特征，N×dim，每行一个
+     * @param packed 输出N×stride归一化后的查询矩阵，尺寸不变时复用内存
+     */
+    void packQueries(const cv::Mat &queries, cv::Mat &packed) const;
+
+    /**
+     * @brief 一次遍历特征库，为所有查询求前top_k个不同身份的候选
+     *
+     * @param packed_queries packQueries的输出
+     * @param distance_type 距离类型
+     * @param top_k 每个查询的候选个数
+     * @param results 输出每个查询的结果，复用内存
+     */
+    void search(const cv::Mat &packed_queries,
+                cv::FaceRecognizerSF::DisType distance_type, int top_k,
+                std::vector<GallerySearchResult> &results) const;
+
+    /**
+     * @brief 将一行加入候选，按余弦相似度从大到小保持前top_k个，
+     * 同名目标只保留相似度最大的一个
+     *
+     * @param result 搜索结果
+     * @param top_k 候选个数
+     * @param index 行号
+     * @param cosine 余弦相似度
+     */
+    void insertCandidate(GallerySearchResult &result, int top_k, int index,
+                         float cosine) const;
+
+  private:
+    void grow(size_t capacity);
+    void detach();
+    void syncNamePointers();
+
+    // 自身持有的数据
+    AlignedFloatPtr storage_;
+    size_t capacity_ = 0;
+    std::vector<uint64_t> owned_name_offsets_ = {0};
+    std::string owned_name_data_;
+    // 外部数据的所有者
+    std::shared_ptr<const void> holder_;
+    // 当前使用的数据
+    const float *data_ = nullptr;
+    const uint64_t *name_offsets_ = owned_name_offsets_.data();
+    const char *name_data_ = owned_name_data_.data();
+    size_t size_ = 0;
+    int dim_ = 0;
+    int stride_ = 0;
+};
+
+/**
+ * @brief 按名字分组的身份中心，用于剪枝搜索
+ * 成员与中心的夹角不超过max_angle时，查询与任一成员的夹角不小于
+ * 查询与中心的夹角减去max_angle，由此得到该身份相似度的上界
+ *
+ */
+class IdentityCentroids {
+  public:
+    /**
+     * @brief 由特征库构建
+     *
+     * @param gallery 特征库
+     */
+    explicit IdentityCentroids(const Gallery &gallery);
+
+    /**
+     * @brief 身份个数
+     *
+     * @return size_t
+     */
+    size_t size() const { return max_angles_.size(); }
+
+    /**
+     * @brief 按上界从大到小扫描身份，上界不超过第top_k个候选时提前结束
+     *
+     * @param gallery 构建时使用的特征库
+     * @param packed_queries Gallery::packQueries的输出
+     * @param distance_type 距离类型
+     * @param top_k 每个查询的候选个数
+     * @param results 输出每个查询的结果，复用内存
+     */
+    void search(const Gallery &gallery, const cv::Mat &packed_queries,
+                cv::FaceRecognizerSF::DisType distance_type, int top_k,
+                std::vector<GallerySearchResult> &results) const;
+
+  private:
+    int stride_ = 0;
+    // 归一化的身份中心，每行一个身份
+    AlignedFloatPtr centroids_;
+    // 成员与中心的最大夹角（弧度）
+    std::vector<float> max_angles_;
+    // 第i个身份的成员行号为members_[member_offsets_[i], member_offsets_[i+1])
+    std::vector<uint32_t> member_offsets_;
+    std::vector<uint32_t> members_;
+};
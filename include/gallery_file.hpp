@@ -0,0 +1,120 @@
+#pragma once
+// std
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// custom
+#include "gallery.hpp"
+
+/**
+ * @brief 特征库文件头，文件布局：
+ * [文件头 64B][名字偏移表 (count+1)×u64][名字字符数据][填充至64B对齐][特征矩阵 count×stride×f32]
+ * 所有整数为小端序，特征已L2归一化
+ *
+ */
+struct GalleryFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dim;
+    uint32_t stride;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t model_hash;
+    uint64_t names_offset;
+    uint64_t features_offset;
+    uint64_t file_size;
+};
+static_assert(sizeof(GalleryFileHeader) == 64, "文件头必须为64字节");
+
+constexpr char kgallery_magic[8] = {'F', 'R', 'G', 'A', 'L', 'L', 'R', 'Y'};
+constexpr uint32_t kgallery_version = 1;
+
+/**
+ * @brief 只读内存映射文件
+ *
+ */
+class MappedFile {
+  public:
+    /**
+     * @brief 映射文件
+     *
+     * @param file_path 文件路径
+     * @return std::shared_ptr<MappedFile> 失败时返回空
+     */
+    static std::shared_ptr<MappedFile> open(const std::string &file_path);
+
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+
+  private:
+    MappedFile(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * @brief 计算文件内容的FNV-1a 64位哈希
+ *
+ * @param file_path 文件路径
+ * @param hash 初始值，可用于串联多个文件
+ * @return uint64_t 哈希值，文件不存在时返回初始值
+ */
+uint64_t HashFile(const std::string &file_path,
+                  uint64_t hash = 0xcbf29ce484222325ull);
+
+/**
+ * @brief 计算模型哈希，YuNet决定对齐关键点，SFace决定特征，二者都会影响特征库
+ *
+ * @param yunet_model_path YuNet模型路径
+ * @param sface_model_path SFace模型路径
+ * @return uint64_t 哈希值
+ */
+uint64_t ModelHash(const std::string &yunet_model_path,
+                   const std::string &sface_model_path);
+
+/**
+ * @brief 计算特征库内容（名字和特征）的哈希，按8字节一组混合，
+ * 用于确认旁路文件与特征库文件属于同一次保存
+ *
+ * @param gallery 特征库
+ * @return uint64_t 哈希值
+ */
+uint64_t HashGallery(const Gallery &gallery);
+
+/**
+ * @brief 特征库保存为文件后的大小
+ *
+ * @param gallery 特征库
+ * @return uint64_t 字节数
+ */
+uint64_t GalleryFileSize(const Gallery &gallery);
+
+/**
+ * @brief 保存特征库到文件，先写临时文件再重命名，其他进程不会读到半个文件
+ *
+ * @param file_path 文件路径
+ * @param gallery 特征库
+ * @param model_hash 模型哈希
+ * @return true 保存成功
+ * @return false 保存失败
+ */
+bool SaveGallery(const std::string &file_path, const Gallery &gallery,
+                 uint64_t model_hash);
+
+/**
+ * @brief 以内存映射的方式加载特征库，不复制特征数据
+ *
+ * @param file_path 文件路径
+ * @param model_hash 期望的模型哈希
+ * @param gallery 输出的特征库
+ * @return true 加载成功
+ * @return false 文件不存在、格式错误或模型不一致
+ */
+bool LoadGallery(const std::string &file_path, uint64_t model_hash,
+                 Gallery &gallery);
@@ -0,0 +1,297 @@
+#pragma once
+// std
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// opencv
+#include <opencv2/core.hpp>
+
+// custom
+#include "gallery.hpp"
+
+/**
+ * @brief 特征库索引类型表
+ *
+ */
+enum GalleryIndexType { kbrute_force_index = 0, khnsw_index = 1 };
+
+/**
+ * @brief HNSW索引参数
+ *
+ */
+struct HnswParams {
+    // 每层最大邻居数，第0层为2m
+    int m = 16;
+    // 构建时候选集大小，越大召回越高、构建越慢
+    int ef_construction = 200;
+    // 搜索时候选集大小，越大召回越高、延迟越高
+    int ef_search = 64;
+    // 随机层数种子，保证同样的输入建出同样的图
+    unsigned int seed = 100;
+};
+
+/**
+ * @brief 特征库索引接口，目标名字和归一化特征存放在内部的Gallery中
+ *
+ */
+class GalleryIndex {
+  public:
+    virtual ~GalleryIndex() = default;
+
+    /**
+     * @brief 索引类型名
+     *
+     * @return const char*
+     */
+    virtual const char *type() const = 0;
+
+    /**
+     * @brief 创建同类型、同参数的空索引
+     *
+     * @return cv::Ptr<GalleryIndex>
+     */
+    virtual cv::Ptr<GalleryIndex> create() const = 0;
+
+    /**
+     * @brief 复制索引及其中的目标，用于写时复制
+     *
+     * @return cv::Ptr<GalleryIndex>
+     */
+    virtual cv::Ptr<GalleryIndex> clone() const = 0;
+
+    /**
+     * @brief 插入一个目标
+     *
+     * @param name 名字
+     * @param feature 特征值(1×dim, CV_32F)
+     */
+    virtual void add(const std::string &name, const cv::Mat &feature) = 0;
+
+    /**
+     * @brief 删除指定名字的所有目标
+     *
+     * @param name 名字
+     * @return size_t 删除的个数
+     */
+    virtual size_t remove(std::string_view name) = 0;
+
+    /**
+     * @brief 删除所有目标
+     *
+     */
+    virtual void clear() = 0;
+
+    /**
+     * @brief 有效目标个数
+     *
+     * @return size_t
+     */
+    virtual size_t size() const = 0;
+
+    /**
+     * @brief 为每个查询求前top_k个不同身份的候选，索引号对应gallery()的行号
+     *
+     * @param packed_queries Gallery::packQueries的输出
+     * @param distance_type 距离类型
+     * @param params 搜索参数
+     * @param results 输出每个查询的结果，复用内存
+     */
+    virtual void search(const cv::Mat &packed_queries,
+                        cv::FaceRecognizerSF::DisType distance_type,
+                        const GallerySearchParams &params,
+                        std::vector<GallerySearchResult> &results) const = 0;
+
+    /**
+     * @brief 保存到文件
+     *
+     * @param file_path 特征库文件路径
+     * @param model_hash 模型哈希
+     * @return true 保存成功
+     * @return false 保存失败
+     */
+    virtual bool save(const std::string &file_path,
+                      uint64_t model_hash) const = 0;
+
+    /**
+     * @brief 从文件加载，替换现有目标
+     *
+     * @param file_path 特征库文件路径
+     * @param model_hash 模型哈希
+     * @return true 加载成功
+     * @return false 加载失败
+     */
+    virtual bool load(const std::string &file_path, uint64_t model_hash) = 0;
+
+    /**
+     * @brief 预留空间
+     *
+     * @param capacity 目标个数
+     */
+    virtual void reserve(size_t capacity) { gallery_.reserve(capacity); }
+
+    /**
+     * @brief 构建搜索用的只读辅助结构，GalleryStore在发布前于写者线程调用，
+     * 发布后search不再修改索引；已构建时直接返回
+     *
+     */
+    virtual void prepare() {}
+
+    /**
+     * @brief 将一批查询特征归一化并按行跨度打包，见Gallery::packQueries
+     *
+     * @param queries 查询特征，N×dim，每行一个
+     * @param packed 输出N×stride归一化后的查询矩阵
+     */
+    virtual void packQueries(const cv::Mat &queries, cv::Mat &packed) const {
+        gallery_.packQueries(queries, packed);
+    }
+
+    /**
+     * @brief search结果中索引号对应的名字
+     *
+     * @param index 索引号
+     * @return std::string_view
+     */
+    virtual std::string_view name(int index) const {
+        return gallery_.name(index);
+    }
+
+    /**
+     * @brief 行是否有效，被删除但仍保留在图中的行无效
+     *
+     * @param row 行号
+     * @return true 有效
+     */
+    virtual bool isLive(size_t row) const { return row < gallery_.size(); }
+
+    const Gallery &gallery() const { return gallery_; }
+
+  protected:
+    Gallery gallery_;
+};
+
+/**
+ * @brief 暴力搜索索引，结果精确，一次顺序扫描整个特征库
+ * 身份中心在prepare中构建，修改目标后作废；没有身份中心时开启中心剪枝
+ * 也按完整扫描搜索
+ *
+ */
+class BruteForceIndex : public GalleryIndex {
+  public:
+    const char *type() const override { return "brute_force"; }
+    cv::Ptr<GalleryIndex> create() const override;
+    cv::Ptr<GalleryIndex> clone() const override;
+    void add(const std::string &name, const cv::Mat &feature) override;
+    size_t remove(std::string_view name) override;
+    void clear() override;
+    size_t size() const override { return gallery_.size(); }
+    void search(const cv::Mat &packed_queries,
+                cv::FaceRecognizerSF::DisType distance_type,
+                const GallerySearchParams &params,
+                std::vector<GallerySearchResult> &results) const override;
+    bool save(const std::string &file_path,
+              uint64_t model_hash) const override;
+    bool load(const std::string &file_path, uint64_t model_hash) override;
+    void prepare() override;
+
+  private:
+    // 发布后只读，搜索时不加锁
+    std::shared_ptr<const IdentityCentroids> centroids_;
+};
+
+/**
+ * @brief 写时复制的叠加索引
+ * 共享一个只读的基础索引，新增的目标放在自身的小特征库中顺序扫描，
+ * 删除基础索引中的目标只记录名字，搜索时过滤。派生新版本只复制叠加部分，
+ * 叠加部分超过kmax_overlay时才复制基础索引合并一次，增删目标的均摊代价
+ * 与特征库大小无关。gallery()只包含新增的目标
+ *
+ */
+class OverlayIndex : public GalleryIndex {
+  public:
+    // 新增行数与删除的名字数之和超过该值时合并进基础索引
+    static constexpr size_t kmax_overlay = 4096;
+
+    /**
+     * @brief 在索引之上创建可修改的叠加层，不复制索引；
+     * index本身是叠加层时共享其基础索引，只复制叠加部分
+     *
+     * @param index 当前版本的索引，之后不应再修改
+     * @return cv::Ptr<OverlayIndex>
+     */
+    static cv::Ptr<OverlayIndex> Derive(const cv::Ptr<GalleryIndex> &index);
+
+    /**
+     * @brief 叠加部分超过kmax_overlay时合并进基础索引
+     *
+     */
+    void compact();
+
+    /**
+     * @brief 合并为一个普通索引，复制一次基础索引
+     *
+     * @return cv::Ptr<GalleryIndex>
+     */
+    cv::Ptr<GalleryIndex> flatten() const;
+
+    const char *type() const override { return base_->type(); }
+    cv::Ptr<GalleryIndex> create() const override { return base_->create(); }
+    cv::Ptr<GalleryIndex> clone() const override;
+    void add(const std::string &name, const cv::Mat &feature) override;
+    size_t remove(std::string_view name) override;
+    void clear() override;
+    size_t size() const override {
+        return base_->size() - removed_rows_ + gallery_.size();
+    }
+    void search(const cv::Mat &packed_queries,
+                cv::FaceRecognizerSF::DisType distance_type,
+                const GallerySearchParams &params,
+                std::vector<GallerySearchResult> &results) const override;
+    bool save(const std::string &file_path,
+              uint64_t model_hash) const override;
+    bool load(const std::string &file_path, uint64_t model_hash) override;
+    void reserve(size_t capacity) override;
+    void prepare() override { base_->prepare(); }
+    void packQueries(const cv::Mat &queries, cv::Mat &packed) const override;
+    std::string_view name(int index) const override;
+    bool isLive(size_t row) const override;
+
+  private:
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const {
+            return std::hash<std::string_view>()(name);
+        }
+    };
+    using NameCounts =
+        std::unordered_map<std::string, size_t, NameHash, std::equal_to<>>;
+    using NameSet = std::unordered_set<std::string, NameHash, std::equal_to<>>;
+
+    OverlayIndex() = default;
+    explicit OverlayIndex(cv::Ptr<GalleryIndex> base);
+    cv::Ptr<OverlayIndex> copy() const;
+    void setBase(cv::Ptr<GalleryIndex> base);
+    size_t baseRows() const { return base_->gallery().size(); }
+
+    // 基础索引，多个版本共享，不再修改
+    cv::Ptr<GalleryIndex> base_;
+    // 基础索引中每个名字的有效行数，同一基础索引的所有版本共享
+    std::shared_ptr<const NameCounts> base_names_;
+    // 基础索引中被删除的名字及其行数
+    NameSet removed_;
+    size_t removed_rows_ = 0;
+};
+
+/**
+ * @brief 按类型创建特征库索引
+ *
+ * @param index_type 索引类型，见GalleryIndexType
+ * @param hnsw_params HNSW参数
+ * @return cv::Ptr<GalleryIndex>
+ */
+cv::Ptr<GalleryIndex> CreateGalleryIndex(int index_type,
+                                         const HnswParams &hnsw_params = {});
@@ -0,0 +1,136 @@
+#pragma once
+// std
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// custom
+#include "gallery_index.hpp"
+
+/**
+ * @brief 支持一边匹配一边增删目标的特征库
+ * 每个版本的索引发布后不再修改。读者登记当前纪元后直接读取当前版本，
+ * 全程无锁；写者在当前版本之上派生叠加层（OverlayIndex）修改后原子替换，
+ * 旧版本在所有可能读到它的读者离开后才释放（基于纪元的内存回收）
+ *
+ */
+class GalleryStore {
+  private:
+    struct Version {
+        cv::Ptr<GalleryIndex> index;
+        uint64_t number = 0;
+    };
+
+  public:
+    // 同时持有快照的读者上限，超出时等待空位
+    static constexpr size_t kmax_readers = 64;
+
+    /**
+     * @brief 只读快照，持有期间对应版本不会被释放，应尽快析构
+     *
+     */
+    class Snapshot {
+      public:
+        Snapshot(Snapshot &&other) noexcept
+            : slot_(std::exchange(other.slot_, nullptr)),
+              version_(other.version_) {}
+        Snapshot &operator=(Snapshot &&other) noexcept;
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+        ~Snapshot() { release(); }
+
+        const GalleryIndex &operator*() const { return *version_->index; }
+        const GalleryIndex *operator->() const {
+            return version_->index.get();
+        }
+        uint64_t version() const { return version_->number; }
+
+      private:
+        friend class GalleryStore;
+        Snapshot(std::atomic<uint64_t> *slot, const Version *version)
+            : slot_(slot), version_(version) {}
+        void release();
+
+        std::atomic<uint64_t> *slot_ = nullptr;
+        const Version *version_ = nullptr;
+    };
+
+    explicit GalleryStore(cv::Ptr<GalleryIndex> index);
+    ~GalleryStore();
+    GalleryStore(const GalleryStore &) = delete;
+    GalleryStore &operator=(const GalleryStore &) = delete;
+
+    /**
+     * @brief 获取当前版本的快照，无锁
+     *
+     * @return Snapshot
+     */
+    Snapshot acquire() const;
+
+    /**
+     * @brief 发布新版本，之后的acquire立即看到新版本；发布前调用
+     * index->prepare()
+     *
+     * @param index 新的索引，发布后不应再修改
+     * @return uint64_t 新版本号
+     */
+    uint64_t publish(cv::Ptr<GalleryIndex> index);
+
+    /**
+     * @brief 在当前版本之上派生叠加层，修改后发布，多个写者之间串行
+     * 只复制叠加部分，叠加部分过大时才复制整个索引合并一次
+     *
+     * @tparam Modify void(GalleryIndex &)
+     * @param modify 修改函数
+     * @return uint64_t 新版本号
+     */
+    template <typename Modify> uint64_t update(Modify &&modify) {
+        std::lock_guard lock(writer_mutex_);
+        auto next = OverlayIndex::Derive(current_owner_->index);
+        modify(*next);
+        next->compact();
+        return publishLocked(std::move(next));
+    }
+
+    /**
+     * @brief 创建与当前版本同类型、同参数的空索引
+     *
+     * @return cv::Ptr<GalleryIndex>
+     */
+    cv::Ptr<GalleryIndex> create() const;
+
+    /**
+     * @brief 当前版本号，每次发布加一
+     *
+     * @return uint64_t
+     */
+    uint64_t version() const { return current_.load()->number; }
+
+    /**
+     * @brief 释放已没有读者的旧版本，发布时会自动调用
+     *
+     */
+    void reclaim();
+
+  private:
+    struct alignas(64) ReaderSlot {
+        // 读者登记的纪元，0表示空闲
+        std::atomic<uint64_t> epoch{0};
+    };
+
+    uint64_t publishLocked(cv::Ptr<GalleryIndex> index);
+    void reclaimLocked();
+
+    std::atomic<const Version *> current_{nullptr};
+    std::atomic<uint64_t> epoch_{1};
+    mutable std::array<ReaderSlot, kmax_readers> slots_;
+    // 以下只由写者访问
+    mutable std::mutex writer_mutex_;
+    std::unique_ptr<const Version> current_owner_;
+    // 被替换的版本及替换时的纪元
+    std::vector<std::pair<uint64_t, std::unique_ptr<const Version>>> retired_;
+};
@@ -0,0 +1,71 @@
+#pragma once
+// std
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+// custom
+#include "gallery_index.hpp"
+
+/**
+ * @brief HNSW近似最近邻索引
+ * 分层可导航小世界图，搜索复杂度约为O(log N)。删除采用墓碑标记，
+ * 被删除的节点仍参与图的连通，但不会出现在结果中，墓碑过多时重建
+ * 图结构保存在特征库文件旁的<file_path>.hnsw中
+ *
+ */
+class HnswIndex : public GalleryIndex {
+  public:
+    explicit HnswIndex(const HnswParams &params = {})
+        : params_(params), rng_(params.seed), dot_(GetDotProductFunc()) {}
+
+    const char *type() const override { return "hnsw"; }
+    cv::Ptr<GalleryIndex> create() const override;
+    cv::Ptr<GalleryIndex> clone() const override;
+    void add(const std::string &name, const cv::Mat &feature) override;
+    size_t remove(std::string_view name) override;
+    void clear() override;
+    size_t size() const override { return gallery_.size() - deleted_count_; }
+    void search(const cv::Mat &packed_queries,
+                cv::FaceRecognizerSF::DisType distance_type,
+                const GallerySearchParams &params,
+                std::vector<GallerySearchResult> &results) const override;
+    bool save(const std::string &file_path,
+              uint64_t model_hash) const override;
+    bool load(const std::string &file_path, uint64_t model_hash) override;
+    bool isLive(size_t row) const override {
+        return row < deleted_.size() && deleted_[row] == 0;
+    }
+
+    /**
+     * @brief 设置搜索时候选集大小
+     *
+     * @param ef_search
+     */
+    void setEfSearch(int ef_search) { params_.ef_search = ef_search; }
+
+  private:
+    // 距离与节点号，距离为1-cos
+    using Candidate = std::pair<float, uint32_t>;
+    using Neighbors = std::vector<uint32_t>;
+
+    float distance(const float *query, uint32_t id) const;
+    int randomLevel();
+    void insertNode(uint32_t id);
+    void searchLayer(const float *query, uint32_t entry, int ef, int level,
+                     std::vector<Candidate> &nearest) const;
+    Neighbors selectNeighbors(std::vector<Candidate> candidates,
+                              size_t max_count) const;
+    void rebuild();
+
+    HnswParams params_;
+    std::mt19937 rng_;
+    DotProductFunc dot_;
+    // links_[节点][层] = 邻居
+    std::vector<std::vector<Neighbors>> links_;
+    std::vector<uint8_t> deleted_;
+    size_t deleted_count_ = 0;
+    int max_level_ = -1;
+    uint32_t entry_point_ = 0;
+};
@@ -0,0 +1,222 @@
+#pragma once
+// std
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 对数线性分桶的直方图（HDR风格），记录非负整数
+ * 每个2的幂区间再等分为16个子桶，分位数的相对误差不超过1/16；
+ * 记录只有几次relaxed原子操作，可在任意线程中并发调用
+ *
+ */
+class Histogram {
+  public:
+    static constexpr int ksub_bucket_bits = 4;
+    static constexpr int ksub_bucket_count = 1 << ksub_bucket_bits;
+    // 小于16的值各占一个桶，其余每个指数16个桶
+    static constexpr int kbucket_count =
+        ksub_bucket_count * (64 - ksub_bucket_bits + 1);
+
+    /**
+     * @brief 记录一个值
+     *
+     * @param value 值
+     */
+    void record(uint64_t value);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 分位数，返回所在桶的中点
+     *
+     * @param q 分位，0~1
+     * @return double 没有记录时为0
+     */
+    double quantile(double q) const;
+
+  private:
+    static int BucketIndex(uint64_t value);
+    static uint64_t BucketLower(int index);
+    static uint64_t BucketWidth(int index);
+
+    std::array<std::atomic<uint64_t>, kbucket_count> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+/**
+ * @brief 计时的处理环节表
+ *
+ */
+enum MetricStage {
+    kmetric_capture = 0,
+    kmetric_resize = 1,
+    kmetric_yunet = 2,
+    kmetric_align_crop = 3,
+    kmetric_sface = 4,
+    kmetric_match = 5,
+    kmetric_render = 6,
+    // 运动门控的降采样和灰度化
+    kmetric_motion = 7,
+    // 分块检测的粗检缩放
+    kmetric_tile = 8,
+    // 录入图片的等比缩放和填充
+    kmetric_letterbox = 9,
+    kmetric_stage_count
+};
+
+/**
+ * @brief 进程内的运行指标：各环节耗时和每帧人脸数
+ * 始终开启，导出由MetricsExporter负责
+ *
+ */
+class Metrics {
+  public:
+    /**
+     * @brief 进程内唯一的实例
+     *
+     * @return Metrics&
+     */
+    static Metrics &Global();
+
+    /**
+     * @brief 环节名，用作Prometheus标签
+     *
+     * @param stage 环节
+     * @return const char*
+     */
+    static const char *StageName(MetricStage stage);
+
+    void recordLatency(MetricStage stage,
+                       std::chrono::steady_clock::duration duration);
+    void recordFaces(int faces) { faces_.record(static_cast<uint64_t>(faces)); }
+
+    const Histogram &latency(MetricStage stage) const {
+        return latencies_[stage];
+    }
+    const Histogram &faces() const { return faces_; }
+
+    /**
+     * @brief 以Prometheus文本格式追加所有指标
+     *
+     * @param text 输出
+     */
+    void writePrometheus(std::string &text) const;
+
+  private:
+    // 耗时以纳秒记录
+    std::array<Histogram, kmetric_stage_count> latencies_;
+    Histogram faces_;
+};
+
+/**
+ * @brief 作用域计时器，析构时记录所在环节的耗时
+ *
+ */
+class MetricTimer {
+  public:
+    explicit MetricTimer(MetricStage stage)
+        : stage_(stage), begin_(std::chrono::steady_clock::now()) {}
+    ~MetricTimer() {
+        Metrics::Global().recordLatency(
+            stage_, std::chrono::steady_clock::now() - begin_);
+    }
+    MetricTimer(const MetricTimer &) = delete;
+    MetricTimer &operator=(const MetricTimer &) = delete;
+
+  private:
+    MetricStage stage_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+/**
+ * @brief 指标导出配置
+ *
+ */
+struct MetricsExportOptions {
+    // 本机HTTP端口，GET /metrics返回Prometheus文本，0表示不监听
+    int port = 0;
+    // 定期写出的文件（如node_exporter的textfile目录），为空表示不写
+    std::string file_path;
+    std::chrono::seconds interval{10};
+};
+
+/**
+ * @brief 指标导出线程，提供本机HTTP接口并定期写出文件
+ *
+ */
+class MetricsExporter {
+  public:
+    // 导出时读取的值
+    using ValueFunc = std::function<double()>;
+
+    explicit MetricsExporter(const MetricsExportOptions &options);
+    ~MetricsExporter();
+    MetricsExporter(const MetricsExporter &) = delete;
+    MetricsExporter &operator=(const MetricsExporter &) = delete;
+
+    /**
+     * @brief 添加由其他模块持有的指标，如特征库大小、丢弃的帧数
+     * func在导出线程中调用，其引用的对象须比导出器活得久
+     *
+     * @param name 指标名
+     * @param help 说明
+     * @param type gauge或counter
+     * @param func 读取当前值
+     */
+    void addValue(const std::string &name, const std::string &help,
+                  const std::string &type, ValueFunc func);
+
+    /**
+     * @brief 启动导出线程
+     *
+     * @return true 成功
+     * @return false 端口监听失败
+     */
+    bool start();
+
+    /**
+     * @brief 停止导出线程，配置了文件时最后写出一次
+     *
+     */
+    void stop();
+
+    /**
+     * @brief 当前所有指标的Prometheus文本
+     *
+     * @return std::string
+     */
+    std::string render() const;
+
+  private:
+    struct Value {
+        std::string name;
+        std::string help;
+        std::string type;
+        ValueFunc func;
+    };
+
+    void run();
+    void serve(int client_fd);
+    bool dumpFile();
+
+    MetricsExportOptions options_;
+    // 保护values_
+    mutable std::mutex mutex_;
+    std::vector<Value> values_;
+    int listen_fd_ = -1;
+    // 用于唤醒导出线程的管道
+    int wake_fds_[2] = {-1, -1};
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+};
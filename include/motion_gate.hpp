@@ -0,0 +1,111 @@
+#pragma once
+// std
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// opencv
+#include <opencv2/core.hpp>
+
+/**
+ * @brief 运动门控参数
+ *
+ */
+struct MotionParams {
+    bool enabled = false;
+    // 运动检测图像的宽度，高度按原图比例，均取8的倍数
+    int width = 160;
+    // 灰度与背景之差超过该值的像素视为变化，越小越灵敏
+    int pixel_threshold = 20;
+    // 8×8单元格中变化像素的比例超过该值视为运动
+    float cell_ratio = 0.2f;
+    // 背景每帧向当前帧靠近1/2^n，0表示与上一帧比较
+    int background_shift = 2;
+    // 最多每隔多少帧强制做一次整图检测，保证静止的新人脸最终被发现
+    int full_interval = 30;
+};
+
+/**
+ * @brief 一帧的门控决策
+ *
+ */
+struct MotionDecision {
+    // 是否需要检测
+    bool detect = true;
+    // 需要检测的区域（原图坐标），为空表示整幅图像
+    cv::Rect region;
+    // 运动单元格占全部单元格的比例
+    float motion_ratio = 0.f;
+};
+
+/**
+ * @brief 运动门控累计统计
+ *
+ */
+struct MotionStats {
+    size_t frames = 0;
+    // 画面静止而跳过检测的帧
+    size_t skipped = 0;
+    // 只检测变化区域的帧
+    size_t partial = 0;
+    // 整图检测的帧（含强制和变化区域过大）
+    size_t full = 0;
+};
+
+/**
+ * @brief 检测前的运动门控
+ * 在缩小的灰度图上与背景逐像素比较（AVX2/标量），按8×8单元格统计变化，
+ * 画面静止时跳过检测；只有部分区域变化时，将变化区域和上次检测到的人脸
+ * 合并，对齐到原图1/4或1/2大小的窗口只检测该窗口，窗口尺寸只有几种，
+ * 不会反复重新配置网络
+ * update只应在一个线程中调用，stats可在任意线程中调用
+ *
+ */
+class MotionGate {
+  public:
+    // 单元格边长
+    static constexpr int kcell_size = 8;
+
+    explicit MotionGate(const MotionParams &params = {}) { setParams(params); }
+
+    /**
+     * @brief 更新参数，检测图像尺寸变化时重新建立背景
+     *
+     * @param params 参数
+     */
+    void setParams(const MotionParams &params);
+
+    /**
+     * @brief 用当前帧更新背景并决定是否检测以及检测区域
+     *
+     * @param image 当前帧（BGR）
+     * @param faces 上次检测到的人脸（原图坐标），合并进检测区域，避免静止的
+     * 人脸因不在变化区域内而丢失
+     * @return MotionDecision
+     */
+    MotionDecision update(const cv::Mat &image, const cv::Mat &faces);
+
+    /**
+     * @brief 丢弃背景，下一帧整图检测
+     *
+     */
+    void reset();
+
+    MotionStats stats() const;
+
+  private:
+    cv::Rect snapRegion(const cv::Rect &region, const cv::Size &size) const;
+
+    MotionParams params_;
+    // 缩小的输入和背景
+    cv::Mat small_;
+    cv::Mat gray_;
+    cv::Mat background_;
+    // 每行每8个像素的变化计数，以及每个单元格的变化计数
+    std::vector<uint8_t> row_counts_;
+    std::vector<uint16_t> cell_counts_;
+    int frames_since_full_ = 0;
+
+    mutable std::mutex stats_mutex_;
+    MotionStats stats_;
+};
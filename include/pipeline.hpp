@@ -0,0 +1,138 @@
+#pragma once
+// std
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// custom
+#include "detector.hpp"
+#include "spsc_queue.hpp"
+
+/**
+ * @brief 在流水线中传递的一帧
+ * 消费者用完后交还给流水线，采集阶段复用其中的图像和帧缓冲
+ *
+ */
+struct PipelineFrame {
+    // 帧号，从0开始连续编号，被丢弃的帧不会出现在输出中
+    size_t index = 0;
+    std::chrono::steady_clock::time_point capture_time;
+    cv::Mat image;
+    // 本帧是否做了完整检测，以及检测输入的缩放
+    bool detected = true;
+    float detect_scale = 1.f;
+    FrameContext context;
+};
+
+/**
+ * @brief 单个阶段的耗时统计
+ *
+ */
+struct StageStats {
+    std::string name;
+    size_t frames = 0;
+    double avg_ms = 0.0;
+    double max_ms = 0.0;
+    // 该阶段输出队列因丢弃策略丢掉的帧
+    size_t dropped = 0;
+};
+
+/**
+ * @brief 流水线配置
+ *
+ */
+struct PipelineOptions {
+    // 每个阶段之间的队列容量
+    size_t queue_capacity = 4;
+    // 队列满时的处理策略
+    BackpressurePolicy backpressure = kbackpressure_block;
+};
+
+/**
+ * @brief 采集→检测→识别→渲染多线程流水线
+ * 每个阶段一个线程，阶段之间为有界无锁队列，吞吐接近最慢的阶段；
+ * 队列均为先进先出，输出顺序与采集顺序一致
+ *
+ */
+class FramePipeline {
+  public:
+    // 读取一帧，返回false表示输入结束
+    using CaptureFunc = std::function<bool(cv::Mat &)>;
+    // 处理一帧
+    using StageFunc = std::function<void(PipelineFrame &)>;
+
+    FramePipeline(const PipelineOptions &options, CaptureFunc capture,
+                  StageFunc detect, StageFunc recognize, StageFunc render);
+    ~FramePipeline();
+    FramePipeline(const FramePipeline &) = delete;
+    FramePipeline &operator=(const FramePipeline &) = delete;
+
+    /**
+     * @brief 启动所有阶段线程，只能启动一次
+     *
+     */
+    void start();
+
+    /**
+     * @brief 取出渲染完成的一帧，按采集顺序
+     *
+     * @param frame 输出帧
+     * @return true 成功
+     * @return false 流水线已结束
+     */
+    bool pop(PipelineFrame &frame);
+
+    /**
+     * @brief 交还用完的帧，采集阶段优先复用，稳态下每帧不再分配内存
+     *
+     * @param frame pop取出的帧
+     */
+    void recycle(PipelineFrame &&frame);
+
+    /**
+     * @brief 停止并等待所有阶段线程退出
+     *
+     */
+    void stop();
+
+    /**
+     * @brief 各阶段的耗时统计
+     *
+     * @return std::vector<StageStats>
+     */
+    std::vector<StageStats> stageStats() const;
+
+  private:
+    using FrameQueue = SpscQueue<PipelineFrame>;
+
+    /**
+     * @brief 阶段计时器，只由所在阶段线程写入
+     *
+     */
+    struct StageTimer {
+        std::string name;
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> total_ns{0};
+        std::atomic<uint64_t> max_ns{0};
+
+        void record(std::chrono::steady_clock::duration duration);
+    };
+
+    void runCapture();
+    void runStage(size_t stage, FrameQueue &input, FrameQueue *output);
+
+    PipelineOptions options_;
+    CaptureFunc capture_;
+    std::vector<StageFunc> stage_funcs_;
+    // queues_[i]为第i个阶段的输出队列
+    std::vector<std::unique_ptr<FrameQueue>> queues_;
+    // 消费者交还给采集阶段的空闲帧
+    std::unique_ptr<FrameQueue> free_frames_;
+    std::vector<std::unique_ptr<StageTimer>> timers_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool> stop_{false};
+};
@@ -0,0 +1,70 @@
+#pragma once
+// std
+#include <string>
+#include <vector>
+
+// custom
+#include "detector.hpp"
+
+/**
+ * @brief 模型精度模式，按位组合
+ *
+ */
+enum PrecisionMode {
+    kprecision_fp32 = 0,
+    // YuNet使用INT8模型
+    kprecision_yunet_int8 = 1,
+    // SFace使用INT8模型
+    kprecision_sface_int8 = 2,
+    kprecision_int8 = kprecision_yunet_int8 | kprecision_sface_int8,
+};
+
+/**
+ * @brief 单个模型FP32与INT8的平均耗时
+ *
+ */
+struct ModelSpeed {
+    double fp32_ms = 0.0;
+    double int8_ms = 0.0;
+    double speedup() const { return int8_ms > 0.0 ? fp32_ms / int8_ms : 0.0; }
+};
+
+/**
+ * @brief INT8相对FP32的精度与速度报告
+ * 没有人工标注，以FP32的结果作为参考
+ *
+ */
+struct PrecisionReport {
+    size_t images = 0;
+    // FP32检测到的人脸数
+    size_t faces = 0;
+    // 以FP32检测框为真值时INT8检测的AP@0.5，mAP差值即1-AP
+    double detection_ap = 0.0;
+    // 同一对齐人脸FP32与INT8特征的余弦相似度
+    double embedding_cos_mean = 0.0;
+    double embedding_cos_min = 1.0;
+    // 余弦相似度低于识别阈值的人脸数，这些人脸在INT8下可能认错
+    size_t embedding_below_threshold = 0;
+    ModelSpeed yunet;
+    ModelSpeed sface;
+};
+
+/**
+ * @brief 在一组本地图片上比较FP32和INT8模型
+ * 检测在填充到固定尺寸的图像上进行，特征在FP32检测框上提取，
+ * 使两个模型的误差互不影响
+ *
+ * @param image_paths 图片路径
+ * @param yunet_fp32 FP32检测器
+ * @param yunet_int8 INT8检测器
+ * @param sface_fp32 FP32特征提取器
+ * @param sface_int8 INT8特征提取器
+ * @param cosine_threshold 识别使用的余弦阈值
+ * @param report 输出报告
+ * @return true 成功
+ * @return false 没有可用的图片
+ */
+bool CheckPrecision(const std::vector<std::string> &image_paths,
+                    YuNet &yunet_fp32, YuNet &yunet_int8, SFace &sface_fp32,
+                    SFace &sface_int8, float cosine_threshold,
+                    PrecisionReport &report);
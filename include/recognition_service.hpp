@@ -0,0 +1,177 @@
+#pragma once
+// std
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// custom
+#include "detector.hpp"
+#include "enrollment.hpp"
+
+/**
+ * @brief 识别服务参数
+ *
+ */
+struct RecognitionOptions {
+    // 推理线程数（每个线程一个识别器），0表示使用所有核心；
+    // 不超过GalleryStore::kmax_readers
+    size_t thread_count = 0;
+    // 服务运行期间OpenCV全局的内部线程数（cv::setNumThreads），析构时恢复；
+    // 负数表示不修改。该设置影响整个进程
+    int cv_threads = -1;
+    // 一次批量推理最多包含几帧
+    size_t max_batch = 8;
+    // 每帧最多几张人脸
+    int top_k = 30;
+    // 检测前的缩放，结果仍为原图坐标
+    float scale = 1.f;
+};
+
+/**
+ * @brief 一帧的识别结果，与detectFace加matchTargetFace的结果相同
+ *
+ */
+struct RecognitionResult {
+    DetectResult detect_result;
+    // 与detect_result.faces逐行对应
+    MatchDataVec match_data_vec;
+    // 推理失败时为false，结果为空；非OpenCV异常通过future抛出
+    bool ok = true;
+};
+
+/**
+ * @brief 识别服务累计统计
+ *
+ */
+struct RecognitionStats {
+    size_t submitted = 0;
+    size_t completed = 0;
+    // 批量推理次数，completed/batches为平均批大小
+    size_t batches = 0;
+    // 从其他线程队列中窃取的帧
+    size_t stolen = 0;
+};
+
+/**
+ * @brief 线程安全的异步识别服务
+ * 每个推理线程持有一个识别器（各自的YuNet/SFace副本），共享同一个特征库，
+ * 任意线程都可以提交帧。提交的帧轮流放入各线程的队列，推理线程从自己
+ * 队列的队头取帧，自己的队列不满一批时从其他线程队列的队尾窃取；
+ * 取到的若干帧逐帧检测后一次批量提取特征（不额外等待凑批，负载高时
+ * 队列中自然积累多帧）。结果通过future、回调或co_await返回
+ * 析构时处理完所有已提交的帧再退出
+ *
+ */
+class RecognitionService {
+  public:
+    // 一帧识别完成，在推理线程中调用，不应阻塞
+    using ResultCallback = std::function<void(RecognitionResult)>;
+
+    /**
+     * @brief 构造并启动推理线程
+     *
+     * @param options 参数
+     * @param detector_factory 为每个推理线程创建识别器，应共享同一个特征库
+     */
+    RecognitionService(const RecognitionOptions &options,
+                       const DetectorFactory &detector_factory);
+    ~RecognitionService();
+    RecognitionService(const RecognitionService &) = delete;
+    RecognitionService &operator=(const RecognitionService &) = delete;
+
+    /**
+     * @brief 提交一帧
+     *
+     * @param frame 输入图像（BGR），不复制像素，结果返回前调用方不应修改
+     * @return std::future<RecognitionResult>
+     */
+    std::future<RecognitionResult> submit(cv::Mat frame);
+
+    /**
+     * @brief 提交一帧，完成后调用回调
+     *
+     * @param frame 输入图像
+     * @param on_result 回调，在推理线程中调用
+     */
+    void submit(cv::Mat frame, ResultCallback on_result);
+
+    /**
+     * @brief 供co_await使用的等待对象
+     * 协程在推理线程中恢复，恢复后的耗时工作应转到其他线程
+     *
+     */
+    class Awaiter {
+      public:
+        Awaiter(RecognitionService &service, cv::Mat frame)
+            : service_(service), frame_(std::move(frame)) {}
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        RecognitionResult await_resume() { return std::move(result_); }
+
+      private:
+        RecognitionService &service_;
+        cv::Mat frame_;
+        RecognitionResult result_;
+    };
+
+    /**
+     * @brief 提交一帧并在协程中等待结果：auto result = co_await
+     * service.recognize(frame);
+     *
+     * @param frame 输入图像
+     * @return Awaiter
+     */
+    Awaiter recognize(cv::Mat frame) { return {*this, std::move(frame)}; }
+
+    size_t threadCount() const { return workers_.size(); }
+
+    RecognitionStats stats() const;
+
+  private:
+    struct Task {
+        cv::Mat frame;
+        // 两者只用其一
+        std::promise<RecognitionResult> promise;
+        ResultCallback on_result;
+    };
+
+    struct Worker {
+        cv::Ptr<Detector> detector;
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+        // 复用的批量输入、检测结果和匹配缓冲
+        std::vector<Task> batch;
+        std::vector<cv::Mat> inputs;
+        std::vector<DetectResult> detect_results;
+        FrameContext context;
+    };
+
+    void push(Task task);
+    bool takeBatch(size_t index);
+    void runBatch(Worker &worker);
+    void workerLoop(size_t index);
+
+    RecognitionOptions options_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // 外部线程提交时的轮转位置
+    std::atomic<size_t> next_worker_{0};
+    // 所有队列中尚未取走的帧数，空闲线程在其上等待
+    std::atomic<size_t> pending_{0};
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    bool stopping_ = false;
+    int cv_threads_ = 0;
+
+    std::atomic<size_t> submitted_{0};
+    std::atomic<size_t> completed_{0};
+    std::atomic<size_t> batches_{0};
+    std::atomic<size_t> stolen_{0};
+};
@@ -0,0 +1,172 @@
+#pragma once
+// std
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+/**
+ * @brief 队列满时的处理策略
+ *
+ */
+enum BackpressurePolicy {
+    // 阻塞生产者，不丢帧，吞吐受最慢阶段限制
+    kbackpressure_block = 0,
+    // 丢弃最旧的元素，保证消费者总是拿到最新的数据
+    kbackpressure_drop_oldest = 1,
+};
+
+/**
+ * @brief 有界无锁单生产者单消费者队列
+ * 每个槽位带序号（Vyukov有界队列），头指针用CAS推进，
+ * 因此生产者在丢弃最旧元素时可以安全地与消费者竞争队头
+ * 等待使用C++20 atomic wait/notify，不使用互斥锁
+ *
+ * @tparam T 元素类型，需可默认构造和移动
+ */
+template <typename T> class SpscQueue {
+  public:
+    /**
+     * @brief 构造
+     *
+     * @param capacity 容量，向上取整为2的幂
+     */
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        capacity_ = size;
+        mask_ = size - 1;
+        slots_ = std::make_unique<Slot[]>(size);
+        for (size_t i = 0; i < size; ++i)
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 生产者放入元素
+     *
+     * @param item 元素
+     * @param policy 队列满时的处理策略
+     * @return true 成功
+     * @return false 队列已关闭
+     */
+    bool push(T &&item, BackpressurePolicy policy) {
+        const size_t pos = tail_.load(std::memory_order_relaxed);
+        Slot &slot = slots_[pos & mask_];
+        while (true) {
+            if (closed_.load(std::memory_order_acquire))
+                return false;
+            const auto event = event_.load(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_acquire) == pos)
+                break;
+            // 槽位仍被未消费的元素占用，队列已满
+            if (policy == kbackpressure_drop_oldest) {
+                T dropped_item;
+                if (tryPop(dropped_item))
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            event_.wait(event, std::memory_order_acquire);
+        }
+        slot.value = std::move(item);
+        slot.seq.store(pos + 1, std::memory_order_release);
+        tail_.store(pos + 1, std::memory_order_release);
+        notify();
+        return true;
+    }
+
+    /**
+     * @brief 消费者取出元素，队列为空时等待
+     *
+     * @param item 输出元素
+     * @return true 成功
+     * @return false 队列已关闭且为空
+     */
+    bool pop(T &item) {
+        while (true) {
+            const auto event = event_.load(std::memory_order_acquire);
+            if (tryPop(item))
+                return true;
+            if (closed_.load(std::memory_order_acquire))
+                return tryPop(item);
+            event_.wait(event, std::memory_order_acquire);
+        }
+    }
+
+    /**
+     * @brief 尝试取出元素，不等待
+     *
+     * @param item 输出元素
+     * @return true 成功
+     * @return false 队列为空
+     */
+    bool tryPop(T &item) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = slots_[pos & mask_];
+            const size_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq != pos + 1)
+                return false;
+            // 成功推进队头的一方独占该槽位
+            if (head_.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_relaxed)) {
+                item = std::move(slot.value);
+                slot.seq.store(pos + capacity_, std::memory_order_release);
+                notify();
+                return true;
+            }
+        }
+    }
+
+    /**
+     * @brief 关闭队列，唤醒所有等待者；已有元素仍可取出
+     *
+     */
+    void close() {
+        closed_.store(true, std::memory_order_release);
+        notify();
+    }
+
+    /**
+     * @brief 因丢弃策略丢掉的元素个数
+     *
+     * @return size_t
+     */
+    size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 当前元素个数（近似值）
+     *
+     * @return size_t
+     */
+    size_t size() const {
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        const size_t head = head_.load(std::memory_order_acquire);
+        return tail >= head ? tail - head : 0;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+  private:
+    struct Slot {
+        std::atomic<size_t> seq{0};
+        T value{};
+    };
+
+    void notify() {
+        event_.fetch_add(1, std::memory_order_release);
+        event_.notify_all();
+    }
+
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<uint32_t> event_{0};
+    std::atomic<bool> closed_{false};
+    std::atomic<size_t> dropped_{0};
+};
@@ -0,0 +1,174 @@
+#pragma once
+// std
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// custom
+#include "detector.hpp"
+#include "face_tracker.hpp"
+#include "motion_gate.hpp"
+#include "pipeline.hpp"
+#include "spsc_queue.hpp"
+
+/**
+ * @brief 多路视频服务配置
+ *
+ */
+struct StreamServerOptions {
+    // 每路视频的帧队列容量
+    size_t queue_capacity = 4;
+    // 队列满时的处理策略，摄像头一般丢弃最旧的帧
+    BackpressurePolicy backpressure = kbackpressure_drop_oldest;
+    // 一次批量推理最多包含几路视频的帧，每路最多一帧
+    size_t batch_size = 8;
+    // 每张图像最多几张人脸
+    int top_k = 30;
+    // 是否跟踪人脸，每路视频一个跟踪器
+    bool tracking = true;
+    TrackParams track_params;
+    // 运动门控，每路视频一个
+    MotionParams motion_params;
+};
+
+/**
+ * @brief 单路视频的统计
+ *
+ */
+struct StreamStats {
+    std::string name;
+    size_t frames = 0;
+    // 第一帧到最后一帧处理完成之间的平均帧率
+    double fps = 0.0;
+    // 采集到识别完成的延迟
+    double avg_latency_ms = 0.0;
+    double max_latency_ms = 0.0;
+    size_t dropped = 0;
+    // 画面静止而跳过检测的帧
+    size_t motion_skipped = 0;
+    bool finished = false;
+};
+
+/**
+ * @brief 多路视频识别服务
+ * 每路视频一个采集线程，所有视频共享一组识别器（每个识别器一个推理线程）
+ * 和同一个特征库。推理线程从上次的位置开始轮询各路视频，每路最多取一帧
+ * 组成一批，YuNet逐张检测，SFace对整批人脸一次前向
+ * 启用运动门控时，画面静止的帧不进入批次，沿用跟踪预测或上次结果
+ * 同一路视频同一时刻只被一个推理线程处理，保证帧序和跟踪器不被并发访问
+ *
+ */
+class StreamServer {
+  public:
+    // 读取一帧，返回false表示该路视频结束
+    using CaptureFunc = std::function<bool(cv::Mat &)>;
+    // 一帧识别完成，在推理线程中调用；返回后帧交还采集线程复用，
+    // 需要保留的图像或结果应复制
+    using ResultFunc = std::function<void(size_t, PipelineFrame &)>;
+
+    /**
+     * @brief 构造
+     *
+     * @param options 配置
+     * @param detectors 识别器池，应共享同一个特征库索引
+     */
+    StreamServer(const StreamServerOptions &options,
+                 std::vector<cv::Ptr<Detector>> detectors);
+    ~StreamServer();
+    StreamServer(const StreamServer &) = delete;
+    StreamServer &operator=(const StreamServer &) = delete;
+
+    /**
+     * @brief 添加一路视频，必须在start()之前调用
+     *
+     * @param name 名字，用于统计输出
+     * @param capture 读取函数
+     * @return size_t 视频编号
+     */
+    size_t addStream(const std::string &name, CaptureFunc capture);
+
+    /**
+     * @brief 设置识别完成回调，必须在start()之前调用
+     *
+     * @param on_result 回调
+     */
+    void setResultCallback(ResultFunc on_result) {
+        on_result_ = std::move(on_result);
+    }
+
+    /**
+     * @brief 启动所有采集和推理线程
+     *
+     */
+    void start();
+
+    /**
+     * @brief 所有视频都已结束且处理完毕
+     *
+     * @return true 已结束
+     */
+    bool finished() const;
+
+    /**
+     * @brief 停止并等待所有线程退出
+     *
+     */
+    void stop();
+
+    /**
+     * @brief 各路视频的统计
+     *
+     * @return std::vector<StreamStats>
+     */
+    std::vector<StreamStats> streamStats() const;
+
+  private:
+    using FrameQueue = SpscQueue<PipelineFrame>;
+
+    struct Stream {
+        size_t id = 0;
+        std::string name;
+        CaptureFunc capture;
+        std::unique_ptr<FrameQueue> queue;
+        // 处理完交还给采集线程的空闲帧，稳态下每帧不再分配内存
+        std::unique_ptr<FrameQueue> free_frames;
+        FaceTracker tracker;
+        // 运动门控和上次检测结果，只由持有该路视频的推理线程访问
+        MotionGate motion_gate;
+        cv::Mat last_faces;
+        // 未跟踪时跳过检测的帧沿用的上次匹配结果
+        MatchDataVec last_match_data_vec;
+        // 是否有推理线程正在处理该路视频
+        std::atomic<bool> busy{false};
+        std::atomic<bool> capture_done{false};
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> total_latency_ns{0};
+        std::atomic<uint64_t> max_latency_ns{0};
+        std::atomic<int64_t> first_done_ns{0};
+        std::atomic<int64_t> last_done_ns{0};
+    };
+
+    void runCapture(Stream &stream);
+    void runWorker(Detector &detector);
+    bool acquireBatch(std::vector<Stream *> &streams,
+                      std::vector<PipelineFrame> &frames);
+    void release(Stream &stream);
+    void record(Stream &stream, const PipelineFrame &frame);
+    bool streamFinished(const Stream &stream) const;
+    void notify();
+
+    StreamServerOptions options_;
+    std::vector<cv::Ptr<Detector>> detectors_;
+    std::vector<std::unique_ptr<Stream>> streams_;
+    ResultFunc on_result_;
+    std::vector<std::thread> threads_;
+    // 轮询起点，保证各路视频公平
+    std::atomic<size_t> cursor_{0};
+    // 有新帧或视频被释放时递增，推理线程在其上等待
+    std::atomic<uint32_t> event_{0};
+    std::atomic<bool> stop_{false};
+};
@@ -0,0 +1,125 @@
+#pragma once
+// std
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// custom
+#include "detector.hpp"
+
+/**
+ * @brief 分块检测参数
+ *
+ */
+struct TileOptions {
+    // 图块边长，即每个检测器的网络输入尺寸
+    int tile_size = 640;
+    // 相邻图块的重叠比例，边长不超过重叠宽度的人脸至少完整落在一个图块内
+    float overlap = 0.2f;
+    // 线程数（含调用线程），0表示使用所有核心
+    size_t thread_count = 0;
+    // 每帧最多检测的图块数，0表示全部
+    int max_tiles = 0;
+    // 粗检测缩放，大于0时先在缩小的全图上检测，找到大人脸并决定优先检测的图块
+    float coarse_scale = 0.f;
+    // 合并各图块结果时的NMS阈值
+    float nms_threshold = 0.3f;
+};
+
+using YuNetFactory = std::function<cv::Ptr<YuNet>()>;
+
+/**
+ * @brief 高分辨率图像的分块并行检测
+ * 图像切分为固定尺寸、互相重叠的图块，线程池中每个线程使用各自的YuNet
+ * 检测分到的图块，结果映射回原图坐标后跨图块NMS合并，格式与YuNet::infer相同；
+ * 限制每帧图块数时，粗检测命中的图块优先，其余图块轮流检测，
+ * 每帧的开销有上界，所有图块每隔若干帧都会被检测一次
+ *
+ */
+class TiledDetector {
+  public:
+    /**
+     * @brief 创建线程池和每个线程的检测器
+     *
+     * @param options 参数
+     * @param yunet_factory 创建互相独立的检测器
+     */
+    TiledDetector(const TileOptions &options,
+                  const YuNetFactory &yunet_factory);
+    ~TiledDetector();
+    TiledDetector(const TiledDetector &) = delete;
+    TiledDetector &operator=(const TiledDetector &) = delete;
+
+    /**
+     * @brief 图像是否大于一个图块，不大于时直接整图检测即可
+     *
+     * @param size 图像尺寸
+     * @return true 需要分块
+     */
+    bool covers(const cv::Size &size) const {
+        return size.width > options_.tile_size ||
+               size.height > options_.tile_size;
+    }
+
+    /**
+     * @brief 分块检测，同一时刻只应由一个线程调用
+     *
+     * @param image 输入图像
+     * @param top_k 最多几张人脸
+     * @param faces 输出检测到的所有人脸位置（原图坐标），按置信度从高到低，
+     * 复用内存
+     */
+    void detect(const cv::Mat &image, int top_k, cv::Mat &faces);
+
+    size_t threadCount() const { return yunets_.size(); }
+
+    /**
+     * @brief 当前图像尺寸下的图块总数
+     *
+     * @return size_t
+     */
+    size_t tileCount() const { return tiles_.size(); }
+
+  private:
+    void layoutTiles(const cv::Size &size);
+    void coarseDetect(const cv::Mat &image, int top_k);
+    void selectTiles();
+    void runTiles(size_t worker);
+    void workerLoop(size_t worker);
+    void mergeFaces(int top_k, cv::Mat &faces);
+
+    TileOptions options_;
+    // 第0个由调用线程使用，同时负责粗检测
+    std::vector<cv::Ptr<YuNet>> yunets_;
+    std::vector<std::thread> threads_;
+
+    // 当前图像尺寸下的所有图块
+    cv::Size image_size_;
+    std::vector<cv::Rect> tiles_;
+    // 本帧检测的图块及其结果，下标一一对应
+    std::vector<size_t> selected_;
+    std::vector<cv::Mat> tile_faces_;
+    // 轮流检测的下一个图块
+    size_t cursor_ = 0;
+    // 粗检测
+    cv::Mat coarse_input_;
+    cv::Mat coarse_faces_;
+    // 合并缓冲
+    std::vector<bool> tile_hit_;
+    std::vector<const float *> candidates_;
+    std::vector<int> kept_;
+
+    // 本帧的任务，由generation_通知工作线程
+    const cv::Mat *image_ = nullptr;
+    int top_k_ = 0;
+    std::atomic<size_t> next_tile_{0};
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    size_t generation_ = 0;
+    size_t active_ = 0;
+    bool stopping_ = false;
+};
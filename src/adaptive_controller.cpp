@@ -0,0 +1,88 @@
+#include "adaptive_controller.hpp"
+
+// std
+#include <algorithm>
+
+void AdaptiveController::setParams(const AdaptiveParams &params) {
+    std::lock_guard lock(mutex_);
+    params_ = params;
+    params_.max_scale = std::max(params_.max_scale, params_.min_scale);
+    params_.max_skip = std::max(params_.max_skip, 1);
+    params_.adjust_interval = std::max(params_.adjust_interval, 1);
+    if (!params_.enabled) {
+        scale_ = 1.f;
+        skip_ = 1;
+        return;
+    }
+    scale_ = std::clamp(scale_, params_.min_scale, params_.max_scale);
+    skip_ = std::clamp(skip_, 1, params_.max_skip);
+}
+
+AdaptiveDecision AdaptiveController::decide() {
+    std::lock_guard lock(mutex_);
+    AdaptiveDecision decision;
+    decision.scale = scale_;
+    decision.skip = skip_;
+    if (first_frame_ || !params_.enabled || ++frames_since_detect_ >= skip_) {
+        first_frame_ = false;
+        frames_since_detect_ = 0;
+        decision.detect = true;
+    } else {
+        decision.detect = false;
+    }
+    return decision;
+}
+
+void AdaptiveController::report(const AdaptiveDecision &decision,
+                                double cost_ms, const cv::Mat &faces) {
+    std::lock_guard lock(mutex_);
+    // 跳过的帧几乎不耗时，平均值反映的是跳帧后的实际每帧开销
+    stats_.avg_cost_ms = stats_.detect_frames + stats_.skipped_frames == 0
+                             ? cost_ms
+                             : 0.9 * stats_.avg_cost_ms + 0.1 * cost_ms;
+    if (decision.detect) {
+        ++stats_.detect_frames;
+        small_face_ = false;
+        for (int i = 0; i < faces.rows; ++i)
+            if (faces.at<float>(i, 3) * decision.scale < params_.min_face_px)
+                small_face_ = true;
+    } else {
+        ++stats_.skipped_frames;
+    }
+    if (!params_.enabled || ++frames_since_adjust_ < params_.adjust_interval)
+        return;
+    frames_since_adjust_ = 0;
+    adjust();
+}
+
+void AdaptiveController::adjust() {
+    const double budget = params_.budget_ms;
+    const double cost = stats_.avg_cost_ms;
+    const float step = params_.scale_step;
+    // 小脸优先保证分辨率
+    if (small_face_ && scale_ < params_.max_scale) {
+        scale_ = std::min(scale_ + step, params_.max_scale);
+        ++stats_.small_face_raises;
+        return;
+    }
+    if (cost > budget) {
+        if (!small_face_ && scale_ - step >= params_.min_scale - 1e-6f)
+            scale_ = std::max(scale_ - step, params_.min_scale);
+        else if (skip_ < params_.max_skip)
+            ++skip_;
+    } else if (cost < budget * 0.7) {
+        if (skip_ > 1)
+            --skip_;
+        else if (scale_ < params_.max_scale)
+            scale_ = std::min(scale_ + step, params_.max_scale);
+    }
+}
+
+AdaptiveStats AdaptiveController::stats() const {
+    std::lock_guard lock(mutex_);
+    auto stats = stats_;
+    stats.scale = scale_;
+    stats.skip = skip_;
+    stats.budget_ms = params_.budget_ms;
+    return stats;
+}
@@ -0,0 +1,274 @@
+#include "align_crop.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+// opencv
+#include <opencv2/imgproc.hpp>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define ALIGN_X86 1
+#endif
+
+namespace {
+// SFace对齐模板：112×112图像上右眼、左眼、鼻尖、右嘴角、左嘴角的位置
+constexpr float kalign_template[5][2] = {{38.2946f, 51.6963f},
+                                         {73.5318f, 51.5014f},
+                                         {56.0252f, 71.7366f},
+                                         {41.5493f, 92.3655f},
+                                         {70.7299f, 92.2041f}};
+
+/**
+ * @brief 一次对齐裁剪的采样参数
+ *
+ */
+struct AlignSampler {
+    // 原图，BGR
+    const uint8_t *data;
+    size_t step;
+    int cols;
+    int rows;
+    // 对齐图像坐标映射到原图坐标的2×3矩阵
+    float inverse[6];
+    // 按原图通道顺序（BGR）：输出=像素×scale+bias，以及写入的平面
+    float scale;
+    float bias[3];
+    float *planes[3];
+};
+
+/**
+ * @brief 计算一个对齐像素，越界的邻点取0
+ *
+ * @param s 采样参数
+ * @param sx 原图x坐标
+ * @param sy 原图y坐标
+ * @param index 在输出平面中的位置
+ */
+void SamplePixel(const AlignSampler &s, float sx, float sy, int index) {
+    // 远离图像的坐标收到图像外2个像素以内，结果同样为0，同时避免转换溢出
+    sx = std::min(std::max(-2.f, sx), s.cols + 1.f);
+    sy = std::min(std::max(-2.f, sy), s.rows + 1.f);
+    const float fx = std::floor(sx);
+    const float fy = std::floor(sy);
+    const int x0 = static_cast<int>(fx);
+    const int y0 = static_cast<int>(fy);
+    const float wx = sx - fx;
+    const float wy = sy - fy;
+    float p[2][2][3] = {};
+    for (int dy = 0; dy < 2; ++dy) {
+        const int y = y0 + dy;
+        if (y < 0 || y >= s.rows)
+            continue;
+        for (int dx = 0; dx < 2; ++dx) {
+            const int x = x0 + dx;
+            if (x < 0 || x >= s.cols)
+                continue;
+            const uint8_t *pixel = s.data + y * s.step + x * 3;
+            for (int c = 0; c < 3; ++c)
+                p[dy][dx][c] = pixel[c];
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        const float top = p[0][0][c] + wx * (p[0][1][c] - p[0][0][c]);
+        const float bottom = p[1][0][c] + wx * (p[1][1][c] - p[1][0][c]);
+        const float value = top + wy * (bottom - top);
+        s.planes[c][index] = value * s.scale + s.bias[c];
+    }
+}
+
+/**
+ * @brief 计算对齐图像的一行
+ *
+ * @param s 采样参数
+ * @param y 行号
+ */
+using AlignRowFunc = void (*)(const AlignSampler &, int);
+
+void AlignRowScalar(const AlignSampler &s, int y) {
+    const float bx = s.inverse[1] * y + s.inverse[2];
+    const float by = s.inverse[4] * y + s.inverse[5];
+    for (int x = 0; x < kalign_size; ++x)
+        SamplePixel(s, s.inverse[0] * x + bx, s.inverse[3] * x + by,
+                    y * kalign_size + x);
+}
+
+#ifdef ALIGN_X86
+/**
+ * @brief 从gather得到的4字节中取出一个通道并转为浮点
+ *
+ */
+__attribute__((target("avx2"))) inline __m256 ByteChannel(__m256i pixels,
+                                                           __m128i shift) {
+    return _mm256_cvtepi32_ps(_mm256_and_si256(
+        _mm256_srl_epi32(pixels, shift), _mm256_set1_epi32(0xFF)));
+}
+
+__attribute__((target("avx2,fma"))) void AlignRowAvx2(const AlignSampler &s,
+                                                       int y) {
+    const float bx = s.inverse[1] * y + s.inverse[2];
+    const float by = s.inverse[4] * y + s.inverse[5];
+    const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 ax = _mm256_set1_ps(s.inverse[0]);
+    const __m256 ay = _mm256_set1_ps(s.inverse[3]);
+    const __m256 scale = _mm256_set1_ps(s.scale);
+    const __m256i minus_one = _mm256_set1_epi32(-1);
+    // 每个邻点gather 4个字节（BGR加下一个像素的B），右邻点不能是
+    // 每行最后一个像素，否则最后一行会读到图像之外
+    const __m256i x_limit = _mm256_set1_epi32(s.cols - 2);
+    const __m256i y_limit = _mm256_set1_epi32(s.rows - 1);
+    const __m256i pixel = _mm256_set1_epi32(3);
+    const __m256i step = _mm256_set1_epi32(static_cast<int>(s.step));
+    const __m256i step_pixel = _mm256_set1_epi32(static_cast<int>(s.step) + 3);
+    const auto *base = reinterpret_cast<const int *>(s.data);
+    for (int x = 0; x < kalign_size; x += 8) {
+        const __m256 xs = _mm256_add_ps(_mm256_set1_ps(x), lane);
+        const __m256 sx = _mm256_fmadd_ps(ax, xs, _mm256_set1_ps(bx));
+        const __m256 sy = _mm256_fmadd_ps(ay, xs, _mm256_set1_ps(by));
+        const __m256 fx = _mm256_floor_ps(sx);
+        const __m256 fy = _mm256_floor_ps(sy);
+        const __m256i x0 = _mm256_cvttps_epi32(fx);
+        const __m256i y0 = _mm256_cvttps_epi32(fy);
+        const __m256i inside = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi32(x0, minus_one),
+                             _mm256_cmpgt_epi32(x_limit, x0)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(y0, minus_one),
+                             _mm256_cmpgt_epi32(y_limit, y0)));
+        const int index = y * kalign_size + x;
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(inside)) != 0xFF) {
+            // 靠近边缘的8个像素逐个计算
+            alignas(32) float sxs[8], sys[8];
+            _mm256_store_ps(sxs, sx);
+            _mm256_store_ps(sys, sy);
+            for (int i = 0; i < 8; ++i)
+                SamplePixel(s, sxs[i], sys[i], index + i);
+            continue;
+        }
+        const __m256i offset = _mm256_add_epi32(
+            _mm256_mullo_epi32(y0, step), _mm256_mullo_epi32(x0, pixel));
+        const __m256i p00 = _mm256_i32gather_epi32(base, offset, 1);
+        const __m256i p01 =
+            _mm256_i32gather_epi32(base, _mm256_add_epi32(offset, pixel), 1);
+        const __m256i p10 =
+            _mm256_i32gather_epi32(base, _mm256_add_epi32(offset, step), 1);
+        const __m256i p11 = _mm256_i32gather_epi32(
+            base, _mm256_add_epi32(offset, step_pixel), 1);
+        const __m256 wx = _mm256_sub_ps(sx, fx);
+        const __m256 wy = _mm256_sub_ps(sy, fy);
+        for (int c = 0; c < 3; ++c) {
+            const __m128i shift = _mm_cvtsi32_si128(8 * c);
+            const __m256 c00 = ByteChannel(p00, shift);
+            const __m256 c01 = ByteChannel(p01, shift);
+            const __m256 c10 = ByteChannel(p10, shift);
+            const __m256 c11 = ByteChannel(p11, shift);
+            const __m256 top =
+                _mm256_fmadd_ps(wx, _mm256_sub_ps(c01, c00), c00);
+            const __m256 bottom =
+                _mm256_fmadd_ps(wx, _mm256_sub_ps(c11, c10), c10);
+            const __m256 value =
+                _mm256_fmadd_ps(wy, _mm256_sub_ps(bottom, top), top);
+            _mm256_storeu_ps(s.planes[c] + index,
+                             _mm256_fmadd_ps(value, scale,
+                                             _mm256_set1_ps(s.bias[c])));
+        }
+    }
+}
+#endif
+
+AlignRowFunc GetAlignRowFunc() {
+    static const AlignRowFunc func = [] {
+#ifdef ALIGN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return AlignRowAvx2;
+#endif
+        return AlignRowScalar;
+    }();
+    return func;
+}
+
+} // namespace
+
+void EstimateAlignTransform(const float *face, float transform[6]) {
+    // 第4~13列为5个关键点
+    float src_x = 0.f, src_y = 0.f, dst_x = 0.f, dst_y = 0.f;
+    for (int i = 0; i < 5; ++i) {
+        src_x += face[4 + 2 * i];
+        src_y += face[5 + 2 * i];
+        dst_x += kalign_template[i][0];
+        dst_y += kalign_template[i][1];
+    }
+    src_x /= 5;
+    src_y /= 5;
+    dst_x /= 5;
+    dst_y /= 5;
+    // 去中心后，旋转缩放[a -b; b a]的最小二乘解为点积和叉积之和除以原点方差
+    float dot = 0.f, cross = 0.f, norm = 0.f;
+    for (int i = 0; i < 5; ++i) {
+        const float px = face[4 + 2 * i] - src_x;
+        const float py = face[5 + 2 * i] - src_y;
+        const float qx = kalign_template[i][0] - dst_x;
+        const float qy = kalign_template[i][1] - dst_y;
+        dot += px * qx + py * qy;
+        cross += px * qy - py * qx;
+        norm += px * px + py * py;
+    }
+    const float a = norm > 1e-6f ? dot / norm : 1.f;
+    const float b = norm > 1e-6f ? cross / norm : 0.f;
+    transform[0] = a;
+    transform[1] = -b;
+    transform[2] = dst_x - (a * src_x - b * src_y);
+    transform[3] = b;
+    transform[4] = a;
+    transform[5] = dst_y - (b * src_x + a * src_y);
+    return;
+}
+
+void AlignCropToBlob(const cv::Mat &image, const float *face,
+                     const BlobNormalization &norm, float *blob) {
+    const cv::Mat *source = &image;
+    static thread_local cv::Mat converted;
+    if (image.type() == CV_8UC1) {
+        cv::cvtColor(image, converted, cv::COLOR_GRAY2BGR);
+        source = &converted;
+    } else if (image.type() == CV_8UC4) {
+        cv::cvtColor(image, converted, cv::COLOR_BGRA2BGR);
+        source = &converted;
+    } else if (image.type() != CV_8UC3) {
+        std::cerr << "[AlignCropToBlob]:不支持的图像格式\n";
+        std::fill_n(blob, 3 * kalign_size * kalign_size, 0.f);
+        return;
+    }
+
+    AlignSampler s;
+    s.data = source->data;
+    s.step = source->step;
+    s.cols = source->cols;
+    s.rows = source->rows;
+    // 相似变换[A t]的逆为[A^-1 -A^-1·t]，A^-1=[a b; -b a]/(a²+b²)
+    float m[6];
+    EstimateAlignTransform(face, m);
+    const float det = std::max(m[0] * m[0] + m[3] * m[3], 1e-12f);
+    s.inverse[0] = m[0] / det;
+    s.inverse[1] = m[3] / det;
+    s.inverse[3] = -m[3] / det;
+    s.inverse[4] = m[0] / det;
+    s.inverse[2] = -(s.inverse[0] * m[2] + s.inverse[1] * m[5]);
+    s.inverse[5] = -(s.inverse[3] * m[2] + s.inverse[4] * m[5]);
+    s.scale = static_cast<float>(norm.scale);
+    const int plane = kalign_size * kalign_size;
+    for (int c = 0; c < 3; ++c) {
+        // 原图第c通道写入的输出通道，均值按输出通道取
+        const int out = norm.swap_rb ? 2 - c : c;
+        s.bias[c] = static_cast<float>(-norm.mean[out] * norm.scale);
+        s.planes[c] = blob + out * plane;
+    }
+
+    const auto align_row = GetAlignRowFunc();
+    for (int y = 0; y < kalign_size; ++y)
+        align_row(s, y);
+    return;
+}
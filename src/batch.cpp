@@ -0,0 +1,332 @@
+#include "batch.hpp"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+// opencv
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+namespace {
+/**
+ * @brief 输入中连续的一段帧[begin, end)
+ *
+ */
+struct Chunk {
+    int begin = 0;
+    int end = 0;
+};
+
+/**
+ * @brief 按段序写出各段结果，当前段的结果直接写出，之后的段暂存到之前的段
+ * 都写完为止
+ *
+ */
+class OrderedWriter {
+  public:
+    explicit OrderedWriter(std::ofstream &file) : file_(file) {}
+
+    /**
+     * @brief 写出某段的一部分结果
+     *
+     * @param chunk_index 段序号
+     * @param text 结果
+     * @param last 是否为该段的最后一部分
+     */
+    void write(size_t chunk_index, std::string &&text, bool last = true) {
+        std::lock_guard lock(mutex_);
+        auto &chunk = pending_[chunk_index];
+        if (chunk.text.empty())
+            chunk.text = std::move(text);
+        else
+            chunk.text += text;
+        chunk.done = last;
+        while (!pending_.empty() && pending_.begin()->first == next_index_) {
+            auto &front = pending_.begin()->second;
+            file_ << front.text;
+            front.text.clear();
+            if (!front.done)
+                break;
+            pending_.erase(pending_.begin());
+            ++next_index_;
+        }
+        return;
+    }
+
+  private:
+    struct PendingChunk {
+        std::string text;
+        bool done = false;
+    };
+
+    std::ofstream &file_;
+    std::mutex mutex_;
+    std::map<size_t, PendingChunk> pending_;
+    size_t next_index_ = 0;
+};
+
+void AppendJsonString(std::string &text, std::string_view value) {
+    text += '"';
+    for (const char c : value) {
+        if (c == '"' || c == '\\') {
+            text += '\\';
+            text += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            text += escaped;
+        } else {
+            text += c;
+        }
+    }
+    text += '"';
+}
+
+/**
+ * @brief 追加一帧的结果
+ *
+ * @param text 输出
+ * @param frame_index 帧序号
+ * @param time 时间戳（秒），file非空时不输出
+ * @param file 图片路径，视频为空
+ * @param context 识别结果
+ */
+void AppendFrame(std::string &text, int frame_index, double time,
+                 const std::string *file, const FrameContext &context) {
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "{\"frame\":%d", frame_index);
+    text += buffer;
+    if (file != nullptr) {
+        text += ",\"file\":";
+        AppendJsonString(text, *file);
+    } else {
+        std::snprintf(buffer, sizeof(buffer), ",\"time\":%.3f", time);
+        text += buffer;
+    }
+    text += ",\"faces\":[";
+    const auto &faces = context.detect_result.faces;
+    for (int r = 0; r < faces.rows; ++r) {
+        const float *face = faces.ptr<float>(r);
+        const auto &match_data = context.match_data_vec[r];
+        std::snprintf(buffer, sizeof(buffer),
+                      "%s{\"box\":[%.1f,%.1f,%.1f,%.1f],\"landmarks\":[",
+                      r > 0 ? "," : "", face[0], face[1], face[2], face[3]);
+        text += buffer;
+        for (int c = 4; c < 14; c += 2) {
+            std::snprintf(buffer, sizeof(buffer), "%s[%.1f,%.1f]",
+                          c > 4 ? "," : "", face[c], face[c + 1]);
+            text += buffer;
+        }
+        std::snprintf(buffer, sizeof(buffer), "],\"score\":%.4f,\"name\":",
+                      face[14]);
+        text += buffer;
+        AppendJsonString(text, match_data.name);
+        std::snprintf(buffer, sizeof(buffer), ",\"conf\":%.4f,\"match\":%s",
+                      match_data.conf, match_data.match ? "true" : "false");
+        text += buffer;
+        // 质量不合格没有识别的人脸注明原因
+        if (match_data.quality.reason != kquality_ok) {
+            text += ",\"quality\":";
+            AppendJsonString(text,
+                             QualityReasonName(match_data.quality.reason));
+        }
+        text += "}";
+    }
+    text += "]}\n";
+    return;
+}
+
+/**
+ * @brief 视频能否精确定位到任意帧
+ * 部分后端只能定位到关键帧，此时只能从头顺序解码
+ *
+ * @param source 视频路径
+ * @param total 总帧数
+ * @return true 定位到中间一帧后位置正确
+ */
+bool SeeksExactly(const std::string &source, int total) {
+    cv::VideoCapture capture(source);
+    const int middle = total / 2;
+    return capture.isOpened() && capture.set(cv::CAP_PROP_POS_FRAMES, middle) &&
+           static_cast<int>(capture.get(cv::CAP_PROP_POS_FRAMES)) == middle;
+}
+
+/**
+ * @brief 打开视频并定位到某一帧
+ *
+ * @param capture 视频
+ * @param source 视频路径
+ * @param begin 帧序号
+ * @return true 成功
+ * @return false 打开失败或无法精确定位
+ */
+bool OpenChunk(cv::VideoCapture &capture, const std::string &source,
+               int begin) {
+    if (!capture.open(source))
+        return false;
+    if (begin == 0)
+        return true;
+    return capture.set(cv::CAP_PROP_POS_FRAMES, begin) &&
+           static_cast<int>(capture.get(cv::CAP_PROP_POS_FRAMES)) == begin;
+}
+} // namespace
+
+bool ProcessBatch(const std::string &source, const std::string &output_path,
+                  cv::Ptr<Detector> detector_ptr,
+                  const DetectorFactory &detector_factory,
+                  const BatchOptions &options, BatchStats &stats) {
+    stats = BatchStats();
+    const auto begin_time = std::chrono::steady_clock::now();
+
+    // 图片文件夹按文件名排序，视频读取总帧数
+    const bool is_dir = std::filesystem::is_directory(source);
+    std::vector<std::string> image_paths;
+    int total = 0;
+    double fps = 0.0;
+    if (is_dir) {
+        cv::glob(source, image_paths, false);
+        total = static_cast<int>(image_paths.size());
+    } else {
+        cv::VideoCapture capture(source);
+        if (!capture.isOpened()) {
+            std::cerr << "[ProcessBatch]:打开<" << source << ">失败\n";
+            return false;
+        }
+        total = static_cast<int>(capture.get(cv::CAP_PROP_FRAME_COUNT));
+        fps = capture.get(cv::CAP_PROP_FPS);
+    }
+    std::ofstream file(output_path, std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "[ProcessBatch]:打开<" << output_path << ">失败\n";
+        return false;
+    }
+
+    size_t thread_count = options.thread_count;
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    // 视频每段都要重新打开和定位，段数与线程数相当；图片分得更细以均衡负载
+    // 总帧数未知（部分流格式）或无法精确定位时整个视频作为一段顺序处理，
+    // 避免每段都从头解码
+    std::vector<Chunk> chunks;
+    const bool unknown_total = !is_dir && total <= 0;
+    if (unknown_total) {
+        chunks.push_back({0, INT_MAX});
+    } else if (!is_dir && !SeeksExactly(source, total)) {
+        std::cout << "[ProcessBatch]:<" << source
+                  << ">无法精确定位，顺序处理\n";
+        chunks.push_back({0, total});
+    } else {
+        const auto parts = is_dir ? thread_count * 4 : thread_count;
+        const int chunk_size = std::clamp(
+            static_cast<int>((total + parts - 1) / parts), 1,
+            std::max(options.chunk_frames, 1));
+        for (int begin = 0; begin < total; begin += chunk_size)
+            chunks.push_back({begin, std::min(begin + chunk_size, total)});
+    }
+    stats.chunks = chunks.size();
+    thread_count = std::clamp<size_t>(
+        std::min(thread_count, chunks.size()), 1, GalleryStore::kmax_readers);
+
+    const int cv_threads = cv::getNumThreads();
+    if (options.cv_threads >= 0)
+        cv::setNumThreads(options.cv_threads);
+
+    OrderedWriter writer(file);
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<size_t> frames{0}, faces{0}, failed{0};
+    auto worker = [&](cv::Ptr<Detector> worker_detector) {
+        // 同一线程内逐帧复用缓冲
+        FrameContext context;
+        cv::VideoCapture capture;
+        cv::Mat image;
+        size_t index;
+        while ((index = next_chunk.fetch_add(1)) < chunks.size()) {
+            const auto &chunk = chunks[index];
+            std::string text;
+            int chunk_done = 0;
+            if (!is_dir && !OpenChunk(capture, source, chunk.begin)) {
+                std::cerr << "[ProcessBatch]:<" << source << ">定位到第"
+                          << chunk.begin << "帧失败\n";
+                if (!unknown_total)
+                    failed += chunk.end - chunk.begin;
+                writer.write(index, std::move(text));
+                continue;
+            }
+            for (int frame_index = chunk.begin; frame_index < chunk.end;
+                 ++frame_index) {
+                if (is_dir) {
+                    image = cv::imread(image_paths[frame_index]);
+                } else if (!capture.read(image)) {
+                    // 实际帧数可能少于容器中记录的帧数
+                    if (!unknown_total)
+                        failed += chunk.end - frame_index;
+                    break;
+                }
+                if (image.empty()) {
+                    ++failed;
+                    continue;
+                }
+                try {
+                    worker_detector->detectFace(image, options.top_k,
+                                                options.scale,
+                                                context.detect_result);
+                    worker_detector->matchTargetFace(context.detect_result,
+                                                     context);
+                } catch (const cv::Exception &e) {
+                    std::cerr << "[ProcessBatch]:第" << frame_index
+                              << "帧推理失败:" << e.what() << "\n";
+                    ++failed;
+                    continue;
+                }
+                const double time =
+                    fps > 0.0 ? frame_index / fps
+                              : capture.get(cv::CAP_PROP_POS_MSEC) / 1000.0;
+                AppendFrame(text, frame_index, time,
+                            is_dir ? &image_paths[frame_index] : nullptr,
+                            context);
+                ++frames;
+                faces += context.detect_result.faces.rows;
+                // 顺序处理整个视频时段很长，每chunk_frames帧写出一次，
+                // 不在内存中累积全部结果
+                if (++chunk_done % std::max(options.chunk_frames, 1) == 0) {
+                    writer.write(index, std::move(text), false);
+                    text.clear();
+                }
+            }
+            writer.write(index, std::move(text));
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; ++i)
+        threads.emplace_back(worker, detector_factory());
+    worker(detector_ptr);
+    for (auto &thread : threads)
+        thread.join();
+    if (options.cv_threads >= 0)
+        cv::setNumThreads(cv_threads);
+
+    file.close();
+    stats.frames = frames;
+    stats.faces = faces;
+    stats.failed = failed;
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - begin_time)
+                        .count();
+    if (!file) {
+        std::cerr << "[ProcessBatch]:写入<" << output_path << ">失败\n";
+        return false;
+    }
+    return true;
+}
@@ -24,10 +24,20 @@ void ReadBool(const cv::FileNode &node, bool &value,
 }
 } // namespace cv
 
+namespace {
+template <typename T>
+void ReadField(const cv::FileStorage &fs, const char *name, T &value) {
+    const auto node = fs[name];
+    if (!node.empty())
+        node >> value;
+}
+} // namespace
+
 void ConfigReader::setConfigPath(std::string dir_path) {
     if (std::filesystem::exists(dir_path)) {
         if (std::filesystem::is_directory(dir_path)) {
             config_path_ = dir_path;
+            reload();
             std::cout << "[readconfig->setConfigPath]:"
                          "设置路径<"
                       << dir_path << ">成功\n";
@@ -40,3 +50,33 @@ void ConfigReader::setConfigPath(std::string dir_path) {
                   << ">貌似不存在\n";
     }
 }
+
+bool ConfigReader::reload() {
+    auto file_path = config_path_ + kconfig_name;
+    if (!std::filesystem::exists(file_path)) {
+        std::cerr << "[ConfigReader->reload]:<" << file_path
+                  << ">貌似不存在\n";
+        return false;
+    }
+    auto snapshot = std::make_shared<ConfigSnapshot>();
+    try {
+        cv::FileStorage fs(file_path, cv::FileStorage::READ);
+        if (!fs.isOpened()) {
+            std::cerr << "[ConfigReader->reload]:"
+                      << "打开<" << file_path
+                      << ">文件失败，请检查文件格式，如是否在开头指定版本等\n";
+            return false;
+        }
+#define CONFIG_FIELD_READ(type, name, default_value)                           \
+    ReadField(fs, #name, snapshot->name);
+        CONFIG_FIELDS(CONFIG_FIELD_READ)
+#undef CONFIG_FIELD_READ
+    } catch (const cv::Exception &e) {
+        // 编辑器保存时可能读到写了一半的文件，保留原快照等待下一次修改
+        std::cerr << "[ConfigReader->reload]:解析<" << file_path
+                  << ">失败:" << e.what() << "\n";
+        return false;
+    }
+    snapshot_.store(std::move(snapshot), std::memory_order_release);
+    return true;
+}
@@ -1,18 +1,111 @@
 #include "detector.hpp"
 
+// std
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+// custom
+#include "metrics.hpp"
+#include "tiled_detector.hpp"
+
 void YuNet::setInputSize(const cv::Size &input_size) {
-    detector_->setInputSize(input_size);
+    if (!detectors_.empty() && detectors_.front().input_size == input_size)
+        return;
+    auto it = std::find_if(detectors_.begin(), detectors_.end(),
+                           [&input_size](const CachedDetector &cached) {
+                               return cached.input_size == input_size;
+                           });
+    if (it != detectors_.end()) {
+        detectors_.splice(detectors_.begin(), detectors_, it);
+    } else if (detectors_.size() >= kinput_cache_capacity) {
+        // 缓存已满时重新配置最久未使用的检测器，模型已在内存中
+        detectors_.splice(detectors_.begin(), detectors_,
+                          std::prev(detectors_.end()));
+        auto &recycled = detectors_.front();
+        recycled.detector->setInputSize(input_size);
+        recycled.input_size = input_size;
+    } else {
+        const auto detector =
+            model_buffer_ != nullptr
+                ? cv::FaceDetectorYN::create(
+                      "onnx", *model_buffer_, std::vector<uchar>(),
+                      input_size, conf_threshold_, nms_threshold_, top_k_,
+                      backend_id_, target_id_)
+                : cv::FaceDetectorYN::create(model_path_, "", input_size,
+                                             conf_threshold_, nms_threshold_,
+                                             top_k_, backend_id_, target_id_);
+        detectors_.push_front({input_size, top_k_, detector});
+    }
+    setTopK(top_k_);
     return;
 }
+
+std::shared_ptr<const std::vector<uchar>>
+YuNet::ReadModel(const std::string &model_path) {
+    std::ifstream file(model_path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "[YuNet->ReadModel]:无法读取模型" << model_path << "\n";
+        return nullptr;
+    }
+    return std::make_shared<const std::vector<uchar>>(
+        std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
 void YuNet::setTopK(const int top_k) {
-    detector_->setTopK(top_k);
+    top_k_ = top_k;
+    auto &current = detectors_.front();
+    if (current.top_k != top_k) {
+        current.detector->setTopK(top_k);
+        current.top_k = top_k;
+    }
+    return;
+}
+
+void YuNet::infer(const cv::Mat &image, cv::Mat &faces) {
+    MetricTimer timer(kmetric_yunet);
+    // 没有检测到人脸时不会写入输出
+    if (detectors_.front().detector->detect(image, faces) == 0 ||
+        faces.empty())
+        faces.create(0, 15, CV_32F);
     return;
 }
 
-cv::Mat YuNet::infer(const cv::Mat &image) {
-    cv::Mat result;
-    detector_->detect(image, result);
-    return result;
+cv::Mat YuNet::inferLetterbox(const cv::Mat &image,
+                              const cv::Size &canonical_size) {
+    const float scale =
+        std::min(static_cast<float>(canonical_size.width) / image.cols,
+                 static_cast<float>(canonical_size.height) / image.rows);
+    const cv::Size scaled_size(
+        std::max(static_cast<int>(image.cols * scale + 0.5f), 1),
+        std::max(static_cast<int>(image.rows * scale + 0.5f), 1));
+    const int dx = (canonical_size.width - scaled_size.width) / 2;
+    const int dy = (canonical_size.height - scaled_size.height) / 2;
+    letterbox_.create(canonical_size, image.type());
+    letterbox_.setTo(cv::Scalar::all(0));
+    cv::Mat roi = letterbox_(cv::Rect(cv::Point(dx, dy), scaled_size));
+    {
+        MetricTimer timer(kmetric_letterbox);
+        cv::resize(image, roi, scaled_size);
+    }
+
+    setInputSize(canonical_size);
+    cv::Mat faces;
+    infer(letterbox_, faces);
+    // 第0~3列为人脸框x,y,w,h，第4~13列为5个关键点，第14列为置信度
+    for (int r = 0; r < faces.rows; ++r) {
+        float *face = faces.ptr<float>(r);
+        face[0] = (face[0] - dx) / scale;
+        face[1] = (face[1] - dy) / scale;
+        face[2] /= scale;
+        face[3] /= scale;
+        for (int c = 4; c < 14; c += 2) {
+            face[c] = (face[c] - dx) / scale;
+            face[c + 1] = (face[c + 1] - dy) / scale;
+        }
+    }
+    return faces;
 }
 
 void SFace::setThresholdCosine(float cosine_threshold) {
@@ -25,78 +118,527 @@ void SFace::setThresholdNorml2(float norml2_threshold) {
     return;
 }
 
-cv::Mat SFace::extractFeatures(const cv::Mat &orig_image,
-                               const cv::Mat &face_image) {
-    // Align and crop detected face from original image
-    cv::Mat target_aligned;
-    recognizer_->alignCrop(orig_image, face_image, target_aligned);
-    // Extract features from cropped detected face
-    cv::Mat target_features;
-    recognizer_->feature(target_aligned, target_features);
-    return target_features.clone();
+void SFace::extractFeatures(const cv::Mat &orig_image,
+                            const cv::Mat &face_image, cv::Mat &features) {
+    extractFeaturesBatch(orig_image, face_image, features);
+    return;
+}
+
+void SFace::extractFeaturesBatch(const cv::Mat &orig_image,
+                                 const cv::Mat &faces, cv::Mat &features) {
+    static thread_local std::vector<cv::Mat> orig_images(1), faces_vec(1);
+    orig_images[0] = orig_image;
+    faces_vec[0] = faces;
+    extractFeaturesBatch(orig_images, faces_vec, features);
+    orig_images[0].release();
+    faces_vec[0].release();
+    return;
+}
+
+void SFace::extractFeaturesBatch(const std::vector<cv::Mat> &orig_images,
+                                 const std::vector<cv::Mat> &faces_vec,
+                                 cv::Mat &features) {
+    int total = 0;
+    for (const auto &faces : faces_vec)
+        total += faces.rows;
+    features.create(total, kfeature_dim, CV_32F);
+    if (total == 0)
+        return;
+
+    // 对齐裁剪直接写入NCHW输入，SFace的输入为RGB、不减均值不缩放
+    const int blob_shape[] = {total, 3, kcrop_size, kcrop_size};
+    blob_.create(4, blob_shape, CV_32F);
+    {
+        MetricTimer timer(kmetric_align_crop);
+        const BlobNormalization norm;
+        int k = 0;
+        for (size_t i = 0; i < faces_vec.size(); ++i)
+            for (int r = 0; r < faces_vec[i].rows; ++r)
+                AlignCropToBlob(orig_images[i], faces_vec[i].ptr<float>(r),
+                                norm, blob_.ptr<float>(k++));
+    }
+
+    MetricTimer timer(kmetric_sface);
+    if (batch_forward_) {
+        try {
+            net_.setInput(blob_);
+            net_.forward(output_);
+            if (output_.total() ==
+                static_cast<size_t>(total) * kfeature_dim) {
+                output_.reshape(1, total).copyTo(features);
+                return;
+            }
+        } catch (const cv::Exception &e) {
+            std::cerr << "[SFace->extractFeaturesBatch]:" << e.what() << "\n";
+        }
+        std::cerr << "[SFace->extractFeaturesBatch]:"
+                     "模型不支持批量输入，改为逐张计算\n";
+        batch_forward_ = false;
+    }
+    // 逐张前向时直接使用批量输入中的每一张
+    const int face_shape[] = {1, 3, kcrop_size, kcrop_size};
+    for (int k = 0; k < total; ++k) {
+        net_.setInput(cv::Mat(4, face_shape, CV_32F, blob_.ptr<float>(k)));
+        net_.forward(output_);
+        cv::Mat feature = features.row(k);
+        output_.reshape(1, 1).copyTo(feature);
+    }
+    return;
 }
 
 std::pair<double, bool> SFace::matchFeatures(const cv::Mat &target_features,
                                              const cv::Mat &query_features) {
+    // 与FaceRecognizerSF::match相同：两个特征各自归一化后求余弦或L2距离
+    cv::Mat target, query;
+    cv::normalize(target_features.reshape(1, 1), target);
+    cv::normalize(query_features.reshape(1, 1), query);
     const double score =
-        recognizer_->match(target_features, query_features, distance_type_);
-    if (distance_type_ == cv::FaceRecognizerSF::DisType::FR_COSINE) {
-        return {score, score >= threshold_cosine_};
-    }
-    return {score, score <= threshold_norml2_};
+        distance_type_ == cv::FaceRecognizerSF::DisType::FR_COSINE
+            ? target.dot(query)
+            : cv::norm(target, query);
+    return {score, isMatched(score)};
+}
+
+bool SFace::isMatched(double score) const {
+    if (distance_type_ == cv::FaceRecognizerSF::DisType::FR_COSINE)
+        return score >= threshold_cosine_;
+    return score <= threshold_norml2_;
+}
+
+void SFace::setMatchMargin(float match_margin) {
+    match_margin_ = match_margin;
+    return;
+}
+
+bool SFace::isDistinct(double best_score, double second_score) const {
+    // 余弦越大越好，L2距离越小越好
+    const double margin =
+        distance_type_ == cv::FaceRecognizerSF::DisType::FR_COSINE
+            ? best_score - second_score
+            : second_score - best_score;
+    return margin >= match_margin_;
+}
+
+void Detector::setGalleryIndex(cv::Ptr<GalleryIndex> index_ptr) {
+    store_ptr_ = cv::makePtr<GalleryStore>(index_ptr);
+    return;
 }
 
 // 添加目标特征值
+// 增删目标都在当前版本之上的叠加层进行，完成后发布，匹配不受影响
 void Detector::addTargetData(const TargetData &new_target_data) {
-    target_data_vec_.push_back(new_target_data);
+    store_ptr_->update([&new_target_data](GalleryIndex &index) {
+        index.add(new_target_data.name, new_target_data.feature);
+    });
     return;
 }
 
 // 批量添加目标特征值
 void Detector::addTargetDatas(const TargetDataVec &new_target_data_vec) {
-    for (auto new_target_data : new_target_data_vec)
-        target_data_vec_.push_back(new_target_data);
+    store_ptr_->update([&new_target_data_vec](GalleryIndex &index) {
+        index.reserve(index.size() + new_target_data_vec.size());
+        for (const auto &new_target_data : new_target_data_vec)
+            index.add(new_target_data.name, new_target_data.feature);
+    });
     return;
 }
 
 void Detector::clearTargetDatas() {
-    target_data_vec_.clear();
+    store_ptr_->publish(store_ptr_->create());
     return;
 }
 
+size_t Detector::removeTargetData(const std::string &name) {
+    size_t removed = 0;
+    store_ptr_->update([&name, &removed](GalleryIndex &index) {
+        removed = index.remove(name);
+    });
+    return removed;
+}
+
+bool Detector::loadGallery(const std::string &file_path, uint64_t model_hash) {
+    auto index_ptr = store_ptr_->create();
+    if (!index_ptr->load(file_path, model_hash))
+        return false;
+    store_ptr_->publish(index_ptr);
+    return true;
+}
+
+bool Detector::saveGallery(const std::string &file_path,
+                           uint64_t model_hash) const {
+    return store_ptr_->acquire()->save(file_path, model_hash);
+}
+
 // 人脸识别，获得一张图片上所有的人脸和对应特征值
-DetectResult Detector::detectFace(const cv::Mat input, int top_k) {
-    yunet_ptr_->setInputSize(input.size());
-    yunet_ptr_->setTopK(top_k);
+void Detector::detectFace(const cv::Mat &input, int top_k, float scale,
+                          DetectResult &detect_result) {
     // 人脸
-    cv::Mat faces = yunet_ptr_->infer(input);
-    // 特征值
-    std::vector<cv::Mat> features;
-    for (size_t i = 0; i < faces.rows; ++i) {
-        cv::Mat feature = sface_ptr_->extractFeatures(input, faces.row(i));
-        features.push_back(feature);
+    detectFaceBoxes(input, top_k, scale, detect_result.faces);
+    // 特征值，质量合格的人脸一次前向
+    static thread_local std::vector<cv::Mat> inputs(1), faces_vec(1);
+    inputs[0] = input;
+    faces_vec[0] = detect_result.faces;
+    extractQualified(inputs, faces_vec, detect_result.qualities,
+                     detect_result.features);
+    inputs[0].release();
+    faces_vec[0].release();
+    return;
+}
+
+void Detector::extractQualified(const std::vector<cv::Mat> &inputs,
+                                const std::vector<cv::Mat> &faces_vec,
+                                std::vector<FaceQuality> &qualities,
+                                cv::Mat &features) {
+    qualities.clear();
+    if (!quality_estimator_.enabled()) {
+        sface_ptr_->extractFeaturesBatch(inputs, faces_vec, features);
+        return;
+    }
+    qualified_faces_vec_.resize(faces_vec.size());
+    int total = 0;
+    for (size_t i = 0; i < faces_vec.size(); ++i) {
+        const auto &faces = faces_vec[i];
+        auto &qualified_faces = qualified_faces_vec_[i];
+        int qualified = 0;
+        for (int r = 0; r < faces.rows; ++r) {
+            qualities.push_back(
+                quality_estimator_.assess(inputs[i], faces.ptr<float>(r)));
+            qualified += qualities.back().verdict == kquality_extract;
+        }
+        qualified_faces.create(qualified, faces.cols, CV_32F);
+        for (int r = 0, row = 0; r < faces.rows; ++r) {
+            if (qualities[total + r].verdict != kquality_extract)
+                continue;
+            cv::Mat qualified_face = qualified_faces.row(row++);
+            faces.row(r).copyTo(qualified_face);
+        }
+        total += faces.rows;
+    }
+    sface_ptr_->extractFeaturesBatch(inputs, qualified_faces_vec_,
+                                     qualified_features_);
+    // 按原顺序放回，不合格人脸的特征为0
+    features.create(total, SFace::kfeature_dim, CV_32F);
+    for (int k = 0, row = 0; k < total; ++k) {
+        cv::Mat feature = features.row(k);
+        if (qualities[k].verdict == kquality_extract)
+            qualified_features_.row(row++).copyTo(feature);
+        else
+            feature.setTo(0);
+    }
+    return;
+}
+
+void Detector::detectFaceBoxes(const cv::Mat &input, int top_k, float scale,
+                               cv::Mat &faces) {
+    if (scale < 1.f) {
+        MetricTimer timer(kmetric_resize);
+        cv::resize(input, scaled_input_, cv::Size(), scale, scale,
+                   cv::INTER_AREA);
+    }
+    const cv::Mat &detect_input = scale < 1.f ? scaled_input_ : input;
+    if (tiled_ptr_ != nullptr && tiled_ptr_->covers(detect_input.size())) {
+        tiled_ptr_->detect(detect_input, top_k, faces);
+    } else {
+        yunet_ptr_->setTopK(top_k);
+        yunet_ptr_->setInputSize(detect_input.size());
+        yunet_ptr_->infer(detect_input, faces);
     }
+    if (scale >= 1.f)
+        return;
+    // 框和关键点映射回原图，第14列置信度不变
+    for (int r = 0; r < faces.rows; ++r) {
+        float *face = faces.ptr<float>(r);
+        for (int c = 0; c < 14; ++c)
+            face[c] /= scale;
+    }
+    return;
+}
+
+DetectResult Detector::detectFaceLetterbox(const cv::Mat &input,
+                                           const cv::Size &canonical_size,
+                                           int top_k) {
+    yunet_ptr_->setTopK(top_k);
+    cv::Mat faces = yunet_ptr_->inferLetterbox(input, canonical_size);
+    cv::Mat features;
+    sface_ptr_->extractFeaturesBatch(input, faces, features);
     return DetectResult(faces, features);
 }
 
+void Detector::detectFaces(const std::vector<cv::Mat> &inputs, int top_k,
+                           float scale,
+                           std::vector<DetectResult> &detect_results) {
+    detect_results.resize(inputs.size());
+    batch_faces_vec_.resize(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        detectFaceBoxes(inputs[i], top_k, scale, detect_results[i].faces);
+        batch_faces_vec_[i] = detect_results[i].faces;
+    }
+    extractQualified(inputs, batch_faces_vec_, batch_qualities_,
+                     batch_features_);
+    // 特征复制到各自的结果中，结果可以交给其他线程而不受下一批影响
+    int row = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        auto &detect_result = detect_results[i];
+        const int rows = detect_result.faces.rows;
+        batch_features_.rowRange(row, row + rows)
+            .copyTo(detect_result.features);
+        detect_result.qualities.clear();
+        if (!batch_qualities_.empty())
+            detect_result.qualities.assign(batch_qualities_.begin() + row,
+                                           batch_qualities_.begin() + row +
+                                               rows);
+        row += rows;
+        batch_faces_vec_[i].release();
+    }
+    return;
+}
+
 // 匹配人脸
-MatchDataVec Detector::matchTargetFace(DetectResult detect_result) {
-    MatchDataVec match_data_vec;
-    for (size_t i = 0; i < detect_result.faces.rows; ++i) {
-        MatchData match_data;
-        match_data.face = detect_result.faces.row(i);
-        for (auto target_data : target_data_vec_) {
-            auto match_raw_data = sface_ptr_->matchFeatures(
-                target_data.feature, detect_result.features[i]);
-            if (match_raw_data.first <= match_data.conf)
+MatchDataVec Detector::matchTargetFace(const DetectResult &detect_result) {
+    FrameContext context;
+    matchTargetFace(detect_result, context);
+    return std::move(context.match_data_vec);
+}
+
+void Detector::matchTargetFace(const DetectResult &detect_result,
+                               FrameContext &context) {
+    const auto &qualities = detect_result.qualities;
+    const auto qualified_count = static_cast<int>(std::count_if(
+        qualities.begin(), qualities.end(), [](const FaceQuality &quality) {
+            return quality.verdict == kquality_extract;
+        }));
+    if (qualities.empty() || qualified_count == detect_result.faces.rows) {
+        matchFeatures(detect_result.faces, detect_result.features, context,
+                      context.match_data_vec);
+        for (size_t r = 0; r < qualities.size(); ++r)
+            context.match_data_vec[r].quality = qualities[r];
+        return;
+    }
+    // 没有提取特征的人脸不参与匹配，只搜索合格人脸
+    auto &pending = context.pending;
+    pending.faces.create(qualified_count, detect_result.faces.cols, CV_32F);
+    pending.features.create(qualified_count, detect_result.features.cols,
+                            CV_32F);
+    for (int r = 0, row = 0; r < detect_result.faces.rows; ++r) {
+        if (qualities[r].verdict != kquality_extract)
+            continue;
+        cv::Mat pending_face = pending.faces.row(row);
+        detect_result.faces.row(r).copyTo(pending_face);
+        cv::Mat pending_feature = pending.features.row(row++);
+        detect_result.features.row(r).copyTo(pending_feature);
+    }
+    matchFeatures(pending.faces, pending.features, context,
+                  context.pending_match_data_vec);
+
+    auto &match_data_vec = context.match_data_vec;
+    match_data_vec.resize(detect_result.faces.rows);
+    for (int r = 0, pending_index = 0; r < detect_result.faces.rows; ++r) {
+        auto &match_data = match_data_vec[r];
+        if (qualities[r].verdict == kquality_extract) {
+            const auto &pending_match_data =
+                context.pending_match_data_vec[pending_index++];
+            match_data.name.assign(pending_match_data.name);
+            match_data.conf = pending_match_data.conf;
+            match_data.match = pending_match_data.match;
+        } else {
+            match_data.name.assign("?");
+            match_data.conf = 0.f;
+            match_data.match = false;
+        }
+        match_data.face = detect_result.faces.row(r);
+        match_data.track_id = -1;
+        match_data.quality = qualities[r];
+    }
+    return;
+}
+
+void Detector::matchFeatures(const cv::Mat &faces, const cv::Mat &features,
+                             FrameContext &context,
+                             MatchDataVec &match_data_vec) {
+    MetricTimer timer(kmetric_match);
+    match_data_vec.resize(faces.rows);
+    // 所有人脸一次性与同一个版本的特征库比较
+    const auto snapshot = store_ptr_->acquire();
+    snapshot->packQueries(features, context.packed_queries);
+    snapshot->search(context.packed_queries, sface_ptr_->distanceType(),
+                     sface_ptr_->searchParams(), context.search_results);
+    for (int i = 0; i < faces.rows; ++i) {
+        auto &match_data = match_data_vec[i];
+        const auto &search_result = context.search_results[i];
+        // 逐项赋值，名字复用已有的字符串内存
+        match_data.face = faces.row(i);
+        match_data.track_id = -1;
+        match_data.quality = FaceQuality();
+        const auto &candidates = search_result.candidates;
+        if (candidates.empty()) {
+            match_data.name.assign("?");
+            match_data.conf = 0.f;
+            match_data.match = false;
+            continue;
+        }
+        const auto &best = candidates.front();
+        match_data.conf = best.score;
+        // 开集拒识：最佳身份须超过阈值且明显优于次佳身份
+        match_data.match =
+            sface_ptr_->isMatched(best.score) &&
+            (candidates.size() < 2 ||
+             sface_ptr_->isDistinct(best.score, candidates[1].score));
+        match_data.name.assign(snapshot->name(best.index));
+    }
+    return;
+}
+
+// 跟踪并匹配人脸
+void Detector::matchTrackedFace(const cv::Mat &input, const cv::Mat &faces,
+                                FaceTracker &tracker, FrameContext &context) {
+    auto &assignments = context.assignments;
+    auto &pending = context.pending;
+    tracker.setGalleryVersion(store_ptr_->version());
+    tracker.update(faces, assignments);
+    gateRecognition(input, faces, tracker, assignments, context.qualities);
+    // 只对需要重新识别的人脸提取特征并匹配
+    const auto pending_count = static_cast<int>(std::count_if(
+        assignments.begin(), assignments.end(),
+        [](const TrackAssignment &assignment) {
+            return assignment.need_recognize;
+        }));
+    pending.faces.create(pending_count, faces.cols, CV_32F);
+    for (int r = 0, row = 0; r < faces.rows; ++r) {
+        if (!assignments[r].need_recognize)
+            continue;
+        cv::Mat pending_face = pending.faces.row(row++);
+        faces.row(r).copyTo(pending_face);
+    }
+    sface_ptr_->extractFeaturesBatch(input, pending.faces, pending.features);
+    matchFeatures(pending.faces, pending.features, context,
+                  context.pending_match_data_vec);
+
+    auto &match_data_vec = context.match_data_vec;
+    match_data_vec.resize(faces.rows);
+    for (int r = 0, pending_index = 0; r < faces.rows; ++r) {
+        auto &match_data = match_data_vec[r];
+        const auto &assignment = assignments[r];
+        if (assignment.need_recognize) {
+            const auto &pending_match_data =
+                context.pending_match_data_vec[pending_index++];
+            match_data.name.assign(pending_match_data.name);
+            match_data.conf = pending_match_data.conf;
+            match_data.match = pending_match_data.match;
+            tracker.setIdentity(assignment.track_id, match_data.name,
+                                match_data.conf, match_data.match);
+        } else {
+            const auto &identity = tracker.identity(assignment.track_id);
+            match_data.name.assign(identity.name);
+            match_data.conf = identity.conf;
+            match_data.match = identity.match;
+        }
+        match_data.face = faces.row(r);
+        match_data.track_id = assignment.track_id;
+        match_data.quality = context.qualities[r];
+    }
+    return;
+}
+
+void Detector::gateRecognition(const cv::Mat &input, const cv::Mat &faces,
+                               FaceTracker &tracker,
+                               std::vector<TrackAssignment> &assignments,
+                               std::vector<FaceQuality> &qualities) {
+    qualities.assign(faces.rows, FaceQuality());
+    if (!quality_estimator_.enabled())
+        return;
+    for (int r = 0; r < faces.rows; ++r) {
+        auto &assignment = assignments[r];
+        if (!assignment.need_recognize)
+            continue;
+        qualities[r] = quality_estimator_.assess(input, faces.ptr<float>(r));
+        if (qualities[r].verdict == kquality_extract)
+            continue;
+        // 轨迹保留原有身份
+        assignment.need_recognize = false;
+        tracker.cancelRecognition(assignment.track_id,
+                                  qualities[r].verdict == kquality_defer);
+    }
+    return;
+}
+
+void Detector::matchPredictedFace(FaceTracker &tracker,
+                                  FrameContext &context) {
+    auto &faces = context.detect_result.faces;
+    tracker.predictFaces(faces, context.track_ids);
+    auto &match_data_vec = context.match_data_vec;
+    match_data_vec.resize(faces.rows);
+    for (int r = 0; r < faces.rows; ++r) {
+        auto &match_data = match_data_vec[r];
+        const int track_id = context.track_ids[r];
+        const auto &identity = tracker.identity(track_id);
+        match_data.name.assign(identity.name);
+        match_data.conf = identity.conf;
+        match_data.match = identity.match;
+        match_data.face = faces.row(r);
+        match_data.track_id = track_id;
+        match_data.quality = FaceQuality();
+    }
+    return;
+}
+
+std::vector<MatchDataVec>
+Detector::matchTrackedFaces(const std::vector<cv::Mat> &inputs,
+                            const std::vector<cv::Mat> &faces_vec,
+                            const std::vector<FaceTracker *> &trackers) {
+    const size_t image_count = inputs.size();
+    std::vector<std::vector<TrackAssignment>> assignments_vec(image_count);
+    std::vector<cv::Mat> pending_faces_vec(image_count);
+    std::vector<std::vector<FaceQuality>> qualities_vec(image_count);
+    // 只对需要重新识别的人脸做一次批量特征提取和匹配
+    DetectResult pending;
+    const auto gallery_version = store_ptr_->version();
+    for (size_t i = 0; i < image_count; ++i) {
+        const auto &faces = faces_vec[i];
+        trackers[i]->setGalleryVersion(gallery_version);
+        trackers[i]->update(faces, assignments_vec[i]);
+        gateRecognition(inputs[i], faces, *trackers[i], assignments_vec[i],
+                        qualities_vec[i]);
+        for (int r = 0; r < faces.rows; ++r) {
+            if (!assignments_vec[i][r].need_recognize)
                 continue;
-            match_data.conf = match_raw_data.first;
-            match_data.match = match_raw_data.second;
-            match_data.name = target_data.name;
+            pending_faces_vec[i].push_back(faces.row(r));
+            pending.faces.push_back(faces.row(r));
         }
-        match_data_vec.push_back(match_data);
     }
-    return match_data_vec;
+    sface_ptr_->extractFeaturesBatch(inputs, pending_faces_vec,
+                                     pending.features);
+    const auto pending_match_data_vec = matchTargetFace(pending);
+
+    std::vector<MatchDataVec> match_data_vecs(image_count);
+    size_t pending_index = 0;
+    for (size_t i = 0; i < image_count; ++i) {
+        const auto &faces = faces_vec[i];
+        auto &tracker = *trackers[i];
+        auto &match_data_vec = match_data_vecs[i];
+        match_data_vec.resize(faces.rows);
+        for (int r = 0; r < faces.rows; ++r) {
+            auto &match_data = match_data_vec[r];
+            const auto &assignment = assignments_vec[i][r];
+            if (assignment.need_recognize) {
+                const auto &pending_match_data =
+                    pending_match_data_vec[pending_index++];
+                match_data = pending_match_data;
+                tracker.setIdentity(assignment.track_id,
+                                    pending_match_data.name,
+                                    pending_match_data.conf,
+                                    pending_match_data.match);
+            } else {
+                const auto &identity = tracker.identity(assignment.track_id);
+                match_data.name = identity.name;
+                match_data.conf = identity.conf;
+                match_data.match = identity.match;
+            }
+            match_data.face = faces.row(r);
+            match_data.track_id = assignment.track_id;
+            match_data.quality = qualities_vec[i][r];
+        }
+    }
+    return match_data_vecs;
 }
 
 void DrawFacePoint(cv::Mat input, const cv::Mat &face) {
@@ -116,28 +658,54 @@ void DrawFacePoint(cv::Mat input, const cv::Mat &face) {
     }
 }
 
-cv::Mat visualize(const cv::Mat &image, MatchDataVec match_data_vec,
-                  const std::string &fps_text, bool draw_face_points) {
+void OffsetFaces(cv::Mat &faces, const cv::Point &offset) {
+    // 第0、1列为人脸框左上角，第4~13列为5个关键点
+    for (int r = 0; r < faces.rows; ++r) {
+        float *face = faces.ptr<float>(r);
+        for (int c = 0; c < 14; c += 2) {
+            if (c == 2)
+                continue;
+            face[c] += offset.x;
+            face[c + 1] += offset.y;
+        }
+    }
+    return;
+}
+
+void visualize(const cv::Mat &image, std::span<const MatchData> match_data,
+               cv::Mat &output_image, const std::string &fps_text,
+               bool draw_face_points) {
     static const cv::Scalar green_color{0, 255, 0};
     static const cv::Scalar red_color{0, 0, 255};
-    auto output_image = image.clone();
+    // 标签文字复用同一块内存
+    static thread_local std::string label;
+    MetricTimer timer(kmetric_render);
+    image.copyTo(output_image);
     cv::putText(output_image, fps_text, cv::Point(0, 15),
                 cv::FONT_HERSHEY_SIMPLEX, 0.5, green_color, 2);
-    for (auto match_data : match_data_vec) {
-        auto [name, face, conf, match] = match_data;
-        auto color = match ? green_color : red_color;
+    for (const auto &[name, face, conf, match, track_id, quality] :
+         match_data) {
+        const auto &color = match ? green_color : red_color;
         int x = static_cast<int>(face.at<float>(0));
         int y = static_cast<int>(face.at<float>(1));
         int w = static_cast<int>(face.at<float>(2));
         int h = static_cast<int>(face.at<float>(3));
-        cv::putText(output_image, name, cv::Point(x, y + 12),
+        label.assign(name);
+        if (track_id >= 0)
+            label.append(" #").append(std::to_string(track_id));
+        cv::putText(output_image, label, cv::Point(x, y + 12),
+                    cv::FONT_HERSHEY_SIMPLEX, 0.5, color, 2);
+        char conf_text[16];
+        std::snprintf(conf_text, sizeof(conf_text), "%.2f", conf);
+        label.assign(conf_text);
+        // 没有识别的人脸标出原因
+        if (quality.reason != kquality_ok)
+            label.append(" ").append(QualityReasonName(quality.reason));
+        cv::putText(output_image, label, cv::Point(x, y + 30),
                     cv::FONT_HERSHEY_SIMPLEX, 0.5, color, 2);
-        cv::putText(output_image, cv::format("%.2f", conf),
-                    cv::Point(x, y + 30), cv::FONT_HERSHEY_SIMPLEX, 0.5, color,
-                    2);
         cv::rectangle(output_image, cv::Rect(x, y, w, h), color, 2);
         if (draw_face_points)
             DrawFacePoint(output_image, face);
     }
-    return output_image;
+    return;
 }
@@ -0,0 +1,315 @@
+#include "enrollment.hpp"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <unordered_set>
+
+// opencv
+#include <opencv2/imgcodecs.hpp>
+
+namespace {
+constexpr char kcache_magic[8] = {'F', 'R', 'E', 'N', 'R', 'O', 'L', 'L'};
+constexpr uint32_t kcache_version = 1;
+
+template <typename T> void WritePod(std::ofstream &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> bool ReadPod(std::ifstream &file, T &value) {
+    return static_cast<bool>(
+        file.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+/**
+ * @brief 图片的文件状态
+ *
+ */
+struct FileStat {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+};
+
+bool GetFileStat(const std::string &file_path, FileStat &file_stat) {
+    std::error_code ec;
+    file_stat.size = std::filesystem::file_size(file_path, ec);
+    if (ec)
+        return false;
+    file_stat.mtime = std::filesystem::last_write_time(file_path, ec)
+                          .time_since_epoch()
+                          .count();
+    return !ec;
+}
+} // namespace
+
+bool EnrollmentCache::load(const std::string &file_path) {
+    entries_.clear();
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+    char magic[8];
+    uint32_t version = 0, dim = 0;
+    uint64_t yunet_hash = 0, sface_hash = 0, count = 0;
+    file.read(magic, sizeof(magic));
+    if (!file || std::memcmp(magic, kcache_magic, sizeof(magic)) != 0 ||
+        !ReadPod(file, version) || version != kcache_version ||
+        !ReadPod(file, dim) || !ReadPod(file, yunet_hash) ||
+        !ReadPod(file, sface_hash) || !ReadPod(file, count)) {
+        std::cerr << "[EnrollmentCache->load]:<" << file_path
+                  << ">格式或版本不匹配，忽略缓存\n";
+        return false;
+    }
+    if (yunet_hash != yunet_hash_ || sface_hash != sface_hash_) {
+        std::cout << "[EnrollmentCache->load]:模型已变化，忽略缓存\n";
+        return false;
+    }
+    // 没有任何图片检测到人脸时维度为0
+    if (dim != 0 && dim != static_cast<uint32_t>(SFace::kfeature_dim)) {
+        std::cerr << "[EnrollmentCache->load]:<" << file_path << ">特征维度为"
+                  << dim << "，应为" << SFace::kfeature_dim << "，忽略缓存\n";
+        return false;
+    }
+    const auto corrupted = [&]() {
+        std::cerr << "[EnrollmentCache->load]:<" << file_path
+                  << ">已损坏，忽略缓存\n";
+        entries_.clear();
+        return false;
+    };
+    for (uint64_t i = 0; i < count; ++i) {
+        uint32_t path_size = 0;
+        uint8_t has_face = 0;
+        EnrollmentCacheEntry entry;
+        // 先检查长度再分配，损坏的文件不会导致巨大的分配
+        if (!ReadPod(file, path_size) || path_size > PATH_MAX)
+            return corrupted();
+        std::string path(path_size, '\0');
+        file.read(path.data(), path_size);
+        if (!ReadPod(file, entry.file_size) || !ReadPod(file, entry.mtime) ||
+            !ReadPod(file, entry.content_hash) || !ReadPod(file, has_face) ||
+            has_face > 1 || (has_face && dim == 0))
+            return corrupted();
+        if (has_face) {
+            entry.feature.resize(dim);
+            file.read(reinterpret_cast<char *>(entry.feature.data()),
+                      dim * sizeof(float));
+        }
+        if (!file)
+            return corrupted();
+        entries_.emplace(std::move(path), std::move(entry));
+    }
+    return true;
+}
+
+bool EnrollmentCache::save(const std::string &file_path) const {
+    uint32_t dim = 0;
+    for (const auto &[path, entry] : entries_)
+        dim = std::max(dim, static_cast<uint32_t>(entry.feature.size()));
+
+    const auto tmp_path = file_path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "[EnrollmentCache->save]:打开<" << tmp_path
+                      << ">失败\n";
+            return false;
+        }
+        file.write(kcache_magic, sizeof(kcache_magic));
+        WritePod(file, kcache_version);
+        WritePod(file, dim);
+        WritePod(file, yunet_hash_);
+        WritePod(file, sface_hash_);
+        WritePod(file, static_cast<uint64_t>(entries_.size()));
+        for (const auto &[path, entry] : entries_) {
+            WritePod(file, static_cast<uint32_t>(path.size()));
+            file.write(path.data(), static_cast<std::streamsize>(path.size()));
+            WritePod(file, entry.file_size);
+            WritePod(file, entry.mtime);
+            WritePod(file, entry.content_hash);
+            const bool has_face = entry.feature.size() == dim && dim > 0;
+            WritePod(file, static_cast<uint8_t>(has_face));
+            if (has_face)
+                file.write(reinterpret_cast<const char *>(entry.feature.data()),
+                           dim * sizeof(float));
+        }
+        if (!file.good()) {
+            std::cerr << "[EnrollmentCache->save]:写入<" << tmp_path
+                      << ">失败\n";
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, file_path, ec);
+    return !ec;
+}
+
+namespace {
+std::string TargetName(const std::string &image_path) {
+    return std::filesystem::path(image_path).stem().string();
+}
+
+/**
+ * @brief 使缓存与图片一致：淘汰已删除的图片，对新增或修改过的图片推理
+ *
+ * @param changed_names 输出有图片新增、修改或删除的名字
+ */
+void UpdateCache(const std::vector<std::string> &image_paths,
+                 EnrollmentCache &cache, cv::Ptr<Detector> detector_ptr,
+                 const DetectorFactory &detector_factory,
+                 EnrollmentStats &stats, size_t thread_count,
+                 std::unordered_set<std::string> &changed_names) {
+    stats = EnrollmentStats();
+    auto &entries = cache.entries();
+
+    // 淘汰已删除的图片
+    const std::unordered_set<std::string> path_set(image_paths.begin(),
+                                                   image_paths.end());
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (path_set.count(it->first) == 0) {
+            changed_names.insert(TargetName(it->first));
+            it = entries.erase(it);
+            ++stats.evictions;
+        } else {
+            ++it;
+        }
+    }
+    // 找出新增或修改过的图片
+    std::vector<std::string> miss_paths;
+    std::vector<FileStat> miss_stats;
+    for (const auto &image_path : image_paths) {
+        FileStat file_stat;
+        if (!GetFileStat(image_path, file_stat))
+            continue;
+        auto it = entries.find(image_path);
+        if (it != entries.end()) {
+            auto &entry = it->second;
+            if (entry.file_size == file_stat.size &&
+                entry.mtime == file_stat.mtime) {
+                ++stats.hits;
+                continue;
+            }
+            // 只是修改时间变了（如复制、touch），内容未变仍然命中
+            if (entry.file_size == file_stat.size &&
+                HashFile(image_path) == entry.content_hash) {
+                entry.mtime = file_stat.mtime;
+                ++stats.hits;
+                continue;
+            }
+        }
+        miss_paths.push_back(image_path);
+        miss_stats.push_back(file_stat);
+    }
+    stats.misses = miss_paths.size();
+
+    // 并行推理，每个线程一个识别器
+    std::vector<EnrollmentCacheEntry> miss_entries(miss_paths.size());
+    if (!miss_paths.empty()) {
+        if (thread_count == 0)
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        thread_count = std::min(thread_count, miss_paths.size());
+
+        std::atomic<size_t> next_index{0};
+        auto worker = [&](cv::Ptr<Detector> worker_detector) {
+            size_t index;
+            while ((index = next_index.fetch_add(1)) < miss_paths.size()) {
+                const auto &image_path = miss_paths[index];
+                auto &entry = miss_entries[index];
+                entry.file_size = miss_stats[index].size;
+                entry.mtime = miss_stats[index].mtime;
+                entry.content_hash = HashFile(image_path);
+                try {
+                    auto image = cv::imread(image_path);
+                    if (image.empty())
+                        continue;
+                    // 尺寸各异的图片填充到固定尺寸检测，网络只配置一次
+                    auto detect_result = worker_detector->detectFaceLetterbox(
+                        image, kenroll_input_size);
+                    if (detect_result.faces.empty())
+                        continue;
+                    const cv::Mat feature = detect_result.features.row(0);
+                    entry.feature.assign(feature.ptr<float>(),
+                                         feature.ptr<float>() +
+                                             feature.total());
+                } catch (const cv::Exception &e) {
+                    std::cerr << "[EnrollTargets]:<" << image_path
+                              << ">推理失败:" << e.what() << "\n";
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < thread_count; ++i)
+            threads.emplace_back(worker, detector_factory());
+        worker(detector_ptr);
+        for (auto &thread : threads)
+            thread.join();
+
+        for (size_t i = 0; i < miss_paths.size(); ++i) {
+            changed_names.insert(TargetName(miss_paths[i]));
+            entries[miss_paths[i]] = std::move(miss_entries[i]);
+        }
+    }
+}
+
+/**
+ * @brief 按图片顺序输出缓存中检测到人脸的目标
+ *
+ * @param names 只输出这些名字的目标，为空指针时输出全部
+ */
+TargetDataVec CollectTargets(const std::vector<std::string> &image_paths,
+                             EnrollmentCache &cache, EnrollmentStats &stats,
+                             const std::unordered_set<std::string> *names) {
+    auto &entries = cache.entries();
+    TargetDataVec target_data_vec;
+    if (names == nullptr)
+        target_data_vec.reserve(image_paths.size());
+    for (const auto &image_path : image_paths) {
+        const auto name = TargetName(image_path);
+        if (names != nullptr && names->count(name) == 0)
+            continue;
+        auto it = entries.find(image_path);
+        if (it == entries.end())
+            continue;
+        auto &feature = it->second.feature;
+        if (feature.empty()) {
+            std::cerr << "未检测到" << name << "人脸\n";
+            ++stats.no_face;
+            continue;
+        }
+        cv::Mat feature_mat(1, static_cast<int>(feature.size()), CV_32F,
+                            feature.data());
+        target_data_vec.push_back({name, feature_mat.clone()});
+    }
+    return target_data_vec;
+}
+} // namespace
+
+TargetDataVec EnrollTargets(const std::vector<std::string> &image_paths,
+                            EnrollmentCache &cache,
+                            cv::Ptr<Detector> detector_ptr,
+                            const DetectorFactory &detector_factory,
+                            EnrollmentStats &stats, size_t thread_count) {
+    std::unordered_set<std::string> changed_names;
+    UpdateCache(image_paths, cache, detector_ptr, detector_factory, stats,
+                thread_count, changed_names);
+    return CollectTargets(image_paths, cache, stats, nullptr);
+}
+
+EnrollmentDelta EnrollChangedTargets(
+    const std::vector<std::string> &image_paths, EnrollmentCache &cache,
+    cv::Ptr<Detector> detector_ptr, const DetectorFactory &detector_factory,
+    EnrollmentStats &stats, size_t thread_count) {
+    std::unordered_set<std::string> changed_names;
+    UpdateCache(image_paths, cache, detector_ptr, detector_factory, stats,
+                thread_count, changed_names);
+    EnrollmentDelta delta;
+    delta.names.assign(changed_names.begin(), changed_names.end());
+    std::sort(delta.names.begin(), delta.names.end());
+    delta.targets = CollectTargets(image_paths, cache, stats, &changed_names);
+    return delta;
+}
+
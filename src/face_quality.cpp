@@ -0,0 +1,86 @@
+#include "face_quality.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+// opencv
+#include <opencv2/imgproc.hpp>
+
+const char *QualityReasonName(QualityReason reason) {
+    switch (reason) {
+    case kquality_ok:
+        return "ok";
+    case kquality_low_score:
+        return "low_score";
+    case kquality_small:
+        return "small";
+    case kquality_pose:
+        return "pose";
+    case kquality_blur:
+        return "blur";
+    }
+    return "unknown";
+}
+
+void FaceQualityEstimator::EstimatePose(const float *face, float &yaw,
+                                        float &pitch) {
+    // 第4~13列依次为右眼、左眼、鼻尖、右嘴角、左嘴角
+    const float eye_x = (face[4] + face[6]) / 2;
+    const float eye_y = (face[5] + face[7]) / 2;
+    const float mouth_x = (face[10] + face[12]) / 2;
+    const float mouth_y = (face[11] + face[13]) / 2;
+    const float nose_x = face[8];
+    const float nose_y = face[9];
+    const float half_eye = std::max(std::hypot(face[6] - face[4],
+                                               face[7] - face[5]) / 2,
+                                    1e-3f);
+    yaw = std::clamp((nose_x - (eye_x + mouth_x) / 2) / half_eye, -1.f, 1.f);
+    const float span = mouth_y - eye_y;
+    pitch = span > 1e-3f
+                ? std::clamp(2.f * (nose_y - eye_y) / span - 1.f, -1.f, 1.f)
+                : 1.f;
+    return;
+}
+
+float FaceQualityEstimator::sharpness(const cv::Mat &image, const float *face) {
+    // 只取中心60%，避开背景和头发的边缘
+    const cv::Rect center(static_cast<int>(face[0] + face[2] * 0.2f),
+                          static_cast<int>(face[1] + face[3] * 0.2f),
+                          static_cast<int>(face[2] * 0.6f),
+                          static_cast<int>(face[3] * 0.6f));
+    const cv::Rect roi = center & cv::Rect(cv::Point(), image.size());
+    if (roi.width < 2 || roi.height < 2)
+        return 0.f;
+    cv::resize(image(roi), patch_, cv::Size(ksharpness_size, ksharpness_size),
+               0, 0, cv::INTER_AREA);
+    if (patch_.channels() == 3)
+        cv::cvtColor(patch_, gray_, cv::COLOR_BGR2GRAY);
+    else
+        patch_.copyTo(gray_);
+    cv::Laplacian(gray_, laplacian_, CV_16S);
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(laplacian_, mean, stddev);
+    return static_cast<float>(stddev[0] * stddev[0]);
+}
+
+FaceQuality FaceQualityEstimator::assess(const cv::Mat &image,
+                                         const float *face) {
+    if (!params_.enabled)
+        return {};
+    // 由便宜到贵依次检查，先判断不可挽回的情况
+    if (std::min(face[2], face[3]) < params_.min_size)
+        return {kquality_skip, kquality_small};
+    float yaw = 0.f, pitch = 0.f;
+    EstimatePose(face, yaw, pitch);
+    if (std::abs(yaw) > params_.skip_yaw)
+        return {kquality_skip, kquality_pose};
+    if (face[14] < params_.min_score)
+        return {kquality_defer, kquality_low_score};
+    if (std::abs(yaw) > params_.max_yaw || std::abs(pitch) > params_.max_pitch)
+        return {kquality_defer, kquality_pose};
+    if (params_.min_sharpness > 0.f &&
+        sharpness(image, face) < params_.min_sharpness)
+        return {kquality_defer, kquality_blur};
+    return {};
+}
@@ -0,0 +1,235 @@
+#include "face_tracker.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+void FaceTracker::Kalman1D::init(float value, float std) {
+    pos = value;
+    vel = 0.f;
+    // 初始速度未知，给较大的不确定度
+    p00 = 4.f * std * std;
+    p01 = 0.f;
+    p11 = 100.f * std * std;
+}
+
+void FaceTracker::Kalman1D::predict(float std_pos, float std_vel) {
+    // x = F x，P = F P F^T + Q，F = [[1, 1], [0, 1]]
+    pos += vel;
+    p00 += 2.f * p01 + p11 + std_pos * std_pos;
+    p01 += p11;
+    p11 += std_vel * std_vel;
+}
+
+void FaceTracker::Kalman1D::correct(float value, float std) {
+    const float s = p00 + std * std;
+    const float k0 = p00 / s;
+    const float k1 = p01 / s;
+    const float residual = value - pos;
+    pos += k0 * residual;
+    vel += k1 * residual;
+    p11 -= k1 * p01;
+    p00 *= 1.f - k0;
+    p01 *= 1.f - k0;
+}
+
+cv::Rect2f FaceTracker::FaceBox(const cv::Mat &faces, int row) {
+    const float *face = faces.ptr<float>(row);
+    return cv::Rect2f(face[0], face[1], face[2], face[3]);
+}
+
+cv::Rect2f FaceTracker::TrackBox(const Track &track) {
+    const float w = std::max(track.state[2].pos, 1.f);
+    const float h = std::max(track.state[3].pos, 1.f);
+    return cv::Rect2f(track.state[0].pos - w / 2, track.state[1].pos - h / 2,
+                      w, h);
+}
+
+float FaceTracker::Iou(const cv::Rect2f &a, const cv::Rect2f &b) {
+    const float inter = (a & b).area();
+    const float uni = a.area() + b.area() - inter;
+    return uni > 0.f ? inter / uni : 0.f;
+}
+
+void FaceTracker::predict(Track &track) const {
+    // 噪声与人脸大小成比例，远近不同的人脸使用同一组参数
+    const float h = std::max(track.state[3].pos, 1.f);
+    for (auto &state : track.state)
+        state.predict(h / 20.f, h / 160.f);
+}
+
+void FaceTracker::correct(Track &track, const cv::Rect2f &box) const {
+    const float values[] = {box.x + box.width / 2, box.y + box.height / 2,
+                            box.width, box.height};
+    const float std = std::max(box.height, 1.f) / 20.f;
+    for (size_t i = 0; i < track.state.size(); ++i)
+        track.state[i].correct(values[i], std);
+}
+
+bool FaceTracker::boxChanged(const Track &track, const cv::Rect2f &box) const {
+    const auto &verified = track.verified_box;
+    if (verified.area() <= 0.f)
+        return true;
+    const float scale = std::sqrt(box.area() / verified.area());
+    return std::abs(scale - 1.f) > params_.max_box_change;
+}
+
+void FaceTracker::update(const cv::Mat &faces,
+                         std::vector<TrackAssignment> &assignments) {
+    const int face_count = faces.rows;
+    assignments.assign(face_count, TrackAssignment());
+    stats_.faces += face_count;
+    for (auto &track : tracks_)
+        predict(track);
+
+    // 按IoU从大到小贪心关联，一帧的人脸数很少，不需要匈牙利算法
+    candidates_.clear();
+    for (size_t t = 0; t < tracks_.size(); ++t) {
+        const auto track_box = TrackBox(tracks_[t]);
+        for (int f = 0; f < face_count; ++f) {
+            const float iou = Iou(track_box, FaceBox(faces, f));
+            if (iou >= params_.iou_threshold)
+                candidates_.push_back({iou, t, f});
+        }
+    }
+    std::sort(candidates_.begin(), candidates_.end(),
+              [](const Candidate &a, const Candidate &b) {
+                  return a.iou > b.iou;
+              });
+
+    track_used_.assign(tracks_.size(), 0);
+    face_used_.assign(face_count, 0);
+    for (const auto &candidate : candidates_) {
+        if (track_used_[candidate.track] || face_used_[candidate.face])
+            continue;
+        track_used_[candidate.track] = 1;
+        face_used_[candidate.face] = 1;
+        auto &track = tracks_[candidate.track];
+        const auto box = FaceBox(faces, candidate.face);
+        correct(track, box);
+        std::copy_n(faces.ptr<float>(candidate.face), track.face.size(),
+                    track.face.begin());
+        track.missed = 0;
+        ++track.frames_since_verify;
+        const bool need_recognize =
+            candidate.iou < params_.reverify_iou ||
+            track.frames_since_verify >= params_.reverify_interval ||
+            boxChanged(track, box);
+        if (need_recognize) {
+            track.frames_since_verify = 0;
+            track.verified_box = box;
+        }
+        assignments[candidate.face] = {track.id, need_recognize};
+    }
+
+    // 未关联的轨迹累计丢失帧数，超过上限删除
+    for (size_t t = 0; t < tracks_.size(); ++t)
+        if (!track_used_[t])
+            ++tracks_[t].missed;
+    std::erase_if(tracks_, [this](const Track &track) {
+        return track.missed > params_.max_missed;
+    });
+
+    // 未关联的人脸新建轨迹
+    for (int f = 0; f < face_count; ++f) {
+        if (face_used_[f])
+            continue;
+        Track track;
+        track.id = next_id_++;
+        const auto box = FaceBox(faces, f);
+        const float values[] = {box.x + box.width / 2, box.y + box.height / 2,
+                                box.width, box.height};
+        const float std = std::max(box.height, 1.f) / 20.f;
+        for (size_t i = 0; i < track.state.size(); ++i)
+            track.state[i].init(values[i], std);
+        std::copy_n(faces.ptr<float>(f), track.face.size(),
+                    track.face.begin());
+        track.verified_box = box;
+        tracks_.push_back(track);
+        assignments[f] = {track.id, true};
+        ++stats_.tracks;
+    }
+
+    for (const auto &assignment : assignments)
+        stats_.recognized += assignment.need_recognize;
+    return;
+}
+
+void FaceTracker::setIdentity(int track_id, std::string_view name, float conf,
+                              bool match) {
+    for (auto &track : tracks_) {
+        if (track.id == track_id) {
+            track.identity.name.assign(name);
+            track.identity.conf = conf;
+            track.identity.match = match;
+            return;
+        }
+    }
+}
+
+void FaceTracker::cancelRecognition(int track_id, bool retry) {
+    --stats_.recognized;
+    if (!retry)
+        return;
+    // 清空识别时的人脸框，boxChanged会在下一次更新时要求重新识别
+    for (auto &track : tracks_) {
+        if (track.id == track_id) {
+            track.verified_box = cv::Rect2f();
+            return;
+        }
+    }
+}
+
+const TrackIdentity &FaceTracker::identity(int track_id) const {
+    static const TrackIdentity unknown;
+    for (const auto &track : tracks_)
+        if (track.id == track_id)
+            return track.identity;
+    return unknown;
+}
+
+void FaceTracker::predictFaces(cv::Mat &faces, std::vector<int> &track_ids) {
+    track_ids.clear();
+    for (auto &track : tracks_) {
+        predict(track);
+        // 上次检测时已丢失的轨迹不输出
+        if (track.missed == 0)
+            track_ids.push_back(track.id);
+    }
+    faces.create(static_cast<int>(track_ids.size()),
+                 static_cast<int>(std::tuple_size_v<decltype(Track::face)>),
+                 CV_32F);
+    int row = 0;
+    for (const auto &track : tracks_) {
+        if (track.missed > 0)
+            continue;
+        const auto box = TrackBox(track);
+        float *face = faces.ptr<float>(row++);
+        std::copy(track.face.begin(), track.face.end(), face);
+        const float sx = face[2] > 0.f ? box.width / face[2] : 1.f;
+        const float sy = face[3] > 0.f ? box.height / face[3] : 1.f;
+        for (size_t i = 4; i + 1 < track.face.size(); i += 2) {
+            face[i] = box.x + (face[i] - face[0]) * sx;
+            face[i + 1] = box.y + (face[i + 1] - face[1]) * sy;
+        }
+        face[0] = box.x;
+        face[1] = box.y;
+        face[2] = box.width;
+        face[3] = box.height;
+    }
+    return;
+}
+
+void FaceTracker::setGalleryVersion(uint64_t version) {
+    if (version == gallery_version_)
+        return;
+    gallery_version_ = version;
+    // 清空上次识别时的人脸框，boxChanged会要求重新识别
+    for (auto &track : tracks_)
+        track.verified_box = cv::Rect2f();
+}
+
+void FaceTracker::reset() {
+    tracks_.clear();
+    return;
+}
@@ -0,0 +1,200 @@
+#include "ffmpeg_capture.hpp"
+
+// std
+#include <algorithm>
+#include <iostream>
+
+// ffmpeg
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/hwcontext.h>
+#include <libswscale/swscale.h>
+}
+
+// custom
+#include "metrics.hpp"
+
+namespace {
+std::string AvError(int error) {
+    char buffer[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(error, buffer, sizeof(buffer));
+    return buffer;
+}
+} // namespace
+
+bool FFmpegCapture::open(const std::string &source,
+                         const FFmpegCaptureOptions &options) {
+    release();
+    int error = avformat_open_input(&format_context_, source.c_str(), nullptr,
+                                    nullptr);
+    if (error < 0) {
+        std::cerr << "[FFmpegCapture->open]:打开<" << source
+                  << ">失败:" << AvError(error) << "\n";
+        return false;
+    }
+    error = avformat_find_stream_info(format_context_, nullptr);
+    const AVCodec *codec = nullptr;
+    if (error >= 0)
+        error = stream_index_ = av_find_best_stream(
+            format_context_, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (error < 0) {
+        std::cerr << "[FFmpegCapture->open]:<" << source
+                  << ">中没有可解码的视频流:" << AvError(error) << "\n";
+        release();
+        return false;
+    }
+
+    codec_context_ = avcodec_alloc_context3(codec);
+    if (codec_context_ == nullptr) {
+        std::cerr << "[FFmpegCapture->open]:分配解码器上下文失败\n";
+        release();
+        return false;
+    }
+    error = avcodec_parameters_to_context(
+        codec_context_, format_context_->streams[stream_index_]->codecpar);
+    if (error < 0) {
+        std::cerr << "[FFmpegCapture->open]:复制解码参数失败:"
+                  << AvError(error) << "\n";
+        release();
+        return false;
+    }
+    // 帧级和片级多线程解码
+    codec_context_->thread_count = std::max(options.decode_threads, 0);
+    codec_context_->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    if (!options.hw_device.empty()) {
+        const auto type = av_hwdevice_find_type_by_name(
+            options.hw_device.c_str());
+        if (type != AV_HWDEVICE_TYPE_NONE &&
+            av_hwdevice_ctx_create(&hw_device_context_, type, nullptr,
+                                   nullptr, 0) == 0)
+            codec_context_->hw_device_ctx = av_buffer_ref(hw_device_context_);
+        else
+            std::cerr << "[FFmpegCapture->open]:硬件解码<"
+                      << options.hw_device << ">不可用，改为软件解码\n";
+    }
+    error = avcodec_open2(codec_context_, codec, nullptr);
+    if (error < 0) {
+        std::cerr << "[FFmpegCapture->open]:打开解码器失败:" << AvError(error)
+                  << "\n";
+        release();
+        return false;
+    }
+    packet_ = av_packet_alloc();
+    frame_ = av_frame_alloc();
+    sw_frame_ = av_frame_alloc();
+    if (packet_ == nullptr || frame_ == nullptr || sw_frame_ == nullptr) {
+        std::cerr << "[FFmpegCapture->open]:分配帧缓冲失败\n";
+        release();
+        return false;
+    }
+    return true;
+}
+
+void FFmpegCapture::release() {
+    sws_freeContext(sws_context_);
+    sws_freeContext(full_sws_context_);
+    sws_context_ = full_sws_context_ = nullptr;
+    av_frame_free(&frame_);
+    av_frame_free(&sw_frame_);
+    av_packet_free(&packet_);
+    avcodec_free_context(&codec_context_);
+    av_buffer_unref(&hw_device_context_);
+    avformat_close_input(&format_context_);
+    current_ = nullptr;
+    stream_index_ = -1;
+    draining_ = false;
+    return;
+}
+
+cv::Size FFmpegCapture::frameSize() const {
+    if (codec_context_ == nullptr)
+        return cv::Size();
+    return cv::Size(codec_context_->width, codec_context_->height);
+}
+
+bool FFmpegCapture::decodeFrame() {
+    while (true) {
+        int error = avcodec_receive_frame(codec_context_, frame_);
+        if (error == 0)
+            break;
+        if (error == AVERROR_EOF)
+            return false;
+        if (error != AVERROR(EAGAIN)) {
+            std::cerr << "[FFmpegCapture->decodeFrame]:" << AvError(error)
+                      << "\n";
+            return false;
+        }
+        // 解码器需要更多数据，读到结尾后送入空包取出缓存的帧
+        if (draining_)
+            return false;
+        while ((error = av_read_frame(format_context_, packet_)) >= 0 &&
+               packet_->stream_index != stream_index_)
+            av_packet_unref(packet_);
+        if (error < 0) {
+            draining_ = true;
+            avcodec_send_packet(codec_context_, nullptr);
+            continue;
+        }
+        error = avcodec_send_packet(codec_context_, packet_);
+        av_packet_unref(packet_);
+        // 损坏的包跳过，继续解码后续的包
+        if (error < 0 && error != AVERROR(EAGAIN))
+            std::cerr << "[FFmpegCapture->decodeFrame]:" << AvError(error)
+                      << "\n";
+    }
+    current_ = frame_;
+    // 硬件解码的帧在显存中，下载后再转换
+    if (frame_->hw_frames_ctx != nullptr) {
+        av_frame_unref(sw_frame_);
+        const int error = av_hwframe_transfer_data(sw_frame_, frame_, 0);
+        if (error < 0) {
+            std::cerr << "[FFmpegCapture->decodeFrame]:下载硬件帧失败:"
+                      << AvError(error) << "\n";
+            return false;
+        }
+        current_ = sw_frame_;
+    }
+    return true;
+}
+
+bool FFmpegCapture::convert(SwsContext *&sws_context, const cv::Size &size,
+                            cv::Mat &image) {
+    sws_context = sws_getCachedContext(
+        sws_context, current_->width, current_->height,
+        static_cast<AVPixelFormat>(current_->format), size.width, size.height,
+        AV_PIX_FMT_BGR24, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (sws_context == nullptr) {
+        std::cerr << "[FFmpegCapture->convert]:不支持的像素格式<"
+                  << current_->format << ">\n";
+        return false;
+    }
+    image.create(size, CV_8UC3);
+    uint8_t *const dst_data[] = {image.data};
+    const int dst_linesize[] = {static_cast<int>(image.step[0])};
+    sws_scale(sws_context, current_->data, current_->linesize, 0,
+              current_->height, dst_data, dst_linesize);
+    return true;
+}
+
+bool FFmpegCapture::read(cv::Mat &image, float scale) {
+    if (!isOpened())
+        return false;
+    {
+        MetricTimer timer(kmetric_capture);
+        if (!decodeFrame())
+            return false;
+    }
+    MetricTimer timer(kmetric_resize);
+    const cv::Size size(
+        std::max(static_cast<int>(current_->width * scale), 1),
+        std::max(static_cast<int>(current_->height * scale), 1));
+    return convert(sws_context_, size, image);
+}
+
+bool FFmpegCapture::retrieveFull(cv::Mat &full_image) {
+    if (current_ == nullptr)
+        return false;
+    return convert(full_sws_context_,
+                   cv::Size(current_->width, current_->height), full_image);
+}
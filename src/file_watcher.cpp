@@ -0,0 +1,327 @@
+#include "file_watcher.hpp"
+
+// std
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+
+// posix
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace {
+#ifdef __linux__
+// 覆盖写入、重命名替换、新建和删除
+constexpr uint32_t kinotify_mask = IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO |
+                                   IN_MOVED_FROM | IN_CREATE | IN_DELETE;
+#endif
+
+std::filesystem::file_time_type
+LastWriteTime(const std::filesystem::path &path) {
+    std::error_code error;
+    const auto time = std::filesystem::last_write_time(path, error);
+    return error ? std::filesystem::file_time_type() : time;
+}
+} // namespace
+
+FileWatcher::Handle &
+FileWatcher::Handle::operator=(Handle &&other) noexcept {
+    if (this != &other) {
+        reset();
+        watcher_ = std::move(other.watcher_);
+        id_ = other.id_;
+        other.watcher_ = nullptr;
+        other.id_ = -1;
+    }
+    return *this;
+}
+
+void FileWatcher::Handle::reset() {
+    if (watcher_ == nullptr)
+        return;
+    watcher_->unwatch(id_);
+    watcher_ = nullptr;
+    id_ = -1;
+}
+
+std::mutex &FileWatcher::SharedMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::shared_ptr<FileWatcher> FileWatcher::Shared() {
+    static std::weak_ptr<FileWatcher> shared;
+    std::lock_guard lock(SharedMutex());
+    auto watcher = shared.lock();
+    if (watcher == nullptr || !watcher->running_) {
+        watcher = std::make_shared<FileWatcher>();
+        shared = watcher;
+    }
+    return watcher;
+}
+
+FileWatcher::FileWatcher(std::chrono::milliseconds debounce,
+                         std::chrono::milliseconds poll_interval)
+    : debounce_(debounce), poll_interval_(poll_interval) {
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0)
+        std::cerr << "[FileWatcher->FileWatcher]:inotify不可用，"
+                     "改为定期检查修改时间\n";
+#endif
+    if (pipe(wake_fds_) == 0) {
+        for (const int fd : wake_fds_)
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    } else {
+        wake_fds_[0] = wake_fds_[1] = -1;
+    }
+    thread_ = std::thread([this] {
+        run();
+        const auto last_owner = std::move(last_owner_);
+    });
+}
+
+FileWatcher::~FileWatcher() {
+    running_ = false;
+    wake();
+    // 最后一个句柄在回调中释放时析构发生在监听线程自身
+    if (thread_.get_id() == std::this_thread::get_id())
+        thread_.detach();
+    else if (thread_.joinable())
+        thread_.join();
+    for (const int fd : {inotify_fd_, wake_fds_[0], wake_fds_[1]})
+        if (fd >= 0)
+            close(fd);
+}
+
+FileWatcher::Handle FileWatcher::watch(const std::string &file_path,
+                                       Callback callback) {
+    const auto path = std::filesystem::absolute(file_path);
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "[FileWatcher->watch]:<" << file_path << ">貌似不存在\n";
+        return Handle();
+    }
+    Watch watch;
+    if (std::filesystem::is_directory(path)) {
+        watch.dir = path;
+    } else {
+        watch.dir = path.parent_path();
+        watch.name = path.filename().string();
+    }
+    watch.callback = std::move(callback);
+    watch.last_write = LastWriteTime(path);
+#ifdef __linux__
+    // 同一文件夹重复添加返回同一个描述符
+    if (inotify_fd_ >= 0)
+        watch.wd = inotify_add_watch(inotify_fd_, watch.dir.c_str(),
+                                     kinotify_mask);
+#endif
+    int id = -1;
+    {
+        std::lock_guard lock(mutex_);
+        id = watch.id = next_id_++;
+        watches_.push_back(std::move(watch));
+    }
+    // 新的轮询项需要监听线程重新计算等待时间
+    wake();
+    return Handle(shared_from_this(), id);
+}
+
+void FileWatcher::unwatch(int id) {
+    {
+        std::lock_guard lock(mutex_);
+        const auto it =
+            std::find_if(watches_.begin(), watches_.end(),
+                         [id](const Watch &watch) { return watch.id == id; });
+        if (it == watches_.end())
+            return;
+        const int wd = it->wd;
+        watches_.erase(it);
+#ifdef __linux__
+        const bool wd_in_use =
+            std::any_of(watches_.begin(), watches_.end(),
+                        [wd](const Watch &watch) { return watch.wd == wd; });
+        if (wd >= 0 && !wd_in_use)
+            inotify_rm_watch(inotify_fd_, wd);
+#endif
+    }
+    // 在回调中注销自身时不能等待自己
+    if (std::this_thread::get_id() != thread_.get_id())
+        std::lock_guard dispatch_lock(dispatch_mutex_);
+}
+
+void FileWatcher::wake() {
+    if (wake_fds_[1] < 0)
+        return;
+    const char byte = 0;
+    [[maybe_unused]] const auto written = write(wake_fds_[1], &byte, 1);
+}
+
+int FileWatcher::pollTimeoutMs() {
+    std::lock_guard lock(mutex_);
+    const auto now = std::chrono::steady_clock::now();
+    auto timeout = std::chrono::milliseconds::max();
+    for (const auto &watch : watches_) {
+        if (watch.wd < 0)
+            timeout = std::min(timeout, poll_interval_);
+        if (watch.pending)
+            timeout = std::min(
+                timeout, std::max(std::chrono::ceil<std::chrono::milliseconds>(
+                                      watch.deadline - now),
+                                  std::chrono::milliseconds(0)));
+    }
+    return timeout == std::chrono::milliseconds::max()
+               ? -1
+               : static_cast<int>(timeout.count());
+}
+
+void FileWatcher::readEvents() {
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        const auto length = read(inotify_fd_, buffer, sizeof(buffer));
+        if (length <= 0)
+            return;
+        const auto deadline = std::chrono::steady_clock::now() + debounce_;
+        std::lock_guard lock(mutex_);
+        for (char *ptr = buffer; ptr < buffer + length;) {
+            const auto *event = reinterpret_cast<const inotify_event *>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+            for (auto &watch : watches_) {
+                // 队列溢出时无法知道丢了哪些事件，全部视为已修改
+                const bool overflow = event->mask & IN_Q_OVERFLOW;
+                const bool matched =
+                    watch.wd == event->wd &&
+                    (watch.name.empty() ||
+                     (event->len > 0 && watch.name == event->name));
+                if (!overflow && !matched)
+                    continue;
+                watch.pending = true;
+                watch.deadline = deadline;
+            }
+            // 文件夹被删除后改为轮询，从当前的修改时间开始比较，
+            // 否则第一次轮询总会与监听失效前记录的时间不同
+            if (event->mask & IN_IGNORED) {
+                for (auto &watch : watches_) {
+                    if (watch.wd != event->wd)
+                        continue;
+                    watch.wd = -1;
+                    watch.last_write = LastWriteTime(
+                        watch.name.empty() ? watch.dir
+                                           : watch.dir / watch.name);
+                }
+            }
+        }
+    }
+#endif
+}
+
+void FileWatcher::pollFiles() {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard lock(mutex_);
+    for (auto &watch : watches_) {
+        if (watch.wd >= 0)
+            continue;
+        // 文件夹的修改时间在其中的文件新建、删除或重命名时改变
+        const auto last_write = LastWriteTime(
+            watch.name.empty() ? watch.dir : watch.dir / watch.name);
+        if (last_write == watch.last_write)
+            continue;
+        watch.last_write = last_write;
+        watch.pending = true;
+        watch.deadline = now + debounce_;
+    }
+}
+
+void FileWatcher::dispatch() {
+    std::unique_lock dispatch_lock(dispatch_mutex_);
+    std::vector<Callback> callbacks;
+    {
+        const auto now = std::chrono::steady_clock::now();
+        std::lock_guard lock(mutex_);
+        for (auto &watch : watches_) {
+            if (!watch.pending || watch.deadline > now)
+                continue;
+            watch.pending = false;
+            callbacks.push_back(watch.callback);
+        }
+    }
+    if (callbacks.empty())
+        return;
+    // 回调中可以注册或注销监听
+    auto self = shared_from_this();
+    for (const auto &callback : callbacks)
+        callback();
+    dispatch_lock.unlock();
+    std::lock_guard shared_lock(SharedMutex());
+    if (self.use_count() == 1) {
+        running_ = false;
+        last_owner_ = std::move(self);
+    }
+}
+
+void FileWatcher::run() {
+    while (running_) {
+        pollfd fds[2] = {{wake_fds_[0], POLLIN, 0}, {inotify_fd_, POLLIN, 0}};
+        const nfds_t fd_count = inotify_fd_ >= 0 ? 2 : 1;
+        // 没有唤醒管道时退化为固定间隔
+        const int timeout = wake_fds_[0] >= 0
+                                ? pollTimeoutMs()
+                                : static_cast<int>(poll_interval_.count());
+        if (poll(fds, fd_count, timeout) < 0 && errno != EINTR)
+            break;
+        if (fds[0].revents & POLLIN) {
+            char buffer[64];
+            while (read(wake_fds_[0], buffer, sizeof(buffer)) > 0)
+                ;
+        }
+        if (!running_)
+            break;
+        if (fd_count == 2 && (fds[1].revents & POLLIN))
+            readEvents();
+        pollFiles();
+        dispatch();
+    }
+}
+
+AsyncWatch::AsyncWatch(const std::string &file_path,
+                       FileWatcher::Callback callback)
+    : callback_(std::move(callback)), thread_(&AsyncWatch::run, this) {
+    handle_ = FileWatcher::Shared()->watch(file_path, [this] { request(); });
+}
+
+AsyncWatch::~AsyncWatch() {
+    // 先注销监听，之后不会再有新的请求
+    handle_.reset();
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_one();
+    thread_.join();
+}
+
+void AsyncWatch::request() {
+    {
+        std::lock_guard lock(mutex_);
+        pending_ = true;
+    }
+    condition_.notify_one();
+}
+
+void AsyncWatch::run() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        condition_.wait(lock, [this] { return pending_ || stop_; });
+        if (stop_)
+            return;
+        pending_ = false;
+        lock.unlock();
+        callback_();
+        lock.lock();
+    }
+}
@@ -0,0 +1,448 @@
+#include "gallery.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GALLERY_X86 1
+#endif
+
+AlignedFloatPtr AllocAlignedFloats(size_t count) {
+    // aligned_alloc要求大小为对齐的整数倍
+    size_t bytes = std::max<size_t>(count * sizeof(float), 64);
+    bytes = (bytes + 63) / 64 * 64;
+    auto *ptr = static_cast<float *>(std::aligned_alloc(64, bytes));
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return AlignedFloatPtr(ptr);
+}
+
+void NormalizeFeature(const float *src, int dim, int stride, float *dst) {
+    double sum = 0.0;
+    for (int i = 0; i < dim; ++i)
+        sum += static_cast<double>(src[i]) * src[i];
+    const float inv =
+        sum > 0.0 ? static_cast<float>(1.0 / std::sqrt(sum)) : 0.f;
+    for (int i = 0; i < dim; ++i)
+        dst[i] = src[i] * inv;
+    for (int i = dim; i < stride; ++i)
+        dst[i] = 0.f;
+}
+
+namespace {
+
+float DotScalar(const float *a, const float *b, int n) {
+    float acc[4] = {0.f, 0.f, 0.f, 0.f};
+    for (int i = 0; i < n; i += 4) {
+        acc[0] += a[i] * b[i];
+        acc[1] += a[i + 1] * b[i + 1];
+        acc[2] += a[i + 2] * b[i + 2];
+        acc[3] += a[i + 3] * b[i + 3];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+#ifdef GALLERY_X86
+__attribute__((target("avx2,fma"))) float DotAvx2(const float *a,
+                                                  const float *b, int n) {
+    // a为特征库行（64字节对齐），b为查询向量
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (int i = 0; i < n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_load_ps(a + i), _mm256_loadu_ps(b + i),
+                               acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_load_ps(a + i + 8),
+                               _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    const __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc),
+                            _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx512f"))) float DotAvx512(const float *a,
+                                                   const float *b, int n) {
+    __m512 acc = _mm512_setzero_ps();
+    for (int i = 0; i < n; i += 16)
+        acc = _mm512_fmadd_ps(_mm512_load_ps(a + i), _mm512_loadu_ps(b + i),
+                              acc);
+    return _mm512_reduce_add_ps(acc);
+}
+#endif
+
+struct DotDispatch {
+    DotProductFunc func = DotScalar;
+    const char *isa = "scalar";
+
+    DotDispatch() {
+#ifdef GALLERY_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            func = DotAvx512;
+            isa = "avx512";
+        } else if (__builtin_cpu_supports("avx2") &&
+                   __builtin_cpu_supports("fma")) {
+            func = DotAvx2;
+            isa = "avx2";
+        }
+#endif
+    }
+};
+
+const DotDispatch &GetDotDispatch() {
+    static const DotDispatch dispatch;
+    return dispatch;
+}
+
+// 上界的余量，避免浮点误差剪掉真正的候选
+constexpr float kbound_slack = 1e-4f;
+
+// 候选已满且不优于最差的候选时不需要插入
+inline bool Rejected(const GallerySearchResult &result, size_t top_k,
+                     float cosine) {
+    return result.candidates.size() >= top_k &&
+           cosine <= result.candidates.back().score;
+}
+
+} // namespace
+
+void ResetSearchResults(std::vector<GallerySearchResult> &results,
+                        size_t count) {
+    results.resize(count);
+    for (auto &result : results)
+        result.candidates.clear();
+    return;
+}
+
+void CosinesToScores(std::vector<GallerySearchResult> &results,
+                     cv::FaceRecognizerSF::DisType distance_type) {
+    for (auto &result : results)
+        for (auto &candidate : result.candidates)
+            candidate.score = CosineToScore(candidate.score, distance_type);
+    return;
+}
+
+float DotProduct(const float *a, const float *b, int n) {
+    return GetDotDispatch().func(a, b, n);
+}
+
+DotProductFunc GetDotProductFunc() { return GetDotDispatch().func; }
+
+DotProductFunc GetDotProductFunc(std::string_view isa) {
+    if (isa == "scalar")
+        return DotScalar;
+#ifdef GALLERY_X86
+    __builtin_cpu_init();
+    if (isa == "avx512" && __builtin_cpu_supports("avx512f"))
+        return DotAvx512;
+    if (isa == "avx2" && __builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("fma"))
+        return DotAvx2;
+#endif
+    return nullptr;
+}
+
+const char *DotProductIsa() { return GetDotDispatch().isa; }
+
+Gallery::Gallery(Gallery &&other) noexcept { *this = std::move(other); }
+
+Gallery &Gallery::operator=(Gallery &&other) noexcept {
+    if (this == &other)
+        return *this;
+    storage_ = std::move(other.storage_);
+    capacity_ = std::exchange(other.capacity_, 0);
+    owned_name_offsets_ = std::move(other.owned_name_offsets_);
+    owned_name_data_ = std::move(other.owned_name_data_);
+    holder_ = std::move(other.holder_);
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    dim_ = std::exchange(other.dim_, 0);
+    stride_ = std::exchange(other.stride_, 0);
+    if (holder_) {
+        name_offsets_ = other.name_offsets_;
+        name_data_ = other.name_data_;
+    } else {
+        syncNamePointers();
+    }
+    other.owned_name_offsets_.assign(1, 0);
+    other.owned_name_data_.clear();
+    other.syncNamePointers();
+    return *this;
+}
+
+Gallery Gallery::clone() const {
+    Gallery copy;
+    copy.size_ = size_;
+    copy.dim_ = dim_;
+    copy.stride_ = stride_;
+    if (holder_) {
+        copy.holder_ = holder_;
+        copy.data_ = data_;
+        copy.name_offsets_ = name_offsets_;
+        copy.name_data_ = name_data_;
+        return copy;
+    }
+    copy.owned_name_offsets_ = owned_name_offsets_;
+    copy.owned_name_data_ = owned_name_data_;
+    copy.syncNamePointers();
+    if (size_ > 0) {
+        copy.storage_ = AllocAlignedFloats(size_ * stride_);
+        std::memcpy(copy.storage_.get(), data_,
+                    size_ * stride_ * sizeof(float));
+        copy.data_ = copy.storage_.get();
+        copy.capacity_ = size_;
+    }
+    return copy;
+}
+
+void Gallery::syncNamePointers() {
+    name_offsets_ = owned_name_offsets_.data();
+    name_data_ = owned_name_data_.data();
+}
+
+void Gallery::grow(size_t capacity) {
+    if (capacity <= capacity_)
+        return;
+    auto storage = AllocAlignedFloats(capacity * stride_);
+    if (size_ > 0)
+        std::memcpy(storage.get(), data_, size_ * stride_ * sizeof(float));
+    storage_ = std::move(storage);
+    data_ = storage_.get();
+    capacity_ = capacity;
+}
+
+void Gallery::detach() {
+    if (!holder_)
+        return;
+    // 复制外部数据，之后可以修改
+    owned_name_offsets_.assign(name_offsets_, name_offsets_ + size_ + 1);
+    owned_name_data_.assign(name_data_, name_offsets_[size_]);
+    capacity_ = 0;
+    grow(std::max<size_t>(size_, 16));
+    holder_.reset();
+    syncNamePointers();
+}
+
+void Gallery::attach(std::shared_ptr<const void> holder, int dim, int stride,
+                     size_t count, const float *features,
+                     const uint64_t *name_offsets, const char *name_data) {
+    clear();
+    storage_.reset();
+    capacity_ = 0;
+    holder_ = std::move(holder);
+    dim_ = dim;
+    stride_ = stride;
+    size_ = count;
+    data_ = features;
+    name_offsets_ = name_offsets;
+    name_data_ = name_data;
+}
+
+void Gallery::reserve(size_t capacity) {
+    detach();
+    owned_name_offsets_.reserve(capacity + 1);
+    syncNamePointers();
+    // 维度未知时只预留名字
+    if (stride_ > 0)
+        grow(capacity);
+}
+
+size_t Gallery::add(const std::string &name, const cv::Mat &feature) {
+    CV_Assert(feature.type() == CV_32F && feature.isContinuous());
+    const int dim = static_cast<int>(feature.total());
+    detach();
+    if (dim_ == 0) {
+        dim_ = dim;
+        stride_ = (dim + kstride_align - 1) / kstride_align * kstride_align;
+        grow(std::max<size_t>(owned_name_offsets_.capacity(), 16));
+    }
+    CV_Assert(dim == dim_);
+    if (size_ == capacity_)
+        grow(std::max<size_t>(capacity_ * 2, 16));
+    NormalizeFeature(feature.ptr<float>(), dim_, stride_,
+                     storage_.get() + size_ * stride_);
+    owned_name_data_ += name;
+    owned_name_offsets_.push_back(owned_name_data_.size());
+    syncNamePointers();
+    return size_++;
+}
+
+size_t Gallery::removeIf(const std::function<bool(size_t)> &pred) {
+    detach();
+    std::string name_data;
+    name_data.reserve(owned_name_data_.size());
+    size_t kept = 0;
+    for (size_t i = 0; i < size_; ++i) {
+        if (pred(i))
+            continue;
+        if (kept != i)
+            std::memcpy(storage_.get() + kept * stride_, data_ + i * stride_,
+                        stride_ * sizeof(float));
+        name_data += name(i);
+        owned_name_offsets_[++kept] = name_data.size();
+    }
+    const size_t removed = size_ - kept;
+    owned_name_data_ = std::move(name_data);
+    owned_name_offsets_.resize(kept + 1);
+    size_ = kept;
+    syncNamePointers();
+    return removed;
+}
+
+void Gallery::clear() {
+    if (holder_) {
+        holder_.reset();
+        data_ = storage_.get();
+    }
+    owned_name_offsets_.assign(1, 0);
+    owned_name_data_.clear();
+    syncNamePointers();
+    size_ = 0;
+    return;
+}
+
+void Gallery::packQueries(const cv::Mat &queries, cv::Mat &packed) const {
+    packed.create(queries.rows, std::max(stride_, 1), CV_32F);
+    if (queries.empty() || empty())
+        return;
+    CV_Assert(queries.type() == CV_32F && queries.cols == dim_);
+    for (int i = 0; i < queries.rows; ++i)
+        NormalizeFeature(queries.ptr<float>(i), dim_, stride_,
+                         packed.ptr<float>(i));
+    return;
+}
+
+void Gallery::insertCandidate(GallerySearchResult &result, int top_k,
+                              int index, float cosine) const {
+    InsertCandidate(result, top_k, index, cosine,
+                    [this](int row) { return name(row); });
+    return;
+}
+
+void Gallery::search(const cv::Mat &packed_queries,
+                     cv::FaceRecognizerSF::DisType distance_type, int top_k,
+                     std::vector<GallerySearchResult> &results) const {
+    const int query_count = packed_queries.rows;
+    ResetSearchResults(results, query_count);
+    if (empty() || query_count == 0)
+        return;
+
+    // 查询矩阵很小，常驻缓存；特征库只顺序扫描一遍
+    const auto dot = GetDotDispatch().func;
+    const auto k = static_cast<size_t>(std::max(top_k, 1));
+    const size_t rows = size_;
+    for (size_t r = 0; r < rows; ++r) {
+        const float *target = row(r);
+        for (int q = 0; q < query_count; ++q) {
+            const float cosine =
+                dot(target, packed_queries.ptr<float>(q), stride_);
+            // 绝大多数行在这里被排除，不进入插入逻辑
+            if (!Rejected(results[q], k, cosine))
+                insertCandidate(results[q], top_k, static_cast<int>(r),
+                                cosine);
+        }
+    }
+    CosinesToScores(results, distance_type);
+    return;
+}
+
+IdentityCentroids::IdentityCentroids(const Gallery &gallery)
+    : stride_(gallery.stride()) {
+    // 按名字分组，身份按首次出现的顺序编号
+    std::unordered_map<std::string_view, uint32_t> identity_ids;
+    std::vector<uint32_t> identity_of(gallery.size());
+    std::vector<uint32_t> counts;
+    for (size_t r = 0; r < gallery.size(); ++r) {
+        const auto [it, inserted] = identity_ids.emplace(
+            gallery.name(r), static_cast<uint32_t>(counts.size()));
+        if (inserted)
+            counts.push_back(0);
+        identity_of[r] = it->second;
+        ++counts[it->second];
+    }
+    const size_t identity_count = counts.size();
+    member_offsets_.assign(identity_count + 1, 0);
+    for (size_t i = 0; i < identity_count; ++i)
+        member_offsets_[i + 1] = member_offsets_[i] + counts[i];
+    members_.resize(gallery.size());
+    std::vector<uint32_t> next(member_offsets_.begin(),
+                               member_offsets_.end() - 1);
+    for (size_t r = 0; r < gallery.size(); ++r)
+        members_[next[identity_of[r]]++] = static_cast<uint32_t>(r);
+
+    // 中心为成员之和归一化，半径为成员与中心的最大夹角
+    const auto dot = GetDotDispatch().func;
+    centroids_ = AllocAlignedFloats(identity_count * stride_);
+    max_angles_.assign(identity_count, 0.f);
+    std::vector<float> sum(stride_);
+    for (size_t i = 0; i < identity_count; ++i) {
+        std::fill(sum.begin(), sum.end(), 0.f);
+        for (auto m = member_offsets_[i]; m < member_offsets_[i + 1]; ++m) {
+            const float *target = gallery.row(members_[m]);
+            for (int c = 0; c < stride_; ++c)
+                sum[c] += target[c];
+        }
+        float *centroid = centroids_.get() + i * stride_;
+        NormalizeFeature(sum.data(), gallery.dim(), stride_, centroid);
+        for (auto m = member_offsets_[i]; m < member_offsets_[i + 1]; ++m) {
+            const float cosine =
+                dot(gallery.row(members_[m]), centroid, stride_);
+            max_angles_[i] = std::max(
+                max_angles_[i], std::acos(std::clamp(cosine, -1.f, 1.f)));
+        }
+    }
+}
+
+void IdentityCentroids::search(
+    const Gallery &gallery, const cv::Mat &packed_queries,
+    cv::FaceRecognizerSF::DisType distance_type, int top_k,
+    std::vector<GallerySearchResult> &results) const {
+    const int query_count = packed_queries.rows;
+    ResetSearchResults(results, query_count);
+    if (size() == 0 || query_count == 0)
+        return;
+
+    const auto dot = GetDotDispatch().func;
+    const auto k = static_cast<size_t>(std::max(top_k, 1));
+    // 每个身份的相似度上界及身份号，复用内存
+    static thread_local std::vector<std::pair<float, uint32_t>> bounds;
+    bounds.resize(size());
+    for (int q = 0; q < query_count; ++q) {
+        const float *query = packed_queries.ptr<float>(q);
+        for (size_t i = 0; i < size(); ++i) {
+            const float cosine =
+                dot(centroids_.get() + i * stride_, query, stride_);
+            const float angle = std::acos(std::clamp(cosine, -1.f, 1.f));
+            bounds[i] = {std::cos(std::max(angle - max_angles_[i], 0.f)) +
+                             kbound_slack,
+                         static_cast<uint32_t>(i)};
+        }
+        std::sort(bounds.begin(), bounds.end(), std::greater<>());
+        auto &result = results[q];
+        for (const auto &[bound, i] : bounds) {
+            // 之后的身份都不可能进入前k
+            if (Rejected(result, k, bound))
+                break;
+            int best_row = -1;
+            float best_cosine = -2.f;
+            for (auto m = member_offsets_[i]; m < member_offsets_[i + 1];
+                 ++m) {
+                const float cosine = dot(gallery.row(members_[m]), query,
+                                         stride_);
+                if (cosine > best_cosine) {
+                    best_cosine = cosine;
+                    best_row = static_cast<int>(members_[m]);
+                }
+            }
+            gallery.insertCandidate(result, top_k, best_row, best_cosine);
+        }
+    }
+    CosinesToScores(results, distance_type);
+    return;
+}
@@ -0,0 +1,247 @@
+#include "gallery_file.hpp"
+
+// std
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// posix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// custom
+#include "detector.hpp"
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &file_path) {
+    const int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    const auto size = static_cast<size_t>(st.st_size);
+    // MAP_SHARED只读映射，多个进程共享同一份页缓存
+    void *addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return nullptr;
+    return std::shared_ptr<MappedFile>(
+        new MappedFile(static_cast<const uint8_t *>(addr), size));
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr)
+        ::munmap(const_cast<uint8_t *>(data_), size_);
+}
+
+uint64_t HashFile(const std::string &file_path, uint64_t hash) {
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file.is_open())
+        return hash;
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        const auto count = file.gcount();
+        for (std::streamsize i = 0; i < count; ++i) {
+            hash ^= static_cast<uint8_t>(buffer[i]);
+            hash *= 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+uint64_t ModelHash(const std::string &yunet_model_path,
+                   const std::string &sface_model_path) {
+    return HashFile(sface_model_path, HashFile(yunet_model_path));
+}
+
+namespace {
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t hash) {
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+/**
+ * @brief 文件各部分的偏移
+ *
+ */
+struct GalleryLayout {
+    uint64_t names_offset = sizeof(GalleryFileHeader);
+    uint64_t names_bytes = 0;
+    uint64_t features_offset = 0;
+    uint64_t file_size = 0;
+};
+
+GalleryLayout GetGalleryLayout(const Gallery &gallery) {
+    const uint64_t count = gallery.size();
+    GalleryLayout layout;
+    layout.names_bytes =
+        (count + 1) * sizeof(uint64_t) + gallery.nameOffsets()[count];
+    layout.features_offset =
+        AlignUp(layout.names_offset + layout.names_bytes, 64);
+    layout.file_size = layout.features_offset +
+                       count * gallery.stride() * sizeof(float);
+    return layout;
+}
+} // namespace
+
+uint64_t HashGallery(const Gallery &gallery) {
+    const uint64_t count = gallery.size();
+    uint64_t hash = HashBytes(&count, sizeof(count), 0xcbf29ce484222325ull);
+    hash = HashBytes(gallery.nameOffsets(), (count + 1) * sizeof(uint64_t),
+                     hash);
+    hash = HashBytes(gallery.nameData(), gallery.nameOffsets()[count], hash);
+    if (count > 0)
+        hash = HashBytes(gallery.data(),
+                         count * gallery.stride() * sizeof(float), hash);
+    return hash;
+}
+
+uint64_t GalleryFileSize(const Gallery &gallery) {
+    return GetGalleryLayout(gallery).file_size;
+}
+
+bool SaveGallery(const std::string &file_path, const Gallery &gallery,
+                 uint64_t model_hash) {
+    const uint64_t count = gallery.size();
+    GalleryFileHeader header{};
+    std::memcpy(header.magic, kgallery_magic, sizeof(header.magic));
+    header.version = kgallery_version;
+    header.dim = static_cast<uint32_t>(gallery.dim());
+    header.stride = static_cast<uint32_t>(gallery.stride());
+    header.count = count;
+    header.model_hash = model_hash;
+    const auto layout = GetGalleryLayout(gallery);
+    const uint64_t names_bytes = layout.names_bytes;
+    header.names_offset = layout.names_offset;
+    header.features_offset = layout.features_offset;
+    header.file_size = layout.file_size;
+
+    const auto tmp_path = file_path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "[SaveGallery]:打开<" << tmp_path << ">失败\n";
+            return false;
+        }
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(gallery.nameOffsets()),
+                   static_cast<std::streamsize>((count + 1) *
+                                                sizeof(uint64_t)));
+        file.write(gallery.nameData(),
+                   static_cast<std::streamsize>(gallery.nameOffsets()[count]));
+        const std::vector<char> padding(
+            header.features_offset - header.names_offset - names_bytes, 0);
+        file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        if (count > 0)
+            file.write(reinterpret_cast<const char *>(gallery.data()),
+                       static_cast<std::streamsize>(count * gallery.stride() *
+                                                    sizeof(float)));
+        if (!file.good()) {
+            std::cerr << "[SaveGallery]:写入<" << tmp_path << ">失败\n";
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, file_path, ec);
+    if (ec) {
+        std::cerr << "[SaveGallery]:重命名<" << tmp_path << ">失败:"
+                  << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool LoadGallery(const std::string &file_path, uint64_t model_hash,
+                 Gallery &gallery) {
+    auto mapped_file = MappedFile::open(file_path);
+    if (!mapped_file)
+        return false;
+    if (mapped_file->size() < sizeof(GalleryFileHeader)) {
+        std::cerr << "[LoadGallery]:<" << file_path << ">文件过小\n";
+        return false;
+    }
+    const auto *header =
+        reinterpret_cast<const GalleryFileHeader *>(mapped_file->data());
+    if (std::memcmp(header->magic, kgallery_magic, sizeof(kgallery_magic)) !=
+            0 ||
+        header->version != kgallery_version) {
+        std::cerr << "[LoadGallery]:<" << file_path << ">格式或版本不匹配\n";
+        return false;
+    }
+    if (header->model_hash != model_hash) {
+        std::cerr << "[LoadGallery]:<" << file_path
+                  << ">与当前模型不一致，需要重新录入\n";
+        return false;
+    }
+    const uint64_t count = header->count;
+    // 各部分的大小和结束位置，count等字段可能被篡改，溢出即视为损坏
+    uint64_t offsets_bytes = 0, names_end = 0;
+    uint64_t features_bytes = 0, features_end = 0;
+    const bool sizes_valid =
+        !__builtin_add_overflow(count, 1, &offsets_bytes) &&
+        !__builtin_mul_overflow(offsets_bytes, sizeof(uint64_t),
+                                &offsets_bytes) &&
+        !__builtin_add_overflow(header->names_offset, offsets_bytes,
+                                &names_end) &&
+        !__builtin_mul_overflow(count, header->stride * sizeof(float),
+                                &features_bytes) &&
+        !__builtin_add_overflow(header->features_offset, features_bytes,
+                                &features_end);
+    if (!sizes_valid || header->file_size != mapped_file->size() ||
+        header->names_offset < sizeof(GalleryFileHeader) ||
+        header->names_offset % sizeof(uint64_t) != 0 ||
+        header->features_offset % 64 != 0 ||
+        header->stride % Gallery::kstride_align != 0 ||
+        header->dim > header->stride || names_end > header->features_offset ||
+        features_end != header->file_size) {
+        std::cerr << "[LoadGallery]:<" << file_path << ">文件已损坏\n";
+        return false;
+    }
+    // 维度与SFace不一致时匹配会在识别线程中断言失败
+    if (count > 0 && static_cast<int>(header->dim) != SFace::kfeature_dim) {
+        std::cerr << "[LoadGallery]:<" << file_path << ">特征维度为"
+                  << header->dim << "，应为" << SFace::kfeature_dim << "\n";
+        return false;
+    }
+    const auto *name_offsets = reinterpret_cast<const uint64_t *>(
+        mapped_file->data() + header->names_offset);
+    // 每个名字都必须落在名字区内，偏移单调不减
+    const uint64_t name_bytes = header->features_offset - names_end;
+    bool names_valid = name_offsets[0] == 0;
+    for (uint64_t i = 0; names_valid && i < count; ++i)
+        names_valid = name_offsets[i] <= name_offsets[i + 1] &&
+                      name_offsets[i + 1] <= name_bytes;
+    if (!names_valid) {
+        std::cerr << "[LoadGallery]:<" << file_path << ">名字表已损坏\n";
+        return false;
+    }
+    const auto *name_data =
+        reinterpret_cast<const char *>(mapped_file->data() + names_end);
+    const auto *features = reinterpret_cast<const float *>(
+        mapped_file->data() + header->features_offset);
+    const int dim = static_cast<int>(header->dim);
+    const int stride = static_cast<int>(header->stride);
+    gallery.attach(std::move(mapped_file), dim, stride, count, features,
+                   name_offsets, name_data);
+    return true;
+}
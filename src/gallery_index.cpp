@@ -0,0 +1,240 @@
+#include "gallery_index.hpp"
+
+// std
+#include <utility>
+
+// custom
+#include "gallery_file.hpp"
+#include "hnsw_index.hpp"
+
+cv::Ptr<GalleryIndex> BruteForceIndex::create() const {
+    return cv::makePtr<BruteForceIndex>();
+}
+
+cv::Ptr<GalleryIndex> BruteForceIndex::clone() const {
+    auto index = cv::makePtr<BruteForceIndex>();
+    index->gallery_ = gallery_.clone();
+    // 身份中心只读，副本修改前可以共享
+    index->centroids_ = centroids_;
+    return index;
+}
+
+void BruteForceIndex::add(const std::string &name, const cv::Mat &feature) {
+    gallery_.add(name, feature);
+    centroids_.reset();
+    return;
+}
+
+size_t BruteForceIndex::remove(std::string_view name) {
+    centroids_.reset();
+    return gallery_.removeIf([&](size_t i) { return gallery_.name(i) == name; });
+}
+
+void BruteForceIndex::clear() {
+    gallery_.clear();
+    centroids_.reset();
+    return;
+}
+
+void BruteForceIndex::search(const cv::Mat &packed_queries,
+                             cv::FaceRecognizerSF::DisType distance_type,
+                             const GallerySearchParams &params,
+                             std::vector<GallerySearchResult> &results) const {
+    if (params.centroid_pruning && centroids_ != nullptr) {
+        centroids_->search(gallery_, packed_queries, distance_type,
+                           params.top_k, results);
+        return;
+    }
+    gallery_.search(packed_queries, distance_type, params.top_k, results);
+    return;
+}
+
+void BruteForceIndex::prepare() {
+    if (centroids_ == nullptr)
+        centroids_ = std::make_shared<const IdentityCentroids>(gallery_);
+    return;
+}
+
+bool BruteForceIndex::save(const std::string &file_path,
+                           uint64_t model_hash) const {
+    return SaveGallery(file_path, gallery_, model_hash);
+}
+
+bool BruteForceIndex::load(const std::string &file_path, uint64_t model_hash) {
+    centroids_.reset();
+    return LoadGallery(file_path, model_hash, gallery_);
+}
+
+OverlayIndex::OverlayIndex(cv::Ptr<GalleryIndex> base) {
+    setBase(std::move(base));
+}
+
+void OverlayIndex::setBase(cv::Ptr<GalleryIndex> base) {
+    // 统计一次基础索引的名字，之后派生的版本共享
+    auto names = std::make_shared<NameCounts>();
+    const auto &base_gallery = base->gallery();
+    for (size_t i = 0; i < base_gallery.size(); ++i)
+        if (base->isLive(i))
+            ++(*names)[std::string(base_gallery.name(i))];
+    base_ = std::move(base);
+    base_names_ = std::move(names);
+    removed_.clear();
+    removed_rows_ = 0;
+    gallery_.clear();
+}
+
+cv::Ptr<OverlayIndex> OverlayIndex::Derive(const cv::Ptr<GalleryIndex> &index) {
+    const auto *overlay = dynamic_cast<const OverlayIndex *>(index.get());
+    if (overlay == nullptr)
+        return cv::Ptr<OverlayIndex>(new OverlayIndex(index));
+    return overlay->copy();
+}
+
+cv::Ptr<OverlayIndex> OverlayIndex::copy() const {
+    // 基础索引和名字统计共享，只复制叠加部分
+    auto overlay = cv::Ptr<OverlayIndex>(new OverlayIndex());
+    overlay->base_ = base_;
+    overlay->base_names_ = base_names_;
+    overlay->removed_ = removed_;
+    overlay->removed_rows_ = removed_rows_;
+    overlay->gallery_ = gallery_.clone();
+    return overlay;
+}
+
+cv::Ptr<GalleryIndex> OverlayIndex::clone() const { return copy(); }
+
+void OverlayIndex::compact() {
+    if (gallery_.size() + removed_.size() <= kmax_overlay)
+        return;
+    setBase(flatten());
+    return;
+}
+
+cv::Ptr<GalleryIndex> OverlayIndex::flatten() const {
+    auto index = base_->clone();
+    for (const auto &name : removed_)
+        index->remove(name);
+    index->reserve(index->gallery().size() + gallery_.size());
+    for (size_t i = 0; i < gallery_.size(); ++i) {
+        // 特征已归一化，按原维度再加入一次结果不变
+        const cv::Mat feature(1, gallery_.dim(), CV_32F,
+                              const_cast<float *>(gallery_.row(i)));
+        index->add(std::string(gallery_.name(i)), feature);
+    }
+    return index;
+}
+
+void OverlayIndex::add(const std::string &name, const cv::Mat &feature) {
+    const int base_dim = base_->gallery().dim();
+    CV_Assert(base_dim == 0 || static_cast<int>(feature.total()) == base_dim);
+    gallery_.add(name, feature);
+    return;
+}
+
+size_t OverlayIndex::remove(std::string_view name) {
+    size_t removed =
+        gallery_.removeIf([&](size_t i) { return gallery_.name(i) == name; });
+    if (removed_.find(name) != removed_.end())
+        return removed;
+    const auto it = base_names_->find(name);
+    if (it == base_names_->end())
+        return removed;
+    removed_.emplace(name);
+    removed_rows_ += it->second;
+    return removed + it->second;
+}
+
+void OverlayIndex::clear() {
+    setBase(base_->create());
+    return;
+}
+
+void OverlayIndex::reserve(size_t capacity) {
+    const size_t current = size();
+    if (capacity > current)
+        gallery_.reserve(gallery_.size() + capacity - current);
+    return;
+}
+
+void OverlayIndex::packQueries(const cv::Mat &queries, cv::Mat &packed) const {
+    if (base_->gallery().dim() > 0)
+        base_->packQueries(queries, packed);
+    else
+        gallery_.packQueries(queries, packed);
+    return;
+}
+
+std::string_view OverlayIndex::name(int index) const {
+    const auto base_rows = static_cast<int>(baseRows());
+    return index < base_rows ? base_->name(index)
+                             : gallery_.name(index - base_rows);
+}
+
+bool OverlayIndex::isLive(size_t row) const {
+    const size_t base_rows = baseRows();
+    if (row >= base_rows)
+        return row - base_rows < gallery_.size();
+    return base_->isLive(row) &&
+           removed_.find(base_->name(static_cast<int>(row))) ==
+               removed_.end();
+}
+
+void OverlayIndex::search(const cv::Mat &packed_queries,
+                          cv::FaceRecognizerSF::DisType distance_type,
+                          const GallerySearchParams &params,
+                          std::vector<GallerySearchResult> &results) const {
+    // 每个被删除的名字最多占一个候选，多取这么多个再过滤，结果不受影响
+    auto base_params = params;
+    base_params.top_k = params.top_k + static_cast<int>(removed_.size());
+    base_->search(packed_queries, cv::FaceRecognizerSF::DisType::FR_COSINE,
+                  base_params, results);
+    const auto k = static_cast<size_t>(std::max(params.top_k, 1));
+    for (auto &result : results) {
+        if (!removed_.empty())
+            std::erase_if(result.candidates,
+                          [this](const GalleryCandidate &candidate) {
+                              return removed_.find(base_->name(
+                                         candidate.index)) != removed_.end();
+                          });
+        if (result.candidates.size() > k)
+            result.candidates.resize(k);
+    }
+    if (!gallery_.empty()) {
+        // 新增的目标很少，顺序扫描后按名字与基础索引的候选合并
+        static thread_local std::vector<GallerySearchResult> overlay_results;
+        gallery_.search(packed_queries,
+                        cv::FaceRecognizerSF::DisType::FR_COSINE, params.top_k,
+                        overlay_results);
+        const auto base_rows = static_cast<int>(baseRows());
+        const auto name_of = [this](int index) { return name(index); };
+        for (size_t q = 0; q < results.size(); ++q)
+            for (const auto &candidate : overlay_results[q].candidates)
+                InsertCandidate(results[q], params.top_k,
+                                base_rows + candidate.index, candidate.score,
+                                name_of);
+    }
+    CosinesToScores(results, distance_type);
+    return;
+}
+
+bool OverlayIndex::save(const std::string &file_path,
+                        uint64_t model_hash) const {
+    if (gallery_.empty() && removed_.empty())
+        return base_->save(file_path, model_hash);
+    return flatten()->save(file_path, model_hash);
+}
+
+bool OverlayIndex::load(const std::string &file_path, uint64_t model_hash) {
+    auto index = base_->create();
+    if (!index->load(file_path, model_hash))
+        return false;
+    setBase(std::move(index));
+    return true;
+}
+
+cv::Ptr<GalleryIndex> CreateGalleryIndex(int index_type,
+                                         const HnswParams &hnsw_params) {
+    if (index_type == khnsw_index)
+        return cv::makePtr<HnswIndex>(hnsw_params);
+    return cv::makePtr<BruteForceIndex>();
+}
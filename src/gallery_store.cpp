@@ -0,0 +1,95 @@
+#include "gallery_store.hpp"
+
+// std
+#include <algorithm>
+#include <thread>
+
+GalleryStore::Snapshot &
+GalleryStore::Snapshot::operator=(Snapshot &&other) noexcept {
+    if (this != &other) {
+        release();
+        slot_ = std::exchange(other.slot_, nullptr);
+        version_ = other.version_;
+    }
+    return *this;
+}
+
+void GalleryStore::Snapshot::release() {
+    if (slot_ == nullptr)
+        return;
+    slot_->store(0, std::memory_order_release);
+    slot_ = nullptr;
+}
+
+GalleryStore::GalleryStore(cv::Ptr<GalleryIndex> index) {
+    index->prepare();
+    current_owner_ = std::make_unique<const Version>(Version{index, 0});
+    current_.store(current_owner_.get());
+}
+
+GalleryStore::~GalleryStore() = default;
+
+GalleryStore::Snapshot GalleryStore::acquire() const {
+    // 从上次使用的位置开始找空位，同一线程通常一次命中
+    thread_local size_t hint = 0;
+    while (true) {
+        for (size_t i = 0; i < kmax_readers; ++i) {
+            const size_t index = (hint + i) % kmax_readers;
+            auto &slot = slots_[index].epoch;
+            if (slot.load(std::memory_order_relaxed) != 0)
+                continue;
+            // 先登记纪元再读取版本，写者回收时一定能看到这次登记
+            uint64_t idle = 0;
+            if (!slot.compare_exchange_strong(idle, epoch_.load()))
+                continue;
+            hint = index;
+            return Snapshot(&slot, current_.load());
+        }
+        std::this_thread::yield();
+    }
+}
+
+uint64_t GalleryStore::publish(cv::Ptr<GalleryIndex> index) {
+    std::lock_guard lock(writer_mutex_);
+    return publishLocked(std::move(index));
+}
+
+uint64_t GalleryStore::publishLocked(cv::Ptr<GalleryIndex> index) {
+    // 辅助结构在写者线程构建，读者的搜索路径上不再有构建和加锁
+    index->prepare();
+    auto next = std::make_unique<const Version>(
+        Version{std::move(index), current_owner_->number + 1});
+    const uint64_t number = next->number;
+    current_.store(next.get());
+    // 替换之后推进纪元，登记了更新纪元的读者只会读到新版本
+    const uint64_t retire_epoch = epoch_.fetch_add(1);
+    retired_.emplace_back(retire_epoch, std::move(current_owner_));
+    current_owner_ = std::move(next);
+    reclaimLocked();
+    return number;
+}
+
+cv::Ptr<GalleryIndex> GalleryStore::create() const {
+    std::lock_guard lock(writer_mutex_);
+    return current_owner_->index->create();
+}
+
+void GalleryStore::reclaim() {
+    std::lock_guard lock(writer_mutex_);
+    reclaimLocked();
+}
+
+void GalleryStore::reclaimLocked() {
+    if (retired_.empty())
+        return;
+    uint64_t min_epoch = UINT64_MAX;
+    for (const auto &slot : slots_) {
+        const uint64_t epoch = slot.epoch.load();
+        if (epoch != 0)
+            min_epoch = std::min(min_epoch, epoch);
+    }
+    // 所有读者的纪元都晚于替换纪元时，没有人还能持有旧版本
+    std::erase_if(retired_, [min_epoch](const auto &retired) {
+        return retired.first < min_epoch;
+    });
+}
@@ -0,0 +1,451 @@
+#include "hnsw_index.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+
+// custom
+#include "gallery_file.hpp"
+
+namespace {
+constexpr char khnsw_magic[8] = {'F', 'R', 'H', 'N', 'S', 'W', 'G', 'R'};
+// 2：文件头加入特征库文件大小和内容哈希
+constexpr uint32_t khnsw_version = 2;
+// 层数上限，m>=2时节点层数超过它的概率低于2^-64
+constexpr int kmax_level = 64;
+
+/**
+ * @brief 每个线程复用的搜索缓冲区，访问标记用递增的标签代替每次清零
+ *
+ */
+struct SearchBuffers {
+    std::vector<uint32_t> tags;
+    uint32_t epoch = 0;
+    std::vector<std::pair<float, uint32_t>> candidates;
+    std::vector<std::pair<float, uint32_t>> results;
+    // 查询时复用的第0层搜索结果
+    std::vector<std::pair<float, uint32_t>> nearest;
+
+    void reset(size_t count) {
+        if (tags.size() < count)
+            tags.resize(count, 0);
+        if (++epoch == 0) {
+            std::fill(tags.begin(), tags.end(), 0);
+            epoch = 1;
+        }
+        candidates.clear();
+        results.clear();
+    }
+
+    bool visit(uint32_t id) {
+        if (tags[id] == epoch)
+            return false;
+        tags[id] = epoch;
+        return true;
+    }
+};
+
+SearchBuffers &GetSearchBuffers() {
+    thread_local SearchBuffers search_buffers;
+    return search_buffers;
+}
+
+template <typename T> void WritePod(std::ofstream &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> bool ReadPod(std::ifstream &file, T &value) {
+    return static_cast<bool>(
+        file.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+} // namespace
+
+cv::Ptr<GalleryIndex> HnswIndex::create() const {
+    return cv::makePtr<HnswIndex>(params_);
+}
+
+cv::Ptr<GalleryIndex> HnswIndex::clone() const {
+    auto index = cv::makePtr<HnswIndex>(params_);
+    index->gallery_ = gallery_.clone();
+    index->rng_ = rng_;
+    index->links_ = links_;
+    index->deleted_ = deleted_;
+    index->deleted_count_ = deleted_count_;
+    index->max_level_ = max_level_;
+    index->entry_point_ = entry_point_;
+    return index;
+}
+
+float HnswIndex::distance(const float *query, uint32_t id) const {
+    return 1.f - dot_(query, gallery_.row(id), gallery_.stride());
+}
+
+int HnswIndex::randomLevel() {
+    std::uniform_real_distribution<double> uniform(
+        std::numeric_limits<double>::min(), 1.0);
+    const double level_mult = 1.0 / std::log(std::max(params_.m, 2));
+    return std::min(static_cast<int>(-std::log(uniform(rng_)) * level_mult),
+                    kmax_level);
+}
+
+void HnswIndex::searchLayer(const float *query, uint32_t entry, int ef,
+                            int level, std::vector<Candidate> &nearest) const {
+    auto &buffers = GetSearchBuffers();
+    buffers.reset(links_.size());
+    // candidates为小顶堆，results为大顶堆，保留最近的ef个
+    auto &candidates = buffers.candidates;
+    auto &results = buffers.results;
+    const std::greater<Candidate> min_heap;
+    const float entry_distance = distance(query, entry);
+    buffers.visit(entry);
+    candidates.emplace_back(entry_distance, entry);
+    results.emplace_back(entry_distance, entry);
+
+    while (!candidates.empty()) {
+        const auto [current_distance, current] = candidates.front();
+        if (current_distance > results.front().first &&
+            static_cast<int>(results.size()) >= ef)
+            break;
+        std::pop_heap(candidates.begin(), candidates.end(), min_heap);
+        candidates.pop_back();
+        const auto &neighbors = links_[current][level];
+        // 特征库远大于缓存，提前预取邻居的特征行
+        for (const uint32_t neighbor : neighbors)
+            __builtin_prefetch(gallery_.row(neighbor));
+        for (const uint32_t neighbor : neighbors) {
+            if (!buffers.visit(neighbor))
+                continue;
+            const float neighbor_distance = distance(query, neighbor);
+            if (static_cast<int>(results.size()) < ef ||
+                neighbor_distance < results.front().first) {
+                candidates.emplace_back(neighbor_distance, neighbor);
+                std::push_heap(candidates.begin(), candidates.end(), min_heap);
+                results.emplace_back(neighbor_distance, neighbor);
+                std::push_heap(results.begin(), results.end());
+                if (static_cast<int>(results.size()) > ef) {
+                    std::pop_heap(results.begin(), results.end());
+                    results.pop_back();
+                }
+            }
+        }
+    }
+
+    nearest.assign(results.begin(), results.end());
+    std::sort(nearest.begin(), nearest.end());
+    return;
+}
+
+HnswIndex::Neighbors
+HnswIndex::selectNeighbors(std::vector<Candidate> candidates,
+                           size_t max_count) const {
+    Neighbors selected;
+    if (candidates.size() <= max_count) {
+        for (const auto &candidate : candidates)
+            selected.push_back(candidate.second);
+        return selected;
+    }
+    // 启发式选择：只保留比已选邻居更靠近基准点的候选，使邻居分布在不同方向
+    std::sort(candidates.begin(), candidates.end());
+    for (const auto &[candidate_distance, id] : candidates) {
+        if (selected.size() >= max_count)
+            break;
+        bool keep = true;
+        for (const uint32_t chosen : selected) {
+            if (distance(gallery_.row(id), chosen) < candidate_distance) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep)
+            selected.push_back(id);
+    }
+    return selected;
+}
+
+void HnswIndex::insertNode(uint32_t id) {
+    const int level = randomLevel();
+    links_[id].assign(level + 1, Neighbors());
+    if (max_level_ < 0) {
+        entry_point_ = id;
+        max_level_ = level;
+        return;
+    }
+
+    const float *query = gallery_.row(id);
+    uint32_t entry = entry_point_;
+    float entry_distance = distance(query, entry);
+    // 高层贪心下降
+    for (int l = max_level_; l > level; --l) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (const uint32_t neighbor : links_[entry][l]) {
+                const float neighbor_distance = distance(query, neighbor);
+                if (neighbor_distance < entry_distance) {
+                    entry_distance = neighbor_distance;
+                    entry = neighbor;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    const size_t m = static_cast<size_t>(std::max(params_.m, 2));
+    std::vector<Candidate> candidates;
+    for (int l = std::min(level, max_level_); l >= 0; --l) {
+        searchLayer(query, entry, std::max(params_.ef_construction, 1), l,
+                    candidates);
+        links_[id][l] = selectNeighbors(candidates, m);
+        const size_t max_links = l == 0 ? 2 * m : m;
+        for (const uint32_t neighbor : links_[id][l]) {
+            auto &neighbor_links = links_[neighbor][l];
+            neighbor_links.push_back(id);
+            if (neighbor_links.size() <= max_links)
+                continue;
+            // 邻居过多时重新选择
+            std::vector<Candidate> shrink;
+            shrink.reserve(neighbor_links.size());
+            for (const uint32_t other : neighbor_links)
+                shrink.emplace_back(
+                    distance(gallery_.row(neighbor), other), other);
+            neighbor_links = selectNeighbors(std::move(shrink), max_links);
+        }
+        entry = candidates.front().second;
+    }
+
+    if (level > max_level_) {
+        max_level_ = level;
+        entry_point_ = id;
+    }
+}
+
+void HnswIndex::add(const std::string &name, const cv::Mat &feature) {
+    const auto id = static_cast<uint32_t>(gallery_.add(name, feature));
+    links_.emplace_back();
+    deleted_.push_back(0);
+    insertNode(id);
+    return;
+}
+
+size_t HnswIndex::remove(std::string_view name) {
+    size_t removed = 0;
+    for (size_t i = 0; i < gallery_.size(); ++i) {
+        if (deleted_[i] || gallery_.name(i) != name)
+            continue;
+        deleted_[i] = 1;
+        ++removed;
+    }
+    deleted_count_ += removed;
+    // 墓碑超过一半时压缩特征库并重建图
+    if (deleted_count_ > 64 && deleted_count_ * 2 > gallery_.size())
+        rebuild();
+    return removed;
+}
+
+void HnswIndex::rebuild() {
+    if (deleted_count_ > 0)
+        gallery_.removeIf([this](size_t i) { return deleted_[i] != 0; });
+    deleted_.assign(gallery_.size(), 0);
+    deleted_count_ = 0;
+    links_.assign(gallery_.size(), std::vector<Neighbors>());
+    max_level_ = -1;
+    entry_point_ = 0;
+    rng_.seed(params_.seed);
+    for (size_t i = 0; i < gallery_.size(); ++i)
+        insertNode(static_cast<uint32_t>(i));
+}
+
+void HnswIndex::clear() {
+    gallery_.clear();
+    links_.clear();
+    deleted_.clear();
+    deleted_count_ = 0;
+    max_level_ = -1;
+    entry_point_ = 0;
+    rng_.seed(params_.seed);
+    return;
+}
+
+void HnswIndex::search(const cv::Mat &packed_queries,
+                       cv::FaceRecognizerSF::DisType distance_type,
+                       const GallerySearchParams &params,
+                       std::vector<GallerySearchResult> &results) const {
+    ResetSearchResults(results, packed_queries.rows);
+    if (size() == 0)
+        return;
+    auto &nearest = GetSearchBuffers().nearest;
+    for (int q = 0; q < packed_queries.rows; ++q) {
+        const float *query = packed_queries.ptr<float>(q);
+        uint32_t entry = entry_point_;
+        float entry_distance = distance(query, entry);
+        for (int l = max_level_; l > 0; --l) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (const uint32_t neighbor : links_[entry][l]) {
+                    const float neighbor_distance = distance(query, neighbor);
+                    if (neighbor_distance < entry_distance) {
+                        entry_distance = neighbor_distance;
+                        entry = neighbor;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        // 候选集至少要容纳top_k个身份
+        searchLayer(query, entry,
+                    std::max({params_.ef_search, params.top_k, 2}), 0,
+                    nearest);
+        for (const auto &[nearest_distance, id] : nearest)
+            if (!deleted_[id])
+                gallery_.insertCandidate(results[q], params.top_k,
+                                         static_cast<int>(id),
+                                         1.f - nearest_distance);
+    }
+    CosinesToScores(results, distance_type);
+    return;
+}
+
+bool HnswIndex::save(const std::string &file_path, uint64_t model_hash) const {
+    // 墓碑只记录在图文件中，先去掉被删除的行再保存，
+    // 单独读取特征库（或图文件不可用）时不会找回已删除的目标
+    if (deleted_count_ > 0) {
+        HnswIndex compacted(params_);
+        compacted.gallery_ = gallery_.clone();
+        compacted.deleted_ = deleted_;
+        compacted.deleted_count_ = deleted_count_;
+        compacted.rebuild();
+        return compacted.save(file_path, model_hash);
+    }
+    if (!SaveGallery(file_path, gallery_, model_hash))
+        return false;
+    // 与特征库一样先写临时文件再重命名，写入中断时不会留下截断的图文件
+    const auto graph_path = file_path + ".hnsw";
+    const auto tmp_path = graph_path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "[HnswIndex->save]:打开<" << tmp_path << ">失败\n";
+            return false;
+        }
+        file.write(khnsw_magic, sizeof(khnsw_magic));
+        WritePod(file, khnsw_version);
+        WritePod(file, static_cast<int32_t>(params_.m));
+        WritePod(file, static_cast<uint64_t>(links_.size()));
+        WritePod(file, static_cast<int32_t>(max_level_));
+        WritePod(file, entry_point_);
+        // 两个文件分别重命名，记录特征库的大小和内容哈希，
+        // 加载时据此发现与特征库不是同一次保存的图文件
+        WritePod(file, GalleryFileSize(gallery_));
+        WritePod(file, HashGallery(gallery_));
+        file.write(reinterpret_cast<const char *>(deleted_.data()),
+                   static_cast<std::streamsize>(deleted_.size()));
+        for (const auto &node_links : links_) {
+            WritePod(file, static_cast<uint32_t>(node_links.size()));
+            for (const auto &neighbors : node_links) {
+                WritePod(file, static_cast<uint32_t>(neighbors.size()));
+                file.write(reinterpret_cast<const char *>(neighbors.data()),
+                           static_cast<std::streamsize>(neighbors.size() *
+                                                        sizeof(uint32_t)));
+            }
+        }
+        if (!file.good()) {
+            std::cerr << "[HnswIndex->save]:写入<" << tmp_path << ">失败\n";
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, graph_path, ec);
+    if (ec) {
+        std::cerr << "[HnswIndex->save]:重命名<" << tmp_path << ">失败:"
+                  << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool HnswIndex::load(const std::string &file_path, uint64_t model_hash) {
+    clear();
+    if (!LoadGallery(file_path, model_hash, gallery_))
+        return false;
+
+    const auto graph_path = file_path + ".hnsw";
+    std::ifstream file(graph_path, std::ios::binary);
+    char magic[8] = {};
+    uint32_t version = 0;
+    int32_t m = 0, max_level = -1;
+    uint64_t count = 0, gallery_size = 0, gallery_hash = 0;
+    uint32_t entry_point = 0;
+    bool ok = file.is_open() && file.read(magic, sizeof(magic)) &&
+              std::memcmp(magic, khnsw_magic, sizeof(magic)) == 0 &&
+              ReadPod(file, version) && version == khnsw_version &&
+              ReadPod(file, m) && m == params_.m && ReadPod(file, count) &&
+              count == gallery_.size() && ReadPod(file, max_level) &&
+              max_level >= -1 && max_level <= kmax_level &&
+              (count == 0) == (max_level < 0) && ReadPod(file, entry_point) &&
+              ReadPod(file, gallery_size) &&
+              gallery_size == GalleryFileSize(gallery_) &&
+              ReadPod(file, gallery_hash) &&
+              gallery_hash == HashGallery(gallery_);
+    if (ok) {
+        deleted_.resize(count);
+        file.read(reinterpret_cast<char *>(deleted_.data()),
+                  static_cast<std::streamsize>(count));
+        // 只允许0和1，否则搜索与计数对墓碑的判断不一致
+        ok = static_cast<bool>(file) &&
+             std::all_of(deleted_.begin(), deleted_.end(),
+                         [](uint8_t deleted) { return deleted <= 1; });
+        links_.resize(ok ? count : 0);
+        for (uint64_t i = 0; ok && i < count; ++i) {
+            uint32_t level_count = 0;
+            ok = ReadPod(file, level_count) && level_count > 0 &&
+                 static_cast<int32_t>(level_count) <= max_level + 1;
+            if (!ok)
+                break;
+            links_[i].resize(level_count);
+            for (auto &neighbors : links_[i]) {
+                uint32_t neighbor_count = 0;
+                ok = ReadPod(file, neighbor_count) &&
+                     neighbor_count <= static_cast<uint32_t>(4 * m);
+                if (!ok)
+                    break;
+                neighbors.resize(neighbor_count);
+                file.read(reinterpret_cast<char *>(neighbors.data()),
+                          neighbor_count * sizeof(uint32_t));
+                ok = static_cast<bool>(file) &&
+                     std::all_of(neighbors.begin(), neighbors.end(),
+                                 [count](uint32_t id) { return id < count; });
+                if (!ok)
+                    break;
+            }
+        }
+        // 第l层的邻居必须也在第l层，否则搜索时会越界
+        for (uint64_t i = 0; ok && i < count; ++i)
+            for (size_t l = 0; ok && l < links_[i].size(); ++l)
+                for (const uint32_t neighbor : links_[i][l])
+                    ok = ok && links_[neighbor].size() > l;
+        ok = ok && (count == 0 ||
+                    (entry_point < count &&
+                     static_cast<int32_t>(links_[entry_point].size()) ==
+                         max_level + 1));
+    }
+    if (!ok) {
+        // 图文件缺失或与特征库不一致时按特征库重建
+        std::cout << "[HnswIndex->load]:<" << graph_path
+                  << ">不可用，重建索引\n";
+        deleted_.assign(gallery_.size(), 0);
+        deleted_count_ = 0;
+        rebuild();
+        return true;
+    }
+    deleted_count_ = std::count(deleted_.begin(), deleted_.end(), 1);
+    max_level_ = max_level;
+    entry_point_ = entry_point;
+    return true;
+}
@@ -1,3 +1,9 @@
+// std
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <thread>
+
 // opencv
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgcodecs.hpp>
@@ -5,23 +11,68 @@
 #include <opencv2/videoio.hpp>
 
 // custom
+#include "adaptive_controller.hpp"
+#include "batch.hpp"
 #include "config.hpp"
 #include "config_reader.hpp"
 #include "detector.hpp"
+#include "enrollment.hpp"
+#include "ffmpeg_capture.hpp"
+#include "file_watcher.hpp"
+#include "metrics.hpp"
+#include "motion_gate.hpp"
+#include "pipeline.hpp"
+#include "precision_check.hpp"
+#include "stream_server.hpp"
+#include "tiled_detector.hpp"
+
+/**
+ * @brief 当前精度模式下是否使用INT8模型
+ *
+ * @param config 配置
+ * @param mode kprecision_yunet_int8或kprecision_sface_int8
+ * @return true 使用INT8模型
+ */
+bool UseInt8(const ConfigSnapshot &config, PrecisionMode mode) {
+    return (config.precision & mode) != 0;
+}
+
+/**
+ * @brief YuNet模型路径
+ *
+ * @param config 配置
+ * @param int8 是否使用INT8模型
+ * @return std::string
+ */
+std::string GetYuNetPath(const ConfigSnapshot &config, bool int8) {
+    return __DATA_DIR__ +
+           (int8 ? config.detection_int8_onnx : config.detection_onnx);
+}
+
+/**
+ * @brief SFace模型路径
+ *
+ * @param config 配置
+ * @param int8 是否使用INT8模型
+ * @return std::string
+ */
+std::string GetSFacePath(const ConfigSnapshot &config, bool int8) {
+    return __DATA_DIR__ + (int8 ? config.sface_int8_onnx : config.sface_onnx);
+}
 
 /**
  * @brief 构造YuNet
  *
- * @param reader 配置读取器
+ * @param config 配置
+ * @param int8 是否使用INT8模型
  * @return YuNet
  */
-YuNet GetYuNet(const ConfigReader &reader) {
-    auto yunet_model_path =
-        __DATA_DIR__ + GetConfigData<std::string>(reader, "detection_onnx");
-    auto detect_threshold = GetConfigData<float>(reader, "detect_threshold");
-    auto nms_threshold = GetConfigData<float>(reader, "nms_threshold");
-    auto top_k = GetConfigData<int>(reader, "top_k");
-    auto backend_target = GetConfigData<int>(reader, "backend_target");
+YuNet GetYuNet(const ConfigSnapshot &config, bool int8) {
+    auto yunet_model_path = GetYuNetPath(config, int8);
+    auto detect_threshold = config.detect_threshold;
+    auto nms_threshold = config.nms_threshold;
+    auto top_k = config.top_k;
+    auto backend_target = config.backend_target;
     const int backend_id = backend_target_pairs.at(backend_target).first;
     const int target_id = backend_target_pairs.at(backend_target).second;
     auto yunet = YuNet(yunet_model_path, cv::Size(320, 320), detect_threshold,
@@ -29,128 +80,894 @@ YuNet GetYuNet(const ConfigReader &reader) {
     return yunet;
 }
 
+YuNet GetYuNet(const ConfigSnapshot &config) {
+    return GetYuNet(config, UseInt8(config, kprecision_yunet_int8));
+}
+
 /**
  * @brief 构造SFace
  *
- * @param reader  配置读取器
+ * @param config 配置
+ * @param int8 是否使用INT8模型
  * @return SFace
  */
-SFace GetSFace(const ConfigReader &reader) {
-    auto sface_model_path =
-        __DATA_DIR__ + GetConfigData<std::string>(reader, "sface_onnx");
-    auto backend_target = GetConfigData<int>(reader, "backend_target");
+SFace GetSFace(const ConfigSnapshot &config, bool int8) {
+    auto sface_model_path = GetSFacePath(config, int8);
+    auto backend_target = config.backend_target;
     const int backend_id = backend_target_pairs.at(backend_target).first;
     const int target_id = backend_target_pairs.at(backend_target).second;
-    auto distance_type = GetConfigData<int>(reader, "distance_type");
-    auto cosine_threshold = GetConfigData<float>(reader, "cosine_threshold");
-    auto norml2_threshold = GetConfigData<float>(reader, "norml2_threshold");
+    auto distance_type = config.distance_type;
+    auto cosine_threshold = config.cosine_threshold;
+    auto norml2_threshold = config.norml2_threshold;
     auto sface = SFace(sface_model_path, backend_id, target_id, distance_type);
     sface.setThresholdCosine(cosine_threshold);
     sface.setThresholdNorml2(norml2_threshold);
+    sface.setMatchMargin(config.match_margin);
+    GallerySearchParams search_params;
+    search_params.top_k = std::max(config.match_top_k, 1);
+    search_params.centroid_pruning = config.centroid_pruning;
+    sface.setSearchParams(search_params);
     return sface;
 }
 
+SFace GetSFace(const ConfigSnapshot &config) {
+    return GetSFace(config, UseInt8(config, kprecision_sface_int8));
+}
+
+/**
+ * @brief 读取质量门控参数
+ *
+ * @param config 配置
+ * @return QualityParams
+ */
+QualityParams GetQualityParams(const ConfigSnapshot &config) {
+    QualityParams quality_params;
+    quality_params.enabled = config.quality_gate;
+    quality_params.min_size = config.quality_min_size;
+    quality_params.min_score = config.quality_min_score;
+    quality_params.max_yaw = config.quality_max_yaw;
+    quality_params.skip_yaw = config.quality_skip_yaw;
+    quality_params.max_pitch = config.quality_max_pitch;
+    quality_params.min_sharpness = config.quality_min_sharpness;
+    return quality_params;
+}
+
 /**
- * @brief 获得所有的识别目标数据
+ * @brief 构造分块检测器
  *
- * @param reader 配置读取器
+ * @param config 配置
+ * @param thread_count 线程数，0表示使用所有核心
+ * @return cv::Ptr<TiledDetector> tile_size为0时为空
+ */
+cv::Ptr<TiledDetector> GetTiledDetector(const ConfigSnapshot &config,
+                                        size_t thread_count) {
+    if (config.tile_size <= 0)
+        return nullptr;
+    TileOptions options;
+    options.tile_size = config.tile_size;
+    options.overlap = config.tile_overlap;
+    options.thread_count = thread_count;
+    options.max_tiles = config.tile_max;
+    options.coarse_scale = config.tile_coarse_scale;
+    options.nms_threshold = config.nms_threshold;
+    return cv::makePtr<TiledDetector>(options, [&config] {
+        return cv::makePtr<YuNet>(GetYuNet(config));
+    });
+}
+
+/**
+ * @brief 构造特征库索引
+ *
+ * @param config 配置
+ * @return cv::Ptr<GalleryIndex>
+ */
+cv::Ptr<GalleryIndex> GetGalleryIndex(const ConfigSnapshot &config) {
+    HnswParams hnsw_params;
+    hnsw_params.m = config.hnsw_m;
+    hnsw_params.ef_construction = config.hnsw_ef_construction;
+    hnsw_params.ef_search = config.hnsw_ef_search;
+    return CreateGalleryIndex(config.gallery_index, hnsw_params);
+}
+
+/**
+ * @brief 计算当前配置下模型文件的哈希
+ *
+ * @param config 配置
+ * @return uint64_t
+ */
+uint64_t GetModelHash(const ConfigSnapshot &config) {
+    return ModelHash(
+        GetYuNetPath(config, UseInt8(config, kprecision_yunet_int8)),
+        GetSFacePath(config, UseInt8(config, kprecision_sface_int8)));
+}
+
+/**
+ * @brief 读取录入缓存，模型变化时为空
+ *
+ * @param config 配置
+ * @return EnrollmentCache
+ */
+EnrollmentCache LoadEnrollmentCache(const ConfigSnapshot &config) {
+    EnrollmentCache cache(
+        HashFile(
+            GetYuNetPath(config, UseInt8(config, kprecision_yunet_int8))),
+        HashFile(
+            GetSFacePath(config, UseInt8(config, kprecision_sface_int8))));
+    cache.load(__DATA_DIR__ + config.enroll_cache_name);
+    return cache;
+}
+
+/**
+ * @brief 目标文件夹中的所有图片
+ *
+ * @param config 配置
+ * @return std::vector<std::string>
+ */
+std::vector<std::string> GetTargetPaths(const ConfigSnapshot &config) {
+    std::vector<std::string> targets_path;
+    cv::glob(__DATA_DIR__ + config.targets_dir_name, targets_path, false);
+    return targets_path;
+}
+
+/**
+ * @brief 获得所有的识别目标数据，只对新增或修改过的图片推理
+ * 只在启动时（视频线程运行之前）调用
+ *
+ * @param config 配置
  * @param detector_ptr 完整识别器的指针
  * @return TargetDataVec
  */
-TargetDataVec GetAllTargetData(const ConfigReader &reader,
+TargetDataVec GetAllTargetData(const ConfigSnapshot &config,
                                cv::Ptr<Detector> detector_ptr) {
-    std::vector<std::string> targets_path;
-    TargetDataVec target_data_vec;
-    auto targets_dir_path =
-        __DATA_DIR__ + GetConfigData<std::string>(reader, "targets_dir_name");
-    cv::glob(targets_dir_path, targets_path, false);
-    for (const auto &target_path : targets_path) {
-        std::string::size_type pos = target_path.find_last_of('/') + 1;
-        std::string filename =
-            target_path.substr(pos, target_path.length() - pos - 4);
-        auto target_image = cv::imread(target_path);
-        auto detect_result = detector_ptr->detectFace(target_image);
-        if (detect_result.faces.empty())
-            std::cerr << "未检测到" << filename << "人脸\n";
-        else
-            target_data_vec.push_back({filename, detect_result.features[0]});
-    }
+    auto cache = LoadEnrollmentCache(config);
+    EnrollmentStats stats;
+    // 录入线程各用一个识别器，此时没有其他推理，关闭OpenCV内部并行
+    const int cv_threads = cv::getNumThreads();
+    if (config.enroll_threads != 1)
+        cv::setNumThreads(1);
+    auto target_data_vec = EnrollTargets(
+        GetTargetPaths(config), cache, detector_ptr,
+        [&config] {
+            return cv::makePtr<Detector>(GetYuNet(config), GetSFace(config));
+        },
+        stats, config.enroll_threads);
+    cv::setNumThreads(cv_threads);
+    std::cout << "[GetAllTargetData]:命中" << stats.hits << "，未命中"
+              << stats.misses << "，淘汰" << stats.evictions << "，无人脸"
+              << stats.no_face << "\n";
+    if (stats.misses > 0 || stats.evictions > 0)
+        cache.save(__DATA_DIR__ + config.enroll_cache_name);
     return target_data_vec;
 }
 
-int main() {
-    // 读取配置
+/**
+ * @brief 监听特征库文件（配置了gallery_name时）或目标文件夹，变化后在专用
+ * 线程中更新特征库并发布，识别线程下一帧即使用新版本
+ * 目标文件夹变化时只录入变化的图片，按差异增删特征库中对应的身份
+ *
+ * @param config 配置
+ * @param detector_ptr 识别器，与其共享特征库的识别器同时生效
+ * @return std::unique_ptr<AsyncWatch> 析构时停止监听
+ */
+std::unique_ptr<AsyncWatch> WatchGallery(const ConfigSnapshot &config,
+                                         cv::Ptr<Detector> detector_ptr) {
+    const auto model_hash = GetModelHash(config);
+    if (!config.gallery_name.empty()) {
+        // 特征库文件以重命名方式原子替换，旧版本的映射仍然有效
+        const auto gallery_path = __DATA_DIR__ + config.gallery_name;
+        return std::make_unique<AsyncWatch>(
+            gallery_path, [detector_ptr, gallery_path, model_hash] {
+                if (detector_ptr->loadGallery(gallery_path, model_hash))
+                    std::cout << "[WatchGallery]:已重新加载<" << gallery_path
+                              << ">，共" << detector_ptr->targetCount()
+                              << "个目标\n";
+            });
+    }
+    // 录入使用单独的识别器和常驻的缓存，第一次变化时才加载
+    struct EnrollState {
+        cv::Ptr<Detector> detector;
+        std::unique_ptr<EnrollmentCache> cache;
+    };
+    auto state = std::make_shared<EnrollState>();
+    return std::make_unique<AsyncWatch>(
+        __DATA_DIR__ + config.targets_dir_name,
+        [config, detector_ptr, state] {
+            if (state->detector == nullptr) {
+                state->detector = cv::makePtr<Detector>(GetYuNet(config),
+                                                        GetSFace(config));
+                state->cache = std::make_unique<EnrollmentCache>(
+                    LoadEnrollmentCache(config));
+            }
+            // 单线程录入，不与视频线程争用核心
+            EnrollmentStats stats;
+            const auto delta =
+                EnrollChangedTargets(GetTargetPaths(config), *state->cache,
+                                     state->detector, nullptr, stats, 1);
+            if (stats.misses > 0 || stats.evictions > 0)
+                state->cache->save(__DATA_DIR__ + config.enroll_cache_name);
+            if (delta.names.empty())
+                return;
+            auto store_ptr = detector_ptr->galleryStore();
+            const auto version =
+                store_ptr->update([&delta](GalleryIndex &index) {
+                    for (const auto &name : delta.names)
+                        index.remove(name);
+                    for (const auto &target_data : delta.targets)
+                        index.add(target_data.name, target_data.feature);
+                });
+            std::cout << "[WatchGallery]:" << delta.names.size()
+                      << "个身份变化，特征库更新到版本" << version << "，共"
+                      << store_ptr->acquire()->size() << "个目标\n";
+        });
+}
+
+/**
+ * @brief 读取跟踪参数
+ *
+ * @param config 配置
+ * @return TrackParams
+ */
+TrackParams GetTrackParams(const ConfigSnapshot &config) {
+    TrackParams track_params;
+    track_params.iou_threshold = config.track_iou_threshold;
+    track_params.reverify_iou = config.track_reverify_iou;
+    track_params.reverify_interval = config.track_reverify_interval;
+    track_params.max_box_change = config.track_max_box_change;
+    track_params.max_missed = config.track_max_missed;
+    return track_params;
+}
+
+/**
+ * @brief 读取自适应控制参数
+ *
+ * @param config 配置
+ * @return AdaptiveParams
+ */
+AdaptiveParams GetAdaptiveParams(const ConfigSnapshot &config) {
+    AdaptiveParams adaptive_params;
+    adaptive_params.enabled = config.adaptive;
+    adaptive_params.budget_ms = config.adaptive_budget_ms;
+    adaptive_params.min_scale = config.adaptive_min_scale;
+    adaptive_params.max_scale = config.adaptive_max_scale;
+    adaptive_params.scale_step = config.adaptive_scale_step;
+    adaptive_params.max_skip = config.adaptive_max_skip;
+    adaptive_params.min_face_px = config.adaptive_min_face_px;
+    adaptive_params.adjust_interval = config.adaptive_adjust_interval;
+    return adaptive_params;
+}
+
+/**
+ * @brief 读取运动门控参数
+ *
+ * @param config 配置
+ * @return MotionParams
+ */
+MotionParams GetMotionParams(const ConfigSnapshot &config) {
+    MotionParams motion_params;
+    motion_params.enabled = config.motion_gate;
+    motion_params.width = config.motion_width;
+    motion_params.pixel_threshold = config.motion_threshold;
+    motion_params.cell_ratio = config.motion_cell_ratio;
+    motion_params.background_shift = config.motion_background_shift;
+    motion_params.full_interval = config.motion_full_interval;
+    return motion_params;
+}
+
+/**
+ * @brief 在本地图片上比较FP32与INT8模型并输出报告
+ *
+ * @param config 配置
+ * @param images_dir 图片文件夹，为空时使用目标文件夹
+ * @return int 进程返回值
+ */
+int RunPrecisionCheck(const ConfigSnapshot &config, std::string images_dir) {
+    if (images_dir.empty())
+        images_dir = __DATA_DIR__ + config.targets_dir_name;
+    std::vector<std::string> image_paths;
+    cv::glob(images_dir, image_paths, false);
+
+    PrecisionReport report;
+    try {
+        auto yunet_fp32 = GetYuNet(config, false);
+        auto yunet_int8 = GetYuNet(config, true);
+        auto sface_fp32 = GetSFace(config, false);
+        auto sface_int8 = GetSFace(config, true);
+        if (!CheckPrecision(image_paths, yunet_fp32, yunet_int8, sface_fp32,
+                            sface_int8, config.cosine_threshold, report))
+            return 1;
+    } catch (const cv::Exception &e) {
+        std::cerr << "[RunPrecisionCheck]:加载或推理模型失败:" << e.what()
+                  << "\n";
+        return 1;
+    }
+    std::cout << "[precision]:" << report.images << "张图片，FP32检测到"
+              << report.faces << "张人脸\n"
+              << "[yunet]:FP32 " << report.yunet.fp32_ms << "ms，INT8 "
+              << report.yunet.int8_ms << "ms，加速" << report.yunet.speedup()
+              << "倍，AP@0.5 " << report.detection_ap << "（mAP差值"
+              << 1.0 - report.detection_ap << "）\n"
+              << "[sface]:FP32 " << report.sface.fp32_ms << "ms，INT8 "
+              << report.sface.int8_ms << "ms，加速" << report.sface.speedup()
+              << "倍，特征余弦相似度平均" << report.embedding_cos_mean
+              << "，最小" << report.embedding_cos_min << "，低于识别阈值"
+              << report.embedding_below_threshold << "张\n";
+    return 0;
+}
+
+/**
+ * @brief 纯数字的视频源为摄像头编号
+ *
+ * @param source 视频源
+ * @return true 摄像头
+ * @return false 视频文件或网络流
+ */
+bool IsCameraSource(const std::string &source) {
+    return !source.empty() &&
+           std::all_of(source.begin(), source.end(), ::isdigit);
+}
+
+/**
+ * @brief 视频文件或网络流的路径，带协议头或绝对路径直接使用，
+ * 其余视为数据文件夹下的视频文件
+ *
+ * @param source 视频源
+ * @return std::string
+ */
+std::string GetVideoPath(const std::string &source) {
+    if (source.find("://") != std::string::npos || source.front() == '/')
+        return source;
+    return __DATA_DIR__ + source;
+}
+
+FFmpegCaptureOptions GetFFmpegCaptureOptions(const ConfigSnapshot &config) {
+    FFmpegCaptureOptions options;
+    options.decode_threads = config.decode_threads;
+    options.hw_device = config.hw_decode;
+    return options;
+}
+
+/**
+ * @brief 打开视频源，纯数字为摄像头编号，带协议头（如rtsp://）或绝对路径
+ * 直接打开，其余视为数据文件夹下的视频文件
+ *
+ * @param video_capture 视频流
+ * @param source 视频源
+ * @return true 打开成功
+ * @return false 打开失败
+ */
+bool OpenVideoSource(cv::VideoCapture &video_capture,
+                     const std::string &source) {
+    if (source.empty())
+        return false;
+    if (IsCameraSource(source))
+        return video_capture.open(std::stoi(source));
+    return video_capture.open(GetVideoPath(source));
+}
+
+/**
+ * @brief 按配置选择采集方式，返回读取一帧并按zoom缩放的函数
+ * 视频文件和网络流可使用FFmpeg，一次完成解码后的缩放和颜色转换
+ *
+ * @param config 配置
+ * @param source 视频源，规则同OpenVideoSource
+ * @return StreamServer::CaptureFunc 打开失败时为空
+ */
+StreamServer::CaptureFunc OpenCaptureFunc(const ConfigSnapshot &config,
+                                          const std::string &source) {
+    const auto zoom = config.zoom;
+    if (config.capture_backend == kcapture_ffmpeg && !source.empty() &&
+        !IsCameraSource(source)) {
+        auto ffmpeg_capture = std::make_shared<FFmpegCapture>();
+        if (!ffmpeg_capture->open(GetVideoPath(source),
+                                  GetFFmpegCaptureOptions(config)))
+            return nullptr;
+        return [ffmpeg_capture, zoom](cv::Mat &image) {
+            return ffmpeg_capture->read(image, zoom);
+        };
+    }
+    auto video_capture = std::make_shared<cv::VideoCapture>();
+    if (!OpenVideoSource(*video_capture, source))
+        return nullptr;
+    // 读入的原始帧只在该路的采集线程中使用，尺寸不变时复用内存
+    return [video_capture, zoom, input = cv::Mat()](cv::Mat &image) mutable {
+        {
+            MetricTimer timer(kmetric_capture);
+            if (!video_capture->read(input))
+                return false;
+        }
+        MetricTimer timer(kmetric_resize);
+        cv::resize(input, image,
+                   cv::Size(input.cols * zoom, input.rows * zoom));
+        return true;
+    };
+}
+
+/**
+ * @brief 输出各路视频的统计
+ *
+ * @param server 多路视频服务
+ */
+void PrintStreamStats(const StreamServer &server) {
+    for (const auto &stats : server.streamStats())
+        std::cout << "[" << stats.name << "]:" << stats.frames << "帧，"
+                  << stats.fps << "FPS，平均延迟" << stats.avg_latency_ms
+                  << "ms，最大延迟" << stats.max_latency_ms << "ms，丢弃"
+                  << stats.dropped << "帧，静止跳过" << stats.motion_skipped
+                  << "帧" << (stats.finished ? "，已结束" : "")
+                  << "\n";
+}
+
+/**
+ * @brief 按配置启动指标导出，附带特征库大小和版本
+ *
+ * @param config 配置
+ * @param detector_ptr 识别器
+ * @return cv::Ptr<MetricsExporter> 未配置端口和文件时为空
+ */
+cv::Ptr<MetricsExporter> StartMetricsExporter(const ConfigSnapshot &config,
+                                              cv::Ptr<Detector> detector_ptr) {
+    MetricsExportOptions options;
+    options.port = config.metrics_port;
+    if (!config.metrics_file.empty())
+        options.file_path = config.metrics_file.front() == '/'
+                                ? config.metrics_file
+                                : __DATA_DIR__ + config.metrics_file;
+    options.interval = std::chrono::seconds(config.metrics_interval);
+    if (options.port <= 0 && options.file_path.empty())
+        return nullptr;
+    auto exporter = cv::makePtr<MetricsExporter>(options);
+    exporter->addValue("face_recognition_gallery_size", "特征库中的目标数",
+                       "gauge", [detector_ptr]() {
+                           return static_cast<double>(
+                               detector_ptr->targetCount());
+                       });
+    exporter->addValue("face_recognition_gallery_version", "特征库版本号",
+                       "gauge", [detector_ptr]() {
+                           return static_cast<double>(
+                               detector_ptr->galleryVersion());
+                       });
+    return exporter;
+}
+
+/**
+ * @brief 导出自适应控制器的当前决策和累计次数
+ *
+ * @param exporter 指标导出器
+ * @param controller 控制器，须比导出器活得久
+ */
+void AddAdaptiveMetrics(MetricsExporter &exporter,
+                        const AdaptiveController &controller) {
+    const auto add = [&exporter, &controller](const char *name,
+                                              const char *help,
+                                              const char *type, auto field) {
+        exporter.addValue(name, help, type, [&controller, field]() {
+            return static_cast<double>(field(controller.stats()));
+        });
+    };
+    add("face_recognition_adaptive_scale", "检测缩放比例", "gauge",
+        [](const AdaptiveStats &stats) { return stats.scale; });
+    add("face_recognition_adaptive_skip", "每几帧检测一次", "gauge",
+        [](const AdaptiveStats &stats) { return stats.skip; });
+    add("face_recognition_adaptive_cost_seconds", "每帧平均耗时", "gauge",
+        [](const AdaptiveStats &stats) { return stats.avg_cost_ms / 1e3; });
+    add("face_recognition_adaptive_budget_seconds", "每帧耗时预算", "gauge",
+        [](const AdaptiveStats &stats) { return stats.budget_ms / 1e3; });
+    add("face_recognition_adaptive_detect_frames_total", "检测的帧数",
+        "counter",
+        [](const AdaptiveStats &stats) { return stats.detect_frames; });
+    add("face_recognition_adaptive_skipped_frames_total",
+        "控制器跳过检测的帧数", "counter",
+        [](const AdaptiveStats &stats) { return stats.skipped_frames; });
+    add("face_recognition_adaptive_small_face_raises_total",
+        "因小脸提高分辨率的次数", "counter",
+        [](const AdaptiveStats &stats) { return stats.small_face_raises; });
+    return;
+}
+
+/**
+ * @brief 多路视频服务模式，所有视频共享识别器池和特征库，无界面
+ *
+ * @param config 配置
+ * @param detector_ptr 已加载特征库的识别器
+ * @param sources 视频源
+ * @return int 进程返回值
+ */
+int RunStreamServer(const ConfigSnapshot &config,
+                    cv::Ptr<Detector> detector_ptr,
+                    const std::vector<std::string> &sources) {
+    StreamServerOptions options;
+    options.queue_capacity = config.pipeline_queue_size;
+    options.backpressure =
+        static_cast<BackpressurePolicy>(config.pipeline_backpressure);
+    options.batch_size = config.stream_batch_size;
+    options.top_k = config.top_k;
+    options.tracking = config.tracking;
+    options.track_params = GetTrackParams(config);
+    options.motion_params = GetMotionParams(config);
+
+    // 识别器池共享同一个特征库索引
+    const int worker_count = std::max(config.stream_workers, 1);
+    // 识别器之间已经并行，分块检测每个识别器只用一个线程
+    detector_ptr->setTiledDetector(GetTiledDetector(config, 1));
+    std::vector<cv::Ptr<Detector>> detectors{detector_ptr};
+    for (int i = 1; i < worker_count; ++i) {
+        auto worker_detector =
+            cv::makePtr<Detector>(GetYuNet(config), GetSFace(config));
+        worker_detector->setGalleryStore(detector_ptr->galleryStore());
+        worker_detector->setTiledDetector(GetTiledDetector(config, 1));
+        worker_detector->setQualityParams(detector_ptr->qualityParams());
+        detectors.push_back(worker_detector);
+    }
+
+    StreamServer server(options, detectors);
+    size_t stream_count = 0;
+    for (const auto &source : sources) {
+        auto capture = OpenCaptureFunc(config, source);
+        if (capture == nullptr) {
+            std::cerr << "[RunStreamServer]:打开<" << source << ">失败\n";
+            continue;
+        }
+        server.addStream(source, std::move(capture));
+        ++stream_count;
+    }
+    if (stream_count == 0)
+        return 1;
+
+    // 导出器先于服务析构
+    const auto exporter = StartMetricsExporter(config, detector_ptr);
+    if (exporter != nullptr) {
+        exporter->addValue("face_recognition_dropped_frames_total",
+                           "所有视频丢弃的帧数", "counter", [&server]() {
+                               size_t dropped = 0;
+                               for (const auto &stats : server.streamStats())
+                                   dropped += stats.dropped;
+                               return static_cast<double>(dropped);
+                           });
+        exporter->addValue("face_recognition_motion_skipped_frames_total",
+                           "画面静止而跳过检测的帧数", "counter", [&server]() {
+                               size_t skipped = 0;
+                               for (const auto &stats : server.streamStats())
+                                   skipped += stats.motion_skipped;
+                               return static_cast<double>(skipped);
+                           });
+        exporter->start();
+    }
+
+    const auto report_interval =
+        std::chrono::seconds(config.stream_report_interval);
+    server.start();
+    auto last_report = std::chrono::steady_clock::now();
+    while (!server.finished()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const auto now = std::chrono::steady_clock::now();
+        if (report_interval.count() > 0 &&
+            now - last_report >= report_interval) {
+            PrintStreamStats(server);
+            last_report = now;
+        }
+    }
+    server.stop();
+    PrintStreamStats(server);
+    return 0;
+}
+
+/**
+ * @brief 离线批处理模式，结果写出为JSONL，无界面
+ *
+ * @param config 配置
+ * @param detector_ptr 已加载特征库的识别器
+ * @param source 视频文件或图片文件夹，不存在时视为数据文件夹下的路径
+ * @param output_path 输出文件，为空时为输入路径加.jsonl
+ * @return int 进程返回值
+ */
+int RunBatch(const ConfigSnapshot &config, cv::Ptr<Detector> detector_ptr,
+             std::string source, std::string output_path) {
+    if (!source.empty() && !std::filesystem::exists(source))
+        source = __DATA_DIR__ + source;
+    while (source.size() > 1 && source.back() == '/')
+        source.pop_back();
+    if (output_path.empty())
+        output_path = source + ".jsonl";
+
+    BatchOptions options;
+    options.thread_count =
+        static_cast<size_t>(std::max(config.batch_threads, 0));
+    // 各段已经并行，关闭OpenCV内部并行避免过度订阅
+    if (config.batch_threads != 1)
+        options.cv_threads = 1;
+    options.chunk_frames = config.batch_chunk_frames;
+    options.top_k = config.top_k;
+    // 与实时模式一致按zoom缩小检测输入，结果仍为原图坐标
+    options.scale = config.zoom;
+
+    const auto exporter = StartMetricsExporter(config, detector_ptr);
+    if (exporter != nullptr)
+        exporter->start();
+    // 各段已经并行，分块检测每个识别器只用一个线程
+    detector_ptr->setTiledDetector(GetTiledDetector(config, 1));
+    BatchStats stats;
+    const bool ok = ProcessBatch(
+        source, output_path, detector_ptr,
+        [&config, detector_ptr] {
+            auto worker_detector =
+                cv::makePtr<Detector>(GetYuNet(config), GetSFace(config));
+            worker_detector->setGalleryStore(detector_ptr->galleryStore());
+            worker_detector->setTiledDetector(GetTiledDetector(config, 1));
+            worker_detector->setQualityParams(detector_ptr->qualityParams());
+            return worker_detector;
+        },
+        options, stats);
+    if (!ok)
+        return 1;
+    std::cout << "[RunBatch]:" << stats.chunks << "段，" << stats.frames
+              << "帧，" << stats.faces << "张人脸，失败" << stats.failed
+              << "帧，用时" << stats.seconds << "s（"
+              << (stats.seconds > 0.0 ? stats.frames / stats.seconds : 0.0)
+              << "FPS），结果写入<" << output_path << ">\n";
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    // --enroll：重新录入所有目标，写入特征库文件后退出
+    const bool enroll = argc > 1 && std::string(argv[1]) == "--enroll";
+    // 热更新回调引用自适应控制器，控制器先于读取器构造、后于其析构，
+    // 读取器注销回调之前控制器始终有效
+    AdaptiveController adaptive_controller;
+    // 读取配置，启动阶段使用同一个快照
     ConfigReader reader;
-    auto yunet = GetYuNet(reader);
-    auto sface = GetSFace(reader);
+    const auto startup_config = reader.snapshot();
+    const auto &config = *startup_config;
+    // --check-precision [图片文件夹]：比较FP32与INT8模型后退出
+    if (argc > 1 && std::string(argv[1]) == "--check-precision")
+        return RunPrecisionCheck(config, argc > 2 ? argv[2] : "");
+    // --batch <视频或图片文件夹> [输出文件]：离线批处理后退出
+    const bool batch = argc > 1 && std::string(argv[1]) == "--batch";
+    if (batch && argc < 3) {
+        std::cerr
+            << "[main]:用法：main --batch <视频或图片文件夹> [输出文件]\n";
+        return 1;
+    }
+    // --streams <源>...：多路视频服务模式，未指定时使用配置中的streams
+    auto stream_sources = config.streams;
+    if (argc > 1 && std::string(argv[1]) == "--streams")
+        stream_sources.assign(argv + 2, argv + argc);
+    auto yunet = GetYuNet(config);
+    auto sface = GetSFace(config);
     // 初始化识别器
     cv::Ptr<Detector> detector_ptr = cv::makePtr<Detector>(yunet, sface);
+    detector_ptr->setGalleryIndex(GetGalleryIndex(config));
+    detector_ptr->setQualityParams(GetQualityParams(config));
     // 初始化目标数据
-    auto target_data_vec = GetAllTargetData(reader, detector_ptr);
-    // 目标数据加入识别器
-    detector_ptr->addTargetDatas(target_data_vec);
+    // 配置了特征库文件时优先映射该文件，否则每次启动增量录入目标文件夹
+    auto gallery_name = config.gallery_name;
+    auto gallery_path = __DATA_DIR__ + gallery_name;
+    auto model_hash = GetModelHash(config);
+    if (gallery_name.empty() || enroll ||
+        !detector_ptr->loadGallery(gallery_path, model_hash)) {
+        auto target_data_vec = GetAllTargetData(config, detector_ptr);
+        // 目标数据加入识别器
+        detector_ptr->addTargetDatas(target_data_vec);
+        if (!gallery_name.empty() &&
+            detector_ptr->saveGallery(gallery_path, model_hash))
+            std::cout << "已录入" << detector_ptr->targetCount() << "个目标到<"
+                      << gallery_path << ">\n";
+        if (enroll)
+            return 0;
+    }
+
+    if (batch)
+        return RunBatch(config, detector_ptr, argv[2], argc > 3 ? argv[3] : "");
+
+    // 运行期间增删目标不需要重启
+    const auto gallery_watch = WatchGallery(config, detector_ptr);
+
+    if (!stream_sources.empty())
+        return RunStreamServer(config, detector_ptr, stream_sources);
+
+    detector_ptr->setTiledDetector(GetTiledDetector(
+        config, static_cast<size_t>(std::max(config.tile_threads, 0))));
 
     // 初始化视频流
-    auto cap_or_video = GetConfigData<int>(reader, "cap_or_video");
+    auto cap_or_video = config.cap_or_video;
     assert((cap_or_video == 0 || cap_or_video == 1) &&
            "cap_or_video 必须是 0 或者 1");
 
     cv::VideoCapture video_capture;
-    cv::Mat input;
+    FFmpegCapture ffmpeg_capture;
+    // 视频文件可使用FFmpeg读取，摄像头始终使用OpenCV
+    const bool use_ffmpeg =
+        cap_or_video == 1 && config.capture_backend == kcapture_ffmpeg;
 
     if (cap_or_video == 0) {
-        auto cap_index = GetConfigData<int>(reader, "cap_index");
+        auto cap_index = config.cap_index;
         video_capture.open(cap_index);
     }
     if (cap_or_video == 1) {
-        auto video_path =
-            __DATA_DIR__ + GetConfigData<std::string>(reader, "video_name");
-        video_capture.open(video_path);
+        auto video_path = __DATA_DIR__ + config.video_name;
+        if (use_ffmpeg)
+            ffmpeg_capture.open(video_path, GetFFmpegCaptureOptions(config));
+        else
+            video_capture.open(video_path);
     }
 
-    auto debug = GetConfigData<int>(reader, "debug");
-    auto top_k = GetConfigData<int>(reader, "top_k");
-    auto zoom = GetConfigData<float>(reader, "zoom");
-    auto draw_face_points = GetConfigData<bool>(reader, "draw_face_points");
-
-    cv::TickMeter tick_meter_video;
-    cv::TickMeter tick_meter_detect;
-
-    // 注册热更新
-    reader.registerHotUpdate(
-        kconfig_name, [&reader, &debug, &zoom, &top_k, &draw_face_points]() {
-            debug = GetConfigData<int>(reader, "debug");
-            top_k = GetConfigData<int>(reader, "top_k");
-            zoom = GetConfigData<float>(reader, "zoom");
-            draw_face_points = GetConfigData<bool>(reader, "draw_face_points");
-        });
+    adaptive_controller.setParams(GetAdaptiveParams(config));
+
+    // 注册热更新，各阶段每帧读取一次最新快照，这里只需更新有状态的控制器
+    reader.registerHotUpdate([&reader, &adaptive_controller]() {
+        adaptive_controller.setParams(GetAdaptiveParams(*reader.snapshot()));
+    });
 
-    while (cv::waitKey(1) != 'q') {
-        tick_meter_detect.start();
-        tick_meter_video.start();
+    // 采集→检测→识别→渲染流水线，每个阶段一个线程
+    PipelineOptions pipeline_options;
+    pipeline_options.queue_capacity = config.pipeline_queue_size;
+    pipeline_options.backpressure =
+        static_cast<BackpressurePolicy>(config.pipeline_backpressure);
+
+    // 读入的原始帧只在采集线程中使用，尺寸不变时复用内存
+    auto capture = [&video_capture, &ffmpeg_capture, &reader, use_ffmpeg,
+                    input = cv::Mat()](cv::Mat &image) mutable {
+        const auto zoom = reader.snapshot()->zoom;
+        // 解码后直接缩放转换到输出帧，不产生原始分辨率的BGR帧
+        if (use_ffmpeg)
+            return ffmpeg_capture.read(image, zoom);
         // 读一帧
-        if (!video_capture.read(input))
-            break;
-        cv::resize(input, input,
+        {
+            MetricTimer timer(kmetric_capture);
+            if (!video_capture.read(input))
+                return false;
+        }
+        MetricTimer timer(kmetric_resize);
+        cv::resize(input, image,
                    cv::Size(input.cols * zoom, input.rows * zoom));
-        tick_meter_video.stop();
-
-        // 获取图片所有识别到的人脸特征等数据
-        auto detect_result = detector_ptr->detectFace(input, top_k);
-        auto match_data_vec = detector_ptr->matchTargetFace(detect_result);
-        tick_meter_detect.stop();
-
-        const auto video_fps = static_cast<float>(tick_meter_video.getFPS());
-        const auto detect_fps = static_cast<float>(tick_meter_detect.getFPS());
-
-        if (debug) {
-            auto output_image =
-                visualize(input, match_data_vec,
-                          cv::format("FPS:%.2f/%.2f", detect_fps, video_fps),
-                          draw_face_points);
-            cv::imshow("main", output_image);
+        return true;
+    };
+    // 跟踪器只在识别阶段线程中使用
+    const auto tracking = config.tracking;
+    FaceTracker tracker(GetTrackParams(config));
+    // 运动门控和上次检测到的人脸只在检测阶段线程中使用
+    MotionGate motion_gate(GetMotionParams(config));
+    auto detect = [&detector_ptr, &reader, &adaptive_controller, &motion_gate,
+                   tracking, last_faces = cv::Mat()](
+                      PipelineFrame &frame) mutable {
+        const auto snapshot = reader.snapshot();
+        const auto top_k = snapshot->top_k;
+        const auto begin = std::chrono::steady_clock::now();
+        const auto decision = adaptive_controller.decide();
+        // 画面静止时跳过检测，只有部分区域变化时只检测该区域
+        MotionDecision motion;
+        const auto motion_params = GetMotionParams(*snapshot);
+        if (decision.detect && motion_params.enabled) {
+            motion_gate.setParams(motion_params);
+            motion = motion_gate.update(frame.image, last_faces);
+        }
+        frame.detected = decision.detect && motion.detect;
+        frame.detect_scale = decision.scale;
+        // 门控跳过的帧由门控自己统计，不反馈给自适应控制器，
+        // 否则控制器会把门控的跳过当作自己的跳帧
+        if (decision.detect && !motion.detect)
+            return;
+        auto &detect_result = frame.context.detect_result;
+        const cv::Mat detect_input = motion.region.empty()
+                                         ? frame.image
+                                         : frame.image(motion.region);
+        // 跟踪时只检测人脸框，特征由识别阶段按需计算
+        if (frame.detected && tracking)
+            detector_ptr->detectFaceBoxes(detect_input, top_k, decision.scale,
+                                          detect_result.faces);
+        else if (frame.detected)
+            detector_ptr->detectFace(detect_input, top_k, decision.scale,
+                                     detect_result);
+        if (frame.detected) {
+            OffsetFaces(detect_result.faces, motion.region.tl());
+            detect_result.faces.copyTo(last_faces);
+            Metrics::Global().recordFaces(detect_result.faces.rows);
+        }
+        adaptive_controller.report(
+            decision,
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - begin)
+                .count(),
+            detect_result.faces);
+    };
+    // 未跟踪时跳过检测的帧沿用上次结果，人脸复制一份，
+    // 不引用会被复用的其他帧的缓冲
+    cv::Mat last_faces;
+    MatchDataVec last_match_data_vec;
+    auto recognize = [&detector_ptr, &tracker, &last_faces,
+                      &last_match_data_vec, tracking](PipelineFrame &frame) {
+        auto &context = frame.context;
+        if (tracking && !frame.detected) {
+            detector_ptr->matchPredictedFace(tracker, context);
+        } else if (tracking) {
+            detector_ptr->matchTrackedFace(
+                frame.image, context.detect_result.faces, tracker, context);
+        } else if (!frame.detected) {
+            last_faces.copyTo(context.detect_result.faces);
+            context.match_data_vec = last_match_data_vec;
+            for (int r = 0; r < last_faces.rows; ++r)
+                context.match_data_vec[r].face =
+                    context.detect_result.faces.row(r);
+        } else {
+            detector_ptr->matchTargetFace(context.detect_result, context);
+            context.detect_result.faces.copyTo(last_faces);
+            last_match_data_vec = context.match_data_vec;
         }
-        tick_meter_video.reset();
-        tick_meter_detect.reset();
+    };
+    cv::TickMeter tick_meter_output;
+    auto render = [&reader, &tick_meter_output](PipelineFrame &frame) {
+        const auto snapshot = reader.snapshot();
+        tick_meter_output.stop();
+        const auto output_fps = static_cast<float>(tick_meter_output.getFPS());
+        tick_meter_output.reset();
+        tick_meter_output.start();
+        if (!snapshot->debug)
+            return;
+        const auto latency_ms =
+            std::chrono::duration<float, std::milli>(
+                std::chrono::steady_clock::now() - frame.capture_time)
+                .count();
+        visualize(frame.image, frame.context.match_data_vec,
+                  frame.context.output_image,
+                  cv::format("FPS:%.2f latency:%.1fms scale:%.2f%s",
+                             output_fps, latency_ms, frame.detect_scale,
+                             frame.detected ? "" : " (skip)"),
+                  snapshot->draw_face_points);
+    };
+
+    FramePipeline pipeline(pipeline_options, capture, detect, recognize,
+                           render);
+    // 导出器先于流水线析构
+    const auto exporter = StartMetricsExporter(config, detector_ptr);
+    if (exporter != nullptr) {
+        exporter->addValue("face_recognition_dropped_frames_total",
+                           "流水线丢弃的帧数", "counter", [&pipeline]() {
+                               size_t dropped = 0;
+                               for (const auto &stats : pipeline.stageStats())
+                                   dropped += stats.dropped;
+                               return static_cast<double>(dropped);
+                           });
+        exporter->addValue("face_recognition_motion_skipped_frames_total",
+                           "画面静止而跳过检测的帧数", "counter",
+                           [&motion_gate]() {
+                               return static_cast<double>(
+                                   motion_gate.stats().skipped);
+                           });
+        AddAdaptiveMetrics(*exporter, adaptive_controller);
+        exporter->start();
+    }
+    pipeline.start();
+    PipelineFrame frame;
+    while (pipeline.pop(frame)) {
+        if (reader.snapshot()->debug && !frame.context.output_image.empty())
+            cv::imshow("main", frame.context.output_image);
+        pipeline.recycle(std::move(frame));
+        if (cv::waitKey(1) == 'q')
+            break;
+    }
+    pipeline.stop();
+
+    for (const auto &stats : pipeline.stageStats())
+        std::cout << "[" << stats.name << "]:" << stats.frames << "帧，平均"
+                  << stats.avg_ms << "ms，最大" << stats.max_ms << "ms，丢弃"
+                  << stats.dropped << "帧\n";
+    if (tracking) {
+        const auto &track_stats = tracker.stats();
+        std::cout << "[tracker]:" << track_stats.tracks << "条轨迹，"
+                  << track_stats.faces << "张人脸，重新识别"
+                  << track_stats.recognized << "张\n";
     }
+    const auto adaptive_stats = adaptive_controller.stats();
+    std::cout << "[adaptive]:检测" << adaptive_stats.detect_frames << "帧，跳过"
+              << adaptive_stats.skipped_frames << "帧，每帧平均"
+              << adaptive_stats.avg_cost_ms << "ms（预算"
+              << adaptive_stats.budget_ms << "ms），缩放"
+              << adaptive_stats.scale << "，每" << adaptive_stats.skip
+              << "帧检测一次，小脸提高分辨率"
+              << adaptive_stats.small_face_raises << "次\n";
+    const auto motion_stats = motion_gate.stats();
+    if (motion_stats.frames > 0)
+        std::cout << "[motion]:" << motion_stats.frames << "帧，静止跳过"
+                  << motion_stats.skipped << "帧，只检测变化区域"
+                  << motion_stats.partial << "帧，整图检测"
+                  << motion_stats.full << "帧\n";
 }
@@ -0,0 +1,310 @@
+#include "metrics.hpp"
+
+// std
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+// posix
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+// 导出的分位
+constexpr double kquantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+void AppendFormat(std::string &text, const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    const int length = std::vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0)
+        text.append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+void AppendSummary(std::string &text, const char *name, const char *labels,
+                   const Histogram &histogram, double scale) {
+    const char *separator = labels[0] == '\0' ? "" : ",";
+    for (const double q : kquantiles)
+        AppendFormat(text, "%s{%s%squantile=\"%g\"} %.9g\n", name, labels,
+                     separator, q, histogram.quantile(q) * scale);
+    const char *open = labels[0] == '\0' ? "" : "{";
+    const char *close = labels[0] == '\0' ? "" : "}";
+    AppendFormat(text, "%s_sum%s%s%s %.9g\n", name, open, labels, close,
+                 histogram.sum() * scale);
+    AppendFormat(text, "%s_count%s%s%s %llu\n", name, open, labels, close,
+                 static_cast<unsigned long long>(histogram.count()));
+}
+} // namespace
+
+int Histogram::BucketIndex(uint64_t value) {
+    // 最高位在第4位及以下时逐个对应，否则保留最高的5位
+    const int shift =
+        std::max(static_cast<int>(std::bit_width(value)) - ksub_bucket_bits -
+                     1,
+                 0);
+    return shift * ksub_bucket_count + static_cast<int>(value >> shift);
+}
+
+uint64_t Histogram::BucketLower(int index) {
+    if (index < 2 * ksub_bucket_count)
+        return static_cast<uint64_t>(index);
+    const int shift = index / ksub_bucket_count - 1;
+    return static_cast<uint64_t>(index - shift * ksub_bucket_count) << shift;
+}
+
+uint64_t Histogram::BucketWidth(int index) {
+    if (index < 2 * ksub_bucket_count)
+        return 1;
+    return uint64_t(1) << (index / ksub_bucket_count - 1);
+}
+
+void Histogram::record(uint64_t value) {
+    buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    uint64_t current = max_.load(std::memory_order_relaxed);
+    while (value > current &&
+           !max_.compare_exchange_weak(current, value,
+                                       std::memory_order_relaxed))
+        ;
+}
+
+double Histogram::quantile(double q) const {
+    // 记录与读取并发时各桶之和可能与count_略有出入，以桶为准
+    uint64_t total = 0;
+    for (const auto &bucket : buckets_)
+        total += bucket.load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0.0;
+    const auto rank = std::max<uint64_t>(
+        static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * total)), 1);
+    uint64_t seen = 0;
+    for (int i = 0; i < kbucket_count; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min(BucketLower(i) + (BucketWidth(i) - 1) / 2.0,
+                            static_cast<double>(max()));
+    }
+    return static_cast<double>(max());
+}
+
+Metrics &Metrics::Global() {
+    static Metrics metrics;
+    return metrics;
+}
+
+const char *Metrics::StageName(MetricStage stage) {
+    static const char *stage_names[] = {
+        "capture", "resize", "yunet",  "align_crop", "sface",
+        "match",   "render", "motion", "tile",       "letterbox"};
+    static_assert(std::size(stage_names) == kmetric_stage_count);
+    return stage_names[stage];
+}
+
+void Metrics::recordLatency(MetricStage stage,
+                            std::chrono::steady_clock::duration duration) {
+    const auto ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    latencies_[stage].record(static_cast<uint64_t>(std::max<int64_t>(ns, 0)));
+}
+
+void Metrics::writePrometheus(std::string &text) const {
+    text += "# HELP face_recognition_stage_seconds 各环节耗时\n"
+            "# TYPE face_recognition_stage_seconds summary\n";
+    char labels[64];
+    for (int stage = 0; stage < kmetric_stage_count; ++stage) {
+        std::snprintf(labels, sizeof(labels), "stage=\"%s\"",
+                      StageName(static_cast<MetricStage>(stage)));
+        AppendSummary(text, "face_recognition_stage_seconds", labels,
+                      latencies_[stage], 1e-9);
+    }
+    text += "# HELP face_recognition_stage_max_seconds 各环节最大耗时\n"
+            "# TYPE face_recognition_stage_max_seconds gauge\n";
+    for (int stage = 0; stage < kmetric_stage_count; ++stage)
+        AppendFormat(text,
+                     "face_recognition_stage_max_seconds{stage=\"%s\"} %.9g\n",
+                     StageName(static_cast<MetricStage>(stage)),
+                     latencies_[stage].max() * 1e-9);
+    text += "# HELP face_recognition_faces_per_frame 每帧检测到的人脸数\n"
+            "# TYPE face_recognition_faces_per_frame summary\n";
+    AppendSummary(text, "face_recognition_faces_per_frame", "", faces_, 1.0);
+}
+
+MetricsExporter::MetricsExporter(const MetricsExportOptions &options)
+    : options_(options) {}
+
+MetricsExporter::~MetricsExporter() { stop(); }
+
+void MetricsExporter::addValue(const std::string &name,
+                               const std::string &help,
+                               const std::string &type, ValueFunc func) {
+    std::lock_guard lock(mutex_);
+    values_.push_back({name, help, type, std::move(func)});
+}
+
+bool MetricsExporter::start() {
+    if (running_)
+        return true;
+    if (options_.port > 0) {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const int reuse = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse,
+                   sizeof(reuse));
+        // 只监听本机，由本机的采集器或反向代理对外
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options_.port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (listen_fd_ < 0 ||
+            bind(listen_fd_, reinterpret_cast<sockaddr *>(&address),
+                 sizeof(address)) != 0 ||
+            listen(listen_fd_, 8) != 0) {
+            std::cerr << "[MetricsExporter->start]:监听端口<" << options_.port
+                      << ">失败:" << std::strerror(errno) << "\n";
+            if (listen_fd_ >= 0)
+                close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+        fcntl(listen_fd_, F_SETFL, fcntl(listen_fd_, F_GETFL) | O_NONBLOCK);
+    }
+    if (pipe(wake_fds_) == 0) {
+        for (const int fd : wake_fds_)
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    } else {
+        wake_fds_[0] = wake_fds_[1] = -1;
+    }
+    running_ = true;
+    thread_ = std::thread(&MetricsExporter::run, this);
+    return true;
+}
+
+void MetricsExporter::stop() {
+    if (!running_.exchange(false))
+        return;
+    if (wake_fds_[1] >= 0) {
+        const char byte = 0;
+        [[maybe_unused]] const auto written = write(wake_fds_[1], &byte, 1);
+    }
+    if (thread_.joinable())
+        thread_.join();
+    for (int *fd : {&listen_fd_, &wake_fds_[0], &wake_fds_[1]}) {
+        if (*fd >= 0)
+            close(*fd);
+        *fd = -1;
+    }
+    if (!options_.file_path.empty())
+        dumpFile();
+}
+
+std::string MetricsExporter::render() const {
+    std::string text;
+    Metrics::Global().writePrometheus(text);
+    std::lock_guard lock(mutex_);
+    for (const auto &value : values_) {
+        text += "# HELP " + value.name + " " + value.help + "\n";
+        text += "# TYPE " + value.name + " " + value.type + "\n";
+        AppendFormat(text, "%s %.17g\n", value.name.c_str(), value.func());
+    }
+    return text;
+}
+
+void MetricsExporter::run() {
+    const bool dump = !options_.file_path.empty();
+    const auto interval =
+        std::max(options_.interval, std::chrono::seconds(1));
+    auto next_dump = std::chrono::steady_clock::now() + interval;
+    while (running_) {
+        pollfd fds[2] = {{wake_fds_[0], POLLIN, 0}, {listen_fd_, POLLIN, 0}};
+        int timeout = -1;
+        if (dump)
+            timeout = static_cast<int>(std::max<int64_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    next_dump - std::chrono::steady_clock::now())
+                    .count(),
+                0));
+        // 没有唤醒管道时定期检查是否停止
+        if (wake_fds_[0] < 0 && (timeout < 0 || timeout > 200))
+            timeout = 200;
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+            break;
+        if (!running_)
+            break;
+        if (fds[1].revents & POLLIN) {
+            const int client_fd = accept4(listen_fd_, nullptr, nullptr,
+                                          SOCK_CLOEXEC);
+            if (client_fd >= 0) {
+                serve(client_fd);
+                close(client_fd);
+            }
+        }
+        if (dump && std::chrono::steady_clock::now() >= next_dump) {
+            dumpFile();
+            next_dump = std::chrono::steady_clock::now() + interval;
+        }
+    }
+}
+
+void MetricsExporter::serve(int client_fd) {
+    // 慢客户端最多占用导出线程200ms
+    timeval timeout{0, 200000};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    char request[1024];
+    const auto length = recv(client_fd, request, sizeof(request) - 1, 0);
+    if (length <= 0)
+        return;
+    request[length] = '\0';
+    const bool found = std::strncmp(request, "GET /metrics", 12) == 0 ||
+                       std::strncmp(request, "GET / ", 6) == 0;
+    const std::string body = found ? render() : "not found\n";
+    std::string response = found ? "HTTP/1.1 200 OK\r\n"
+                                 : "HTTP/1.1 404 Not Found\r\n";
+    response += "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                "Content-Length: " +
+                std::to_string(body.size()) +
+                "\r\nConnection: close\r\n\r\n" + body;
+    for (size_t sent = 0; sent < response.size();) {
+        const auto written = send(client_fd, response.data() + sent,
+                                  response.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0)
+            return;
+        sent += static_cast<size_t>(written);
+    }
+}
+
+bool MetricsExporter::dumpFile() {
+    // 先写临时文件再重命名，读取方不会看到写了一半的文件
+    const auto temp_path = options_.file_path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "[MetricsExporter->dumpFile]:打开<" << temp_path
+                      << ">失败\n";
+            return false;
+        }
+        file << render();
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, options_.file_path, error);
+    if (error) {
+        std::cerr << "[MetricsExporter->dumpFile]:写出<" << options_.file_path
+                  << ">失败:" << error.message() << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,232 @@
+#include "motion_gate.hpp"
+
+// std
+#include <algorithm>
+#include <cstdlib>
+
+// opencv
+#include <opencv2/imgproc.hpp>
+
+// custom
+#include "metrics.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MOTION_X86 1
+#endif
+
+namespace {
+
+/**
+ * @brief 比较一行当前帧与背景，输出每8个像素中变化像素的个数，
+ * 并将背景向当前帧靠近1/2^shift（与_mm256_avg_epu8相同的舍入）
+ *
+ * @param frame 当前帧的一行
+ * @param background 背景的一行，原地更新
+ * @param counts 输出，长度为n/8
+ * @param n 像素数，8的倍数
+ * @param threshold 灰度差阈值
+ * @param shift 背景更新速率
+ */
+using MotionRowFunc = void (*)(const uint8_t *, uint8_t *, uint8_t *, int,
+                               uint8_t, int);
+
+void MotionRowScalar(const uint8_t *frame, uint8_t *background,
+                     uint8_t *counts, int n, uint8_t threshold, int shift) {
+    for (int g = 0; g < n; g += 8) {
+        uint8_t count = 0;
+        for (int i = g; i < g + 8; ++i) {
+            const int b = background[i];
+            count += std::abs(frame[i] - b) > threshold;
+            int target = frame[i];
+            for (int s = 0; s < shift; ++s)
+                target = (b + target + 1) >> 1;
+            background[i] = static_cast<uint8_t>(target);
+        }
+        counts[g / 8] = count;
+    }
+}
+
+#ifdef MOTION_X86
+__attribute__((target("avx2"))) void
+MotionRowAvx2(const uint8_t *frame, uint8_t *background, uint8_t *counts,
+              int n, uint8_t threshold, int shift) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i thresh = _mm256_set1_epi8(static_cast<char>(threshold));
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i f = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(frame + i));
+        const __m256i b = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(background + i));
+        // 无符号饱和减法求绝对差，差超过阈值的像素记为1
+        const __m256i diff =
+            _mm256_or_si256(_mm256_subs_epu8(f, b), _mm256_subs_epu8(b, f));
+        const __m256i still =
+            _mm256_cmpeq_epi8(_mm256_subs_epu8(diff, thresh), zero);
+        const __m256i changed = _mm256_andnot_si256(still, one);
+        // 每8个字节求和，正好是一个单元格宽度
+        const __m256i sums = _mm256_sad_epu8(changed, zero);
+        counts[i / 8] = static_cast<uint8_t>(_mm256_extract_epi64(sums, 0));
+        counts[i / 8 + 1] =
+            static_cast<uint8_t>(_mm256_extract_epi64(sums, 1));
+        counts[i / 8 + 2] =
+            static_cast<uint8_t>(_mm256_extract_epi64(sums, 2));
+        counts[i / 8 + 3] =
+            static_cast<uint8_t>(_mm256_extract_epi64(sums, 3));
+        __m256i target = f;
+        for (int s = 0; s < shift; ++s)
+            target = _mm256_avg_epu8(b, target);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(background + i),
+                            target);
+    }
+    MotionRowScalar(frame + i, background + i, counts + i / 8, n - i,
+                    threshold, shift);
+}
+#endif
+
+MotionRowFunc GetMotionRowFunc() {
+    static const MotionRowFunc func = [] {
+#ifdef MOTION_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return MotionRowAvx2;
+#endif
+        return MotionRowScalar;
+    }();
+    return func;
+}
+
+int RoundUp8(int value) { return std::max((value + 7) / 8 * 8, 8); }
+
+} // namespace
+
+void MotionGate::setParams(const MotionParams &params) {
+    const bool resized = params.width != params_.width;
+    params_ = params;
+    params_.pixel_threshold = std::clamp(params_.pixel_threshold, 0, 255);
+    params_.background_shift = std::clamp(params_.background_shift, 0, 7);
+    params_.full_interval = std::max(params_.full_interval, 1);
+    if (resized)
+        reset();
+    return;
+}
+
+void MotionGate::reset() {
+    background_.release();
+    frames_since_full_ = 0;
+    return;
+}
+
+MotionStats MotionGate::stats() const {
+    std::lock_guard lock(stats_mutex_);
+    return stats_;
+}
+
+cv::Rect MotionGate::snapRegion(const cv::Rect &region,
+                                const cv::Size &size) const {
+    // 依次尝试1/4和1/2大小的窗口，以变化区域为中心并限制在图像内
+    for (const int divisor : {4, 2}) {
+        const cv::Size window(size.width / divisor, size.height / divisor);
+        if (region.width > window.width || region.height > window.height)
+            continue;
+        const int cx = region.x + region.width / 2;
+        const int cy = region.y + region.height / 2;
+        const int x =
+            std::clamp(cx - window.width / 2, 0, size.width - window.width);
+        const int y =
+            std::clamp(cy - window.height / 2, 0, size.height - window.height);
+        return cv::Rect(cv::Point(x, y), window);
+    }
+    return cv::Rect();
+}
+
+MotionDecision MotionGate::update(const cv::Mat &image, const cv::Mat &faces) {
+    MotionDecision decision;
+    const cv::Size small_size(
+        RoundUp8(params_.width),
+        RoundUp8(params_.width * image.rows / std::max(image.cols, 1)));
+    {
+        MetricTimer timer(kmetric_motion);
+        cv::resize(image, small_, small_size, 0, 0, cv::INTER_AREA);
+        if (small_.channels() == 3)
+            cv::cvtColor(small_, gray_, cv::COLOR_BGR2GRAY);
+        else
+            small_.copyTo(gray_);
+    }
+    const bool first = background_.size() != small_size;
+    if (first)
+        gray_.copyTo(background_);
+
+    // 逐行比较，按单元格累加变化像素
+    const int cell_cols = small_size.width / kcell_size;
+    const int cell_rows = small_size.height / kcell_size;
+    cell_counts_.assign(static_cast<size_t>(cell_cols) * cell_rows, 0);
+    row_counts_.resize(cell_cols);
+    const auto motion_row = GetMotionRowFunc();
+    for (int y = 0; y < small_size.height; ++y) {
+        motion_row(gray_.ptr<uint8_t>(y), background_.ptr<uint8_t>(y),
+                   row_counts_.data(), small_size.width,
+                   static_cast<uint8_t>(params_.pixel_threshold),
+                   params_.background_shift);
+        uint16_t *cells = cell_counts_.data() + (y / kcell_size) * cell_cols;
+        for (int c = 0; c < cell_cols; ++c)
+            cells[c] += row_counts_[c];
+    }
+
+    // 运动单元格的外接矩形（单元格坐标）
+    const auto min_count = static_cast<uint16_t>(
+        params_.cell_ratio * kcell_size * kcell_size);
+    int moving = 0;
+    int x0 = cell_cols, y0 = cell_rows, x1 = -1, y1 = -1;
+    for (int r = 0; r < cell_rows; ++r) {
+        for (int c = 0; c < cell_cols; ++c) {
+            if (cell_counts_[r * cell_cols + c] <= min_count)
+                continue;
+            ++moving;
+            x0 = std::min(x0, c);
+            y0 = std::min(y0, r);
+            x1 = std::max(x1, c);
+            y1 = std::max(y1, r);
+        }
+    }
+    decision.motion_ratio =
+        static_cast<float>(moving) / std::max(cell_cols * cell_rows, 1);
+
+    std::lock_guard lock(stats_mutex_);
+    ++stats_.frames;
+    if (first || ++frames_since_full_ >= params_.full_interval) {
+        frames_since_full_ = 0;
+        ++stats_.full;
+        return decision;
+    }
+    if (moving == 0) {
+        decision.detect = false;
+        ++stats_.skipped;
+        return decision;
+    }
+
+    // 外扩一个单元格后映射回原图，再合并上次的人脸（外扩半个人脸）
+    const float sx = static_cast<float>(image.cols) / small_size.width;
+    const float sy = static_cast<float>(image.rows) / small_size.height;
+    cv::Rect region(
+        cv::Point(static_cast<int>((x0 - 1) * kcell_size * sx),
+                  static_cast<int>((y0 - 1) * kcell_size * sy)),
+        cv::Point(static_cast<int>((x1 + 2) * kcell_size * sx),
+                  static_cast<int>((y1 + 2) * kcell_size * sy)));
+    for (int r = 0; r < faces.rows; ++r) {
+        const float *face = faces.ptr<float>(r);
+        region |= cv::Rect(static_cast<int>(face[0] - face[2] / 2),
+                           static_cast<int>(face[1] - face[3] / 2),
+                           static_cast<int>(face[2] * 2),
+                           static_cast<int>(face[3] * 2));
+    }
+    region &= cv::Rect(cv::Point(), image.size());
+    decision.region = snapRegion(region, image.size());
+    if (decision.region.empty())
+        ++stats_.full;
+    else
+        ++stats_.partial;
+    return decision;
+}
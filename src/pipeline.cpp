@@ -0,0 +1,120 @@
+#include "pipeline.hpp"
+
+// std
+#include <algorithm>
+
+void FramePipeline::StageTimer::record(
+    std::chrono::steady_clock::duration duration) {
+    const auto ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+            .count());
+    frames.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+    if (ns > max_ns.load(std::memory_order_relaxed))
+        max_ns.store(ns, std::memory_order_relaxed);
+}
+
+FramePipeline::FramePipeline(const PipelineOptions &options,
+                             CaptureFunc capture, StageFunc detect,
+                             StageFunc recognize, StageFunc render)
+    : options_(options), capture_(std::move(capture)),
+      stage_funcs_{std::move(detect), std::move(recognize),
+                   std::move(render)} {
+    static const char *stage_names[] = {"capture", "detect", "recognize",
+                                        "render"};
+    for (const auto *name : stage_names) {
+        queues_.push_back(std::make_unique<FrameQueue>(
+            std::max<size_t>(options_.queue_capacity, 1)));
+        timers_.push_back(std::make_unique<StageTimer>());
+        timers_.back()->name = name;
+    }
+    // 足够容纳所有在途的帧：每个队列、每个阶段线程和消费者各一帧
+    free_frames_ = std::make_unique<FrameQueue>(
+        queues_.size() * (queues_.front()->capacity() + 1) + 1);
+}
+
+FramePipeline::~FramePipeline() { stop(); }
+
+void FramePipeline::start() {
+    threads_.emplace_back(&FramePipeline::runCapture, this);
+    for (size_t stage = 1; stage <= stage_funcs_.size(); ++stage) {
+        // 最后一个阶段的输出队列由pop()消费
+        threads_.emplace_back(&FramePipeline::runStage, this, stage,
+                              std::ref(*queues_[stage - 1]),
+                              queues_[stage].get());
+    }
+}
+
+void FramePipeline::runCapture() {
+    auto &output = *queues_[0];
+    size_t index = 0;
+    PipelineFrame frame;
+    while (!stop_.load(std::memory_order_acquire)) {
+        // 没有可复用的帧时新建，复用的帧在各阶段中被覆盖
+        if (!free_frames_->tryPop(frame))
+            frame = PipelineFrame();
+        const auto begin = std::chrono::steady_clock::now();
+        if (!capture_(frame.image))
+            break;
+        timers_[0]->record(std::chrono::steady_clock::now() - begin);
+        frame.index = index++;
+        frame.capture_time = begin;
+        if (!output.push(std::move(frame), options_.backpressure))
+            break;
+    }
+    output.close();
+}
+
+void FramePipeline::runStage(size_t stage, FrameQueue &input,
+                             FrameQueue *output) {
+    const auto &func = stage_funcs_[stage - 1];
+    PipelineFrame frame;
+    while (!stop_.load(std::memory_order_acquire) && input.pop(frame)) {
+        const auto begin = std::chrono::steady_clock::now();
+        func(frame);
+        timers_[stage]->record(std::chrono::steady_clock::now() - begin);
+        if (!output->push(std::move(frame), options_.backpressure))
+            break;
+    }
+    output->close();
+}
+
+bool FramePipeline::pop(PipelineFrame &frame) {
+    return queues_.back()->pop(frame);
+}
+
+void FramePipeline::recycle(PipelineFrame &&frame) {
+    // 不阻塞消费者，满了丢弃最旧的
+    free_frames_->push(std::move(frame), kbackpressure_drop_oldest);
+    return;
+}
+
+void FramePipeline::stop() {
+    stop_.store(true, std::memory_order_release);
+    // 关闭所有队列，唤醒阻塞在队列上的线程
+    for (auto &queue : queues_)
+        queue->close();
+    free_frames_->close();
+    for (auto &thread : threads_)
+        if (thread.joinable())
+            thread.join();
+    threads_.clear();
+}
+
+std::vector<StageStats> FramePipeline::stageStats() const {
+    std::vector<StageStats> stats;
+    for (size_t i = 0; i < timers_.size(); ++i) {
+        const auto &timer = *timers_[i];
+        StageStats stage_stats;
+        stage_stats.name = timer.name;
+        stage_stats.frames = timer.frames.load(std::memory_order_relaxed);
+        if (stage_stats.frames > 0)
+            stage_stats.avg_ms =
+                timer.total_ns.load(std::memory_order_relaxed) / 1e6 /
+                stage_stats.frames;
+        stage_stats.max_ms = timer.max_ns.load(std::memory_order_relaxed) / 1e6;
+        stage_stats.dropped = queues_[i]->dropped();
+        stats.push_back(stage_stats);
+    }
+    return stats;
+}
@@ -0,0 +1,173 @@
+#include "precision_check.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// opencv
+#include <opencv2/imgcodecs.hpp>
+
+// custom
+#include "enrollment.hpp"
+
+namespace {
+/**
+ * @brief 一个INT8检测框及其是否命中FP32检测框
+ *
+ */
+struct ScoredDetection {
+    float score;
+    bool true_positive;
+};
+
+float BoxIou(const float *a, const float *b) {
+    const float x1 = std::max(a[0], b[0]);
+    const float y1 = std::max(a[1], b[1]);
+    const float x2 = std::min(a[0] + a[2], b[0] + b[2]);
+    const float y2 = std::min(a[1] + a[3], b[1] + b[3]);
+    const float inter = std::max(x2 - x1, 0.f) * std::max(y2 - y1, 0.f);
+    const float uni = a[2] * a[3] + b[2] * b[3] - inter;
+    return uni > 0.f ? inter / uni : 0.f;
+}
+
+/**
+ * @brief 按置信度从高到低贪心匹配，IoU不低于0.5视为命中
+ *
+ */
+void MatchDetections(const cv::Mat &detections, const cv::Mat &references,
+                     std::vector<ScoredDetection> &scored) {
+    std::vector<int> order(detections.rows);
+    for (int i = 0; i < detections.rows; ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&detections](int a, int b) {
+        return detections.at<float>(a, 14) > detections.at<float>(b, 14);
+    });
+    std::vector<char> used(references.rows, 0);
+    for (const int i : order) {
+        const float *detection = detections.ptr<float>(i);
+        int best = -1;
+        float best_iou = 0.5f;
+        for (int r = 0; r < references.rows; ++r) {
+            const float iou = BoxIou(detection, references.ptr<float>(r));
+            if (!used[r] && iou >= best_iou) {
+                best = r;
+                best_iou = iou;
+            }
+        }
+        if (best >= 0)
+            used[best] = 1;
+        scored.push_back({detection[14], best >= 0});
+    }
+}
+
+/**
+ * @brief 全点插值的AP（VOC2010之后的算法）
+ *
+ */
+double AveragePrecision(std::vector<ScoredDetection> scored,
+                        size_t reference_count) {
+    if (reference_count == 0)
+        return scored.empty() ? 1.0 : 0.0;
+    std::sort(scored.begin(), scored.end(),
+              [](const ScoredDetection &a, const ScoredDetection &b) {
+                  return a.score > b.score;
+              });
+    std::vector<double> precisions, recalls;
+    size_t true_positives = 0;
+    for (size_t i = 0; i < scored.size(); ++i) {
+        true_positives += scored[i].true_positive;
+        precisions.push_back(static_cast<double>(true_positives) / (i + 1));
+        recalls.push_back(static_cast<double>(true_positives) /
+                          reference_count);
+    }
+    // 精度取右侧最大值，使曲线单调
+    for (size_t i = precisions.size(); i-- > 1;)
+        precisions[i - 1] = std::max(precisions[i - 1], precisions[i]);
+    double ap = 0.0, last_recall = 0.0;
+    for (size_t i = 0; i < scored.size(); ++i) {
+        ap += (recalls[i] - last_recall) * precisions[i];
+        last_recall = recalls[i];
+    }
+    return ap;
+}
+
+template <typename Func> double ElapsedMs(Func &&func) {
+    const auto begin = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - begin)
+        .count();
+}
+
+double Cosine(const cv::Mat &a, const cv::Mat &b) {
+    const double norm = cv::norm(a) * cv::norm(b);
+    return norm > 0.0 ? a.dot(b) / norm : 0.0;
+}
+} // namespace
+
+bool CheckPrecision(const std::vector<std::string> &image_paths,
+                    YuNet &yunet_fp32, YuNet &yunet_int8, SFace &sface_fp32,
+                    SFace &sface_int8, float cosine_threshold,
+                    PrecisionReport &report) {
+    report = PrecisionReport();
+    std::vector<ScoredDetection> scored;
+    double cos_sum = 0.0;
+    bool sface_warm = false;
+    for (const auto &image_path : image_paths) {
+        const auto image = cv::imread(image_path);
+        if (image.empty())
+            continue;
+        // 第一张图片只用于预热，避免首次推理的初始化计入耗时
+        if (report.images == 0) {
+            yunet_fp32.inferLetterbox(image, kenroll_input_size);
+            yunet_int8.inferLetterbox(image, kenroll_input_size);
+        }
+        ++report.images;
+
+        cv::Mat faces_fp32, faces_int8;
+        report.yunet.fp32_ms += ElapsedMs([&] {
+            faces_fp32 = yunet_fp32.inferLetterbox(image, kenroll_input_size);
+        });
+        report.yunet.int8_ms += ElapsedMs([&] {
+            faces_int8 = yunet_int8.inferLetterbox(image, kenroll_input_size);
+        });
+        report.faces += faces_fp32.rows;
+        MatchDetections(faces_int8, faces_fp32, scored);
+
+        for (int i = 0; i < faces_fp32.rows; ++i) {
+            const cv::Mat face = faces_fp32.row(i);
+            cv::Mat feature_fp32, feature_int8;
+            if (!sface_warm) {
+                sface_fp32.extractFeatures(image, face, feature_fp32);
+                sface_int8.extractFeatures(image, face, feature_int8);
+                sface_warm = true;
+            }
+            report.sface.fp32_ms += ElapsedMs([&] {
+                sface_fp32.extractFeatures(image, face, feature_fp32);
+            });
+            report.sface.int8_ms += ElapsedMs([&] {
+                sface_int8.extractFeatures(image, face, feature_int8);
+            });
+            const double cosine = Cosine(feature_fp32, feature_int8);
+            cos_sum += cosine;
+            report.embedding_cos_min =
+                std::min(report.embedding_cos_min, cosine);
+            report.embedding_below_threshold += cosine < cosine_threshold;
+        }
+    }
+    if (report.images == 0) {
+        std::cerr << "[CheckPrecision]:没有可用的图片\n";
+        return false;
+    }
+
+    report.detection_ap = AveragePrecision(scored, report.faces);
+    report.yunet.fp32_ms /= report.images;
+    report.yunet.int8_ms /= report.images;
+    if (report.faces > 0) {
+        report.embedding_cos_mean = cos_sum / report.faces;
+        report.sface.fp32_ms /= report.faces;
+        report.sface.int8_ms /= report.faces;
+    }
+    return true;
+}
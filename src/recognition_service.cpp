@@ -0,0 +1,216 @@
+#include "recognition_service.hpp"
+
+// std
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+namespace {
+// 推理线程所属的服务和线程编号，推理线程中（回调或恢复的协程）提交的帧
+// 放入本线程的队列
+thread_local const RecognitionService *tls_service = nullptr;
+thread_local size_t tls_worker = 0;
+} // namespace
+
+RecognitionService::RecognitionService(const RecognitionOptions &options,
+                                       const DetectorFactory &detector_factory)
+    : options_(options) {
+    options_.max_batch = std::max<size_t>(options_.max_batch, 1);
+    size_t thread_count = options_.thread_count;
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    // 每个推理线程匹配时持有一个读者槽位
+    thread_count = std::min(thread_count, GalleryStore::kmax_readers);
+    if (options_.cv_threads >= 0) {
+        cv_threads_ = cv::getNumThreads();
+        cv::setNumThreads(options_.cv_threads);
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->detector = detector_factory();
+        workers_.push_back(std::move(worker));
+    }
+    for (size_t i = 0; i < thread_count; ++i)
+        workers_[i]->thread =
+            std::thread(&RecognitionService::workerLoop, this, i);
+}
+
+RecognitionService::~RecognitionService() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        stopping_ = true;
+    }
+    idle_cv_.notify_all();
+    for (auto &worker : workers_)
+        worker->thread.join();
+    if (options_.cv_threads >= 0)
+        cv::setNumThreads(cv_threads_);
+}
+
+std::future<RecognitionResult> RecognitionService::submit(cv::Mat frame) {
+    Task task;
+    task.frame = std::move(frame);
+    auto future = task.promise.get_future();
+    push(std::move(task));
+    return future;
+}
+
+void RecognitionService::submit(cv::Mat frame, ResultCallback on_result) {
+    Task task;
+    task.frame = std::move(frame);
+    task.on_result = std::move(on_result);
+    push(std::move(task));
+    return;
+}
+
+void RecognitionService::Awaiter::await_suspend(
+    std::coroutine_handle<> handle) {
+    service_.submit(std::move(frame_),
+                    [this, handle](RecognitionResult result) {
+                        result_ = std::move(result);
+                        handle.resume();
+                    });
+    return;
+}
+
+RecognitionStats RecognitionService::stats() const {
+    RecognitionStats stats;
+    stats.submitted = submitted_.load(std::memory_order_relaxed);
+    stats.completed = completed_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.stolen = stolen_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void RecognitionService::push(Task task) {
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    const size_t index =
+        tls_service == this
+            ? tls_worker
+            : next_worker_.fetch_add(1, std::memory_order_relaxed) %
+                  workers_.size();
+    auto &worker = *workers_[index];
+    {
+        // 先计数再放入队列，其他线程取走该帧时计数不会先减到负数
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        pending_.fetch_add(1);
+        worker.tasks.push_back(std::move(task));
+    }
+    // 先加锁再通知，等待的线程不会错过计数的变化
+    { std::lock_guard<std::mutex> lock(idle_mutex_); }
+    idle_cv_.notify_one();
+    return;
+}
+
+bool RecognitionService::takeBatch(size_t index) {
+    auto &self = *workers_[index];
+    self.batch.clear();
+    {
+        std::lock_guard<std::mutex> lock(self.mutex);
+        while (!self.tasks.empty() && self.batch.size() < options_.max_batch) {
+            self.batch.push_back(std::move(self.tasks.front()));
+            self.tasks.pop_front();
+        }
+    }
+    // 不满一批时从其他线程队列的队尾窃取，与队列主人从两端取帧
+    for (size_t k = 1; k < workers_.size() &&
+                       self.batch.size() < options_.max_batch;
+         ++k) {
+        auto &victim = *workers_[(index + k) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        while (!victim.tasks.empty() &&
+               self.batch.size() < options_.max_batch) {
+            self.batch.push_back(std::move(victim.tasks.back()));
+            victim.tasks.pop_back();
+            stolen_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (self.batch.empty())
+        return false;
+    pending_.fetch_sub(self.batch.size());
+    return true;
+}
+
+void RecognitionService::runBatch(Worker &worker) {
+    worker.inputs.clear();
+    for (const auto &task : worker.batch)
+        worker.inputs.push_back(task.frame);
+    // 推理失败时整批结果为空；非OpenCV异常原样交给future
+    bool ok = true;
+    std::exception_ptr error;
+    try {
+        worker.detector->detectFaces(worker.inputs, options_.top_k,
+                                     options_.scale, worker.detect_results);
+    } catch (const cv::Exception &e) {
+        std::cerr << "[RecognitionService->runBatch]:" << worker.batch.size()
+                  << "帧推理失败:" << e.what() << "\n";
+        ok = false;
+    } catch (...) {
+        std::cerr << "[RecognitionService->runBatch]:" << worker.batch.size()
+                  << "帧推理抛出未知异常\n";
+        ok = false;
+        error = std::current_exception();
+    }
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    // 每个任务都必须完成，否则等待的调用方或协程永远不会返回
+    for (size_t k = 0; k < worker.batch.size(); ++k) {
+        RecognitionResult result;
+        result.ok = ok;
+        auto task_error = error;
+        if (ok) {
+            try {
+                // 结果交给调用方，检测结果移出，匹配结果复制，帧缓冲留给下一批
+                result.detect_result = std::move(worker.detect_results[k]);
+                worker.detector->matchTargetFace(result.detect_result,
+                                                 worker.context);
+                result.match_data_vec = worker.context.match_data_vec;
+            } catch (const cv::Exception &e) {
+                std::cerr << "[RecognitionService->runBatch]:匹配失败:"
+                          << e.what() << "\n";
+                result = RecognitionResult();
+                result.ok = false;
+            } catch (...) {
+                std::cerr
+                    << "[RecognitionService->runBatch]:匹配抛出未知异常\n";
+                result = RecognitionResult();
+                result.ok = false;
+                task_error = std::current_exception();
+            }
+        }
+        completed_.fetch_add(1, std::memory_order_relaxed);
+        auto &task = worker.batch[k];
+        if (task.on_result) {
+            // 回调的异常不能终止推理线程，也不能影响同批的其他帧
+            try {
+                task.on_result(std::move(result));
+            } catch (...) {
+                std::cerr << "[RecognitionService->runBatch]:回调抛出异常\n";
+            }
+        } else if (task_error) {
+            task.promise.set_exception(task_error);
+        } else {
+            task.promise.set_value(std::move(result));
+        }
+    }
+    worker.batch.clear();
+    worker.inputs.clear();
+    return;
+}
+
+void RecognitionService::workerLoop(size_t index) {
+    tls_service = this;
+    tls_worker = index;
+    auto &worker = *workers_[index];
+    while (true) {
+        if (takeBatch(index)) {
+            runBatch(worker);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        idle_cv_.wait(lock,
+                      [this] { return stopping_ || pending_.load() > 0; });
+        // 停止时先处理完所有已提交的帧
+        if (stopping_ && pending_.load() == 0)
+            return;
+    }
+}
@@ -0,0 +1,272 @@
+#include "stream_server.hpp"
+
+// std
+#include <algorithm>
+#include <utility>
+
+// custom
+#include "metrics.hpp"
+
+namespace {
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+} // namespace
+
+StreamServer::StreamServer(const StreamServerOptions &options,
+                           std::vector<cv::Ptr<Detector>> detectors)
+    : options_(options), detectors_(std::move(detectors)) {
+    options_.batch_size = std::max<size_t>(options_.batch_size, 1);
+}
+
+StreamServer::~StreamServer() { stop(); }
+
+size_t StreamServer::addStream(const std::string &name, CaptureFunc capture) {
+    auto stream = std::make_unique<Stream>();
+    stream->id = streams_.size();
+    stream->name = name;
+    stream->capture = std::move(capture);
+    stream->queue = std::make_unique<FrameQueue>(
+        std::max<size_t>(options_.queue_capacity, 1));
+    // 足够容纳所有在途的帧：队列中、推理线程和采集线程各一帧
+    stream->free_frames =
+        std::make_unique<FrameQueue>(stream->queue->capacity() + 2);
+    stream->tracker.setParams(options_.track_params);
+    stream->motion_gate.setParams(options_.motion_params);
+    streams_.push_back(std::move(stream));
+    return streams_.size() - 1;
+}
+
+void StreamServer::start() {
+    for (auto &stream : streams_)
+        threads_.emplace_back(&StreamServer::runCapture, this,
+                              std::ref(*stream));
+    for (auto &detector : detectors_)
+        threads_.emplace_back(&StreamServer::runWorker, this,
+                              std::ref(*detector));
+}
+
+void StreamServer::notify() {
+    event_.fetch_add(1, std::memory_order_release);
+    event_.notify_all();
+}
+
+void StreamServer::runCapture(Stream &stream) {
+    size_t index = 0;
+    PipelineFrame frame;
+    while (!stop_.load(std::memory_order_acquire)) {
+        // 没有可复用的帧时新建，复用的帧在推理线程中被覆盖
+        if (!stream.free_frames->tryPop(frame))
+            frame = PipelineFrame();
+        const auto begin = std::chrono::steady_clock::now();
+        if (!stream.capture(frame.image))
+            break;
+        frame.index = index++;
+        frame.capture_time = begin;
+        if (!stream.queue->push(std::move(frame), options_.backpressure))
+            break;
+        notify();
+    }
+    stream.capture_done.store(true, std::memory_order_release);
+    notify();
+}
+
+bool StreamServer::streamFinished(const Stream &stream) const {
+    return stream.capture_done.load(std::memory_order_acquire) &&
+           stream.queue->size() == 0 &&
+           !stream.busy.load(std::memory_order_acquire);
+}
+
+bool StreamServer::acquireBatch(std::vector<Stream *> &streams,
+                                std::vector<PipelineFrame> &frames) {
+    streams.clear();
+    frames.clear();
+    const size_t count = streams_.size();
+    while (!stop_.load(std::memory_order_acquire)) {
+        const auto event = event_.load(std::memory_order_acquire);
+        // 每次从下一路视频开始轮询，每路最多取一帧
+        const size_t start = cursor_.fetch_add(1, std::memory_order_relaxed);
+        bool all_finished = true;
+        for (size_t k = 0; k < count && streams.size() < options_.batch_size;
+             ++k) {
+            auto &stream = *streams_[(start + k) % count];
+            if (!streamFinished(stream))
+                all_finished = false;
+            if (stream.busy.exchange(true, std::memory_order_acquire))
+                continue;
+            PipelineFrame frame;
+            if (stream.queue->tryPop(frame)) {
+                streams.push_back(&stream);
+                frames.push_back(std::move(frame));
+            } else {
+                stream.busy.store(false, std::memory_order_release);
+            }
+        }
+        if (!streams.empty())
+            return true;
+        if (all_finished)
+            return false;
+        event_.wait(event, std::memory_order_acquire);
+    }
+    return false;
+}
+
+void StreamServer::release(Stream &stream) {
+    stream.busy.store(false, std::memory_order_release);
+    // 该路视频可能还有等待处理的帧
+    notify();
+}
+
+void StreamServer::record(Stream &stream, const PipelineFrame &frame) {
+    const int64_t now_ns = NowNs();
+    const auto latency_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - frame.capture_time)
+            .count());
+    stream.frames.fetch_add(1, std::memory_order_relaxed);
+    stream.total_latency_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+    if (latency_ns > stream.max_latency_ns.load(std::memory_order_relaxed))
+        stream.max_latency_ns.store(latency_ns, std::memory_order_relaxed);
+    int64_t expected = 0;
+    stream.first_done_ns.compare_exchange_strong(expected, now_ns,
+                                                 std::memory_order_relaxed);
+    stream.last_done_ns.store(now_ns, std::memory_order_relaxed);
+}
+
+void StreamServer::runWorker(Detector &detector) {
+    std::vector<Stream *> streams;
+    std::vector<PipelineFrame> frames;
+    std::vector<cv::Mat> images, inputs, faces_vec;
+    std::vector<FaceTracker *> trackers;
+    std::vector<DetectResult> detect_results;
+    // 需要检测的帧在批次中的位置及其检测区域
+    std::vector<size_t> detected;
+    std::vector<cv::Rect> regions;
+    while (acquireBatch(streams, frames)) {
+        images.clear();
+        inputs.clear();
+        detected.clear();
+        regions.clear();
+        for (size_t k = 0; k < frames.size(); ++k) {
+            auto &stream = *streams[k];
+            auto &frame = frames[k];
+            // 画面静止时跳过检测，只有部分区域变化时只检测该区域
+            MotionDecision motion;
+            if (options_.motion_params.enabled)
+                motion = stream.motion_gate.update(frame.image,
+                                                   stream.last_faces);
+            frame.detected = motion.detect;
+            if (frame.detected) {
+                detected.push_back(k);
+                regions.push_back(motion.region);
+                images.push_back(frame.image);
+                inputs.push_back(motion.region.empty()
+                                     ? frame.image
+                                     : frame.image(motion.region));
+                continue;
+            }
+            auto &context = frame.context;
+            if (options_.tracking) {
+                detector.matchPredictedFace(stream.tracker, context);
+                continue;
+            }
+            // 人脸复制一份，不引用下一帧会覆盖的缓冲
+            stream.last_faces.copyTo(context.detect_result.faces);
+            context.match_data_vec = stream.last_match_data_vec;
+            for (int r = 0; r < stream.last_faces.rows; ++r)
+                context.match_data_vec[r].face =
+                    context.detect_result.faces.row(r);
+        }
+        if (!detected.empty() && options_.tracking) {
+            faces_vec.clear();
+            trackers.clear();
+            for (size_t i = 0; i < detected.size(); ++i) {
+                auto &faces = faces_vec.emplace_back();
+                detector.detectFaceBoxes(inputs[i], options_.top_k, 1.f,
+                                         faces);
+                OffsetFaces(faces, regions[i].tl());
+                trackers.push_back(&streams[detected[i]]->tracker);
+            }
+            auto match_data_vecs =
+                detector.matchTrackedFaces(images, faces_vec, trackers);
+            for (size_t i = 0; i < detected.size(); ++i) {
+                auto &context = frames[detected[i]].context;
+                context.detect_result.faces = faces_vec[i];
+                context.match_data_vec = std::move(match_data_vecs[i]);
+            }
+        } else if (!detected.empty()) {
+            // 与逐帧detectFace相同，图像大于一个图块时分块检测
+            detector.detectFaces(inputs, options_.top_k, 1.f, detect_results);
+            for (size_t i = 0; i < detected.size(); ++i) {
+                auto &stream = *streams[detected[i]];
+                auto &context = frames[detected[i]].context;
+                OffsetFaces(detect_results[i].faces, regions[i].tl());
+                std::swap(context.detect_result, detect_results[i]);
+                detector.matchTargetFace(context.detect_result, context);
+                stream.last_match_data_vec = context.match_data_vec;
+            }
+        }
+        for (const auto k : detected) {
+            const auto &faces = frames[k].context.detect_result.faces;
+            faces.copyTo(streams[k]->last_faces);
+            Metrics::Global().recordFaces(faces.rows);
+        }
+        for (size_t k = 0; k < frames.size(); ++k) {
+            auto &stream = *streams[k];
+            record(stream, frames[k]);
+            // 回调在释放之前调用，同一路视频的回调按帧序且不会并发
+            if (on_result_)
+                on_result_(stream.id, frames[k]);
+            // 不阻塞推理线程，满了丢弃最旧的
+            stream.free_frames->push(std::move(frames[k]),
+                                     kbackpressure_drop_oldest);
+            release(stream);
+        }
+    }
+}
+
+bool StreamServer::finished() const {
+    return std::all_of(
+        streams_.begin(), streams_.end(),
+        [this](const auto &stream) { return streamFinished(*stream); });
+}
+
+void StreamServer::stop() {
+    stop_.store(true, std::memory_order_release);
+    for (auto &stream : streams_) {
+        stream->queue->close();
+        stream->free_frames->close();
+    }
+    notify();
+    for (auto &thread : threads_)
+        if (thread.joinable())
+            thread.join();
+    threads_.clear();
+}
+
+std::vector<StreamStats> StreamServer::streamStats() const {
+    std::vector<StreamStats> stats;
+    for (const auto &stream : streams_) {
+        StreamStats stream_stats;
+        stream_stats.name = stream->name;
+        stream_stats.frames = stream->frames.load(std::memory_order_relaxed);
+        if (stream_stats.frames > 0)
+            stream_stats.avg_latency_ms =
+                stream->total_latency_ns.load(std::memory_order_relaxed) /
+                1e6 / stream_stats.frames;
+        stream_stats.max_latency_ms =
+            stream->max_latency_ns.load(std::memory_order_relaxed) / 1e6;
+        const auto elapsed_ns =
+            stream->last_done_ns.load(std::memory_order_relaxed) -
+            stream->first_done_ns.load(std::memory_order_relaxed);
+        if (stream_stats.frames > 1 && elapsed_ns > 0)
+            stream_stats.fps = (stream_stats.frames - 1) * 1e9 / elapsed_ns;
+        stream_stats.dropped = stream->queue->dropped();
+        stream_stats.motion_skipped = stream->motion_gate.stats().skipped;
+        stream_stats.finished = streamFinished(*stream);
+        stats.push_back(stream_stats);
+    }
+    return stats;
+}
@@ -0,0 +1,243 @@
+#include "tiled_detector.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+// custom
+#include "metrics.hpp"
+
+namespace {
+// 小框大部分落在大框内时视为同一张人脸被图块边缘截断的部分
+constexpr float kcontain_threshold = 0.8f;
+
+/**
+ * @brief 沿一个方向排列图块起点，最后一块与图像边缘对齐
+ *
+ * @param length 图像边长
+ * @param tile 图块边长
+ * @param step 步长
+ * @return std::vector<int>
+ */
+std::vector<int> TileStarts(int length, int tile, int step) {
+    std::vector<int> starts = {0};
+    while (starts.back() + tile < length)
+        starts.push_back(std::min(starts.back() + step, length - tile));
+    return starts;
+}
+
+/**
+ * @brief 两个人脸框是否为同一张人脸
+ *
+ * @param a 人脸a（YuNet格式）
+ * @param b 人脸b
+ * @param nms_threshold IoU阈值
+ * @return true 重复
+ */
+bool Overlapped(const float *a, const float *b, float nms_threshold) {
+    const float w = std::min(a[0] + a[2], b[0] + b[2]) - std::max(a[0], b[0]);
+    const float h = std::min(a[1] + a[3], b[1] + b[3]) - std::max(a[1], b[1]);
+    if (w <= 0.f || h <= 0.f)
+        return false;
+    const float inter = w * h;
+    const float area_a = a[2] * a[3];
+    const float area_b = b[2] * b[3];
+    return inter > nms_threshold * (area_a + area_b - inter) ||
+           inter > kcontain_threshold * std::min(area_a, area_b);
+}
+} // namespace
+
+TiledDetector::TiledDetector(const TileOptions &options,
+                             const YuNetFactory &yunet_factory)
+    : options_(options) {
+    options_.tile_size = std::max(options_.tile_size, 32);
+    options_.overlap = std::clamp(options_.overlap, 0.f, 0.9f);
+    size_t thread_count = options_.thread_count;
+    if (thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t i = 0; i < thread_count; ++i)
+        yunets_.push_back(yunet_factory());
+    for (size_t i = 1; i < thread_count; ++i)
+        threads_.emplace_back(&TiledDetector::workerLoop, this, i);
+}
+
+TiledDetector::~TiledDetector() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto &thread : threads_)
+        thread.join();
+}
+
+void TiledDetector::layoutTiles(const cv::Size &size) {
+    if (size == image_size_)
+        return;
+    image_size_ = size;
+    const int tile_w = std::min(options_.tile_size, size.width);
+    const int tile_h = std::min(options_.tile_size, size.height);
+    const int overlap =
+        static_cast<int>(std::lround(options_.tile_size * options_.overlap));
+    const int step = std::max(options_.tile_size - overlap, 1);
+    tiles_.clear();
+    for (const int y : TileStarts(size.height, tile_h, step))
+        for (const int x : TileStarts(size.width, tile_w, step))
+            tiles_.emplace_back(x, y, tile_w, tile_h);
+    tile_faces_.resize(tiles_.size());
+    cursor_ = 0;
+    return;
+}
+
+void TiledDetector::coarseDetect(const cv::Mat &image, int top_k) {
+    const float scale = options_.coarse_scale;
+    if (scale <= 0.f) {
+        coarse_faces_.create(0, 15, CV_32F);
+        return;
+    }
+    {
+        MetricTimer timer(kmetric_tile);
+        cv::resize(image, coarse_input_, cv::Size(), scale, scale,
+                   cv::INTER_AREA);
+    }
+    auto &yunet = *yunets_[0];
+    yunet.setTopK(top_k);
+    yunet.setInputSize(coarse_input_.size());
+    yunet.infer(coarse_input_, coarse_faces_);
+    // 框和关键点映射回原图，第14列置信度不变
+    for (int r = 0; r < coarse_faces_.rows; ++r) {
+        float *face = coarse_faces_.ptr<float>(r);
+        for (int c = 0; c < 14; ++c)
+            face[c] /= scale;
+    }
+    return;
+}
+
+void TiledDetector::selectTiles() {
+    selected_.clear();
+    const size_t budget =
+        options_.max_tiles > 0
+            ? std::min(static_cast<size_t>(options_.max_tiles), tiles_.size())
+            : tiles_.size();
+    if (budget == tiles_.size()) {
+        for (size_t i = 0; i < tiles_.size(); ++i)
+            selected_.push_back(i);
+        return;
+    }
+    // 粗检测结果按置信度从高到低，命中的图块优先
+    tile_hit_.assign(tiles_.size(), false);
+    for (int r = 0; r < coarse_faces_.rows && selected_.size() < budget;
+         ++r) {
+        const float *face = coarse_faces_.ptr<float>(r);
+        const cv::Rect box(cv::Point(static_cast<int>(face[0]),
+                                     static_cast<int>(face[1])),
+                           cv::Size(std::max(static_cast<int>(face[2]), 1),
+                                    std::max(static_cast<int>(face[3]), 1)));
+        for (size_t i = 0; i < tiles_.size() && selected_.size() < budget;
+             ++i) {
+            if (!tile_hit_[i] && (tiles_[i] & box).area() > 0) {
+                tile_hit_[i] = true;
+                selected_.push_back(i);
+            }
+        }
+    }
+    // 剩余的名额轮流分给其他图块
+    for (size_t n = 0; n < tiles_.size() && selected_.size() < budget; ++n) {
+        const size_t i = cursor_;
+        cursor_ = (cursor_ + 1) % tiles_.size();
+        if (!tile_hit_[i])
+            selected_.push_back(i);
+    }
+    return;
+}
+
+void TiledDetector::runTiles(size_t worker) {
+    auto &yunet = *yunets_[worker];
+    yunet.setTopK(top_k_);
+    for (size_t k = next_tile_.fetch_add(1, std::memory_order_relaxed);
+         k < selected_.size();
+         k = next_tile_.fetch_add(1, std::memory_order_relaxed)) {
+        const auto &tile = tiles_[selected_[k]];
+        yunet.setInputSize(tile.size());
+        yunet.infer((*image_)(tile), tile_faces_[k]);
+    }
+    return;
+}
+
+void TiledDetector::workerLoop(size_t worker) {
+    size_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cv_.wait(lock, [this, seen] {
+                return stopping_ || generation_ != seen;
+            });
+            if (stopping_)
+                return;
+            seen = generation_;
+        }
+        runTiles(worker);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--active_ == 0)
+            done_cv_.notify_one();
+    }
+}
+
+void TiledDetector::detect(const cv::Mat &image, int top_k, cv::Mat &faces) {
+    layoutTiles(image.size());
+    coarseDetect(image, top_k);
+    selectTiles();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        image_ = &image;
+        top_k_ = top_k;
+        next_tile_.store(0, std::memory_order_relaxed);
+        active_ = threads_.size();
+        ++generation_;
+    }
+    start_cv_.notify_all();
+    // 调用线程也参与检测
+    runTiles(0);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this] { return active_ == 0; });
+        image_ = nullptr;
+    }
+    mergeFaces(top_k, faces);
+    return;
+}
+
+void TiledDetector::mergeFaces(int top_k, cv::Mat &faces) {
+    candidates_.clear();
+    for (int r = 0; r < coarse_faces_.rows; ++r)
+        candidates_.push_back(coarse_faces_.ptr<float>(r));
+    // 图块结果映射回原图坐标
+    for (size_t k = 0; k < selected_.size(); ++k) {
+        const auto &tile = tiles_[selected_[k]];
+        auto &tile_faces = tile_faces_[k];
+        OffsetFaces(tile_faces, tile.tl());
+        for (int r = 0; r < tile_faces.rows; ++r)
+            candidates_.push_back(tile_faces.ptr<float>(r));
+    }
+    // 按置信度从高到低贪心NMS
+    std::stable_sort(candidates_.begin(), candidates_.end(),
+                     [](const float *a, const float *b) {
+                         return a[14] > b[14];
+                     });
+    kept_.clear();
+    const size_t limit =
+        top_k > 0 ? static_cast<size_t>(top_k) : candidates_.size();
+    for (size_t i = 0; i < candidates_.size() && kept_.size() < limit; ++i) {
+        const bool duplicate =
+            std::any_of(kept_.begin(), kept_.end(), [&](int j) {
+                return Overlapped(candidates_[i], candidates_[j],
+                                  options_.nms_threshold);
+            });
+        if (!duplicate)
+            kept_.push_back(static_cast<int>(i));
+    }
+    faces.create(static_cast<int>(kept_.size()), 15, CV_32F);
+    for (int r = 0; r < faces.rows; ++r)
+        std::copy_n(candidates_[kept_[r]], 15, faces.ptr<float>(r));
+    return;
+}
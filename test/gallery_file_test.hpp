@@ -0,0 +1,133 @@
+#pragma once
+// std
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+// posix
+#include <unistd.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+// custom
+#include "detector.hpp"
+#include "gallery_file.hpp"
+
+namespace gallery_file_test {
+constexpr uint64_t kmodel_hash = 0x1234;
+
+class GalleryFileTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        path_ = (std::filesystem::temp_directory_path() /
+                 ("gallery_file_test_" + std::to_string(::getpid()) +
+                  ".gallery"))
+                    .string();
+        std::mt19937 rng(5);
+        std::normal_distribution<float> dist(0.f, 1.f);
+        for (int i = 0; i < 9; ++i) {
+            cv::Mat feature(1, SFace::kfeature_dim, CV_32F);
+            for (int j = 0; j < SFace::kfeature_dim; ++j)
+                feature.ptr<float>(0)[j] = dist(rng);
+            gallery_.add("name" + std::to_string(i * 7), feature);
+        }
+        ASSERT_TRUE(SaveGallery(path_, gallery_, kmodel_hash));
+        std::ifstream file(path_, std::ios::binary);
+        file.read(reinterpret_cast<char *>(&header_), sizeof(header_));
+    }
+
+    void TearDown() override { std::filesystem::remove(path_); }
+
+    // 覆盖文件中的一个字段
+    template <typename T> void patch(size_t offset, T value) {
+        std::fstream file(path_,
+                          std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    bool load() {
+        Gallery loaded;
+        return LoadGallery(path_, kmodel_hash, loaded);
+    }
+
+    std::string path_;
+    Gallery gallery_;
+    GalleryFileHeader header_{};
+};
+} // namespace gallery_file_test
+
+using gallery_file_test::GalleryFileTest;
+
+TEST_F(GalleryFileTest, RoundTrip) {
+    Gallery loaded;
+    ASSERT_TRUE(LoadGallery(path_, gallery_file_test::kmodel_hash, loaded));
+    EXPECT_TRUE(loaded.isAttached());
+    ASSERT_EQ(loaded.size(), gallery_.size());
+    ASSERT_EQ(loaded.dim(), gallery_.dim());
+    ASSERT_EQ(loaded.stride(), gallery_.stride());
+    for (size_t i = 0; i < gallery_.size(); ++i) {
+        EXPECT_EQ(loaded.name(i), gallery_.name(i));
+        for (int j = 0; j < gallery_.dim(); ++j)
+            EXPECT_EQ(loaded.row(i)[j], gallery_.row(i)[j]);
+    }
+    EXPECT_EQ(HashGallery(loaded), HashGallery(gallery_));
+    EXPECT_EQ(std::filesystem::file_size(path_), GalleryFileSize(gallery_));
+
+    // 模型不一致时拒绝
+    EXPECT_FALSE(LoadGallery(path_, gallery_file_test::kmodel_hash + 1,
+                             loaded));
+}
+
+TEST_F(GalleryFileTest, RejectsCorruptedHeader) {
+    patch(offsetof(GalleryFileHeader, magic), 'X');
+    EXPECT_FALSE(load());
+    patch(offsetof(GalleryFileHeader, magic), kgallery_magic[0]);
+    ASSERT_TRUE(load());
+
+    // 个数大到偏移表字节数溢出
+    patch(offsetof(GalleryFileHeader, count),
+          header_.count + (uint64_t(1) << 61));
+    EXPECT_FALSE(load());
+    patch(offsetof(GalleryFileHeader, count), header_.count);
+
+    // 名字表与文件头重叠或未对齐
+    patch(offsetof(GalleryFileHeader, names_offset), uint64_t(8));
+    EXPECT_FALSE(load());
+    patch(offsetof(GalleryFileHeader, names_offset), header_.names_offset + 4);
+    EXPECT_FALSE(load());
+    patch(offsetof(GalleryFileHeader, names_offset), header_.features_offset);
+    EXPECT_FALSE(load());
+    patch(offsetof(GalleryFileHeader, names_offset), header_.names_offset);
+
+    patch(offsetof(GalleryFileHeader, dim), uint32_t(0));
+    EXPECT_FALSE(load());
+    patch(offsetof(GalleryFileHeader, dim), header_.dim + 16);
+    EXPECT_FALSE(load());
+    patch(offsetof(GalleryFileHeader, dim), header_.dim);
+
+    patch(offsetof(GalleryFileHeader, features_offset),
+          header_.features_offset + 64);
+    EXPECT_FALSE(load());
+    patch(offsetof(GalleryFileHeader, features_offset),
+          header_.features_offset);
+    EXPECT_TRUE(load());
+}
+
+TEST_F(GalleryFileTest, RejectsTruncatedFile) {
+    std::filesystem::resize_file(path_, header_.file_size - 4);
+    EXPECT_FALSE(load());
+    std::filesystem::resize_file(path_, sizeof(GalleryFileHeader) / 2);
+    EXPECT_FALSE(load());
+}
+
+TEST_F(GalleryFileTest, RejectsBadNameOffsets) {
+    // 名字偏移不递增
+    patch(header_.names_offset + sizeof(uint64_t),
+          uint64_t(header_.features_offset));
+    EXPECT_FALSE(load());
+}
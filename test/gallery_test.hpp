@@ -0,0 +1,211 @@
+#pragma once
+// std
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+// gtest
+#include <gtest/gtest.h>
+
+// custom
+#include "gallery.hpp"
+#include "gallery_store.hpp"
+
+namespace gallery_test {
+constexpr int kdim = 128;
+
+// 可复现的随机特征
+cv::Mat RandomFeature(std::mt19937 &rng) {
+    std::normal_distribution<float> dist(0.f, 1.f);
+    cv::Mat feature(1, kdim, CV_32F);
+    for (int i = 0; i < kdim; ++i)
+        feature.ptr<float>(0)[i] = dist(rng);
+    return feature;
+}
+
+float Cosine(const float *a, const float *b) {
+    double dot = 0, na = 0, nb = 0;
+    for (int i = 0; i < kdim; ++i) {
+        const double x = a[i], y = b[i];
+        dot += x * y;
+        na += x * x;
+        nb += y * y;
+    }
+    return static_cast<float>(dot / std::sqrt(na * nb));
+}
+} // namespace gallery_test
+
+TEST(DotProduct, IsaImplementationsAgree) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    // 特征库行要求64字节对齐
+    auto a = AllocAlignedFloats(gallery_test::kdim);
+    std::vector<float> b(gallery_test::kdim);
+    const auto scalar = GetDotProductFunc("scalar");
+    ASSERT_NE(scalar, nullptr);
+    EXPECT_EQ(GetDotProductFunc("sse"), nullptr);
+    for (int round = 0; round < 100; ++round) {
+        double expected = 0;
+        for (int i = 0; i < gallery_test::kdim; ++i) {
+            a.get()[i] = dist(rng);
+            b[i] = dist(rng);
+            expected += static_cast<double>(a.get()[i]) * b[i];
+        }
+        for (const char *isa : {"scalar", "avx2", "avx512"}) {
+            const auto dot = GetDotProductFunc(isa);
+            // 当前CPU不支持的实现跳过
+            if (dot == nullptr)
+                continue;
+            EXPECT_NEAR(dot(a.get(), b.data(), gallery_test::kdim), expected,
+                        1e-4)
+                << isa;
+        }
+        EXPECT_FLOAT_EQ(DotProduct(a.get(), b.data(), gallery_test::kdim),
+                        GetDotProductFunc(DotProductIsa())(
+                            a.get(), b.data(), gallery_test::kdim));
+    }
+}
+
+TEST(Gallery, SearchOrdersTopKAndDedupesNames) {
+    std::mt19937 rng(11);
+    Gallery gallery;
+    std::vector<cv::Mat> features;
+    std::vector<std::string> names;
+    for (int i = 0; i < 60; ++i) {
+        features.push_back(gallery_test::RandomFeature(rng));
+        // 每个名字录入多行，检验同名去重
+        names.push_back("id" + std::to_string(i % 17));
+        gallery.add(names.back(), features.back());
+    }
+    cv::Mat queries(4, gallery_test::kdim, CV_32F);
+    for (int q = 0; q < queries.rows; ++q) {
+        // 第一个查询与第5行相同
+        const cv::Mat feature =
+            q == 0 ? features[5] : gallery_test::RandomFeature(rng);
+        std::copy_n(feature.ptr<float>(), gallery_test::kdim,
+                    queries.ptr<float>(q));
+    }
+
+    cv::Mat packed;
+    gallery.packQueries(queries, packed);
+    constexpr int ktop_k = 5;
+    for (const auto type : {cv::FaceRecognizerSF::DisType::FR_COSINE,
+                            cv::FaceRecognizerSF::DisType::FR_NORM_L2}) {
+        const bool cosine = type == cv::FaceRecognizerSF::DisType::FR_COSINE;
+        std::vector<GallerySearchResult> results;
+        gallery.search(packed, type, ktop_k, results);
+        ASSERT_EQ(results.size(), static_cast<size_t>(queries.rows));
+        for (int q = 0; q < queries.rows; ++q) {
+            const float *query = queries.ptr<float>(q);
+            // 暴力求每个名字的最大相似度
+            std::vector<std::pair<float, std::string>> best;
+            for (size_t r = 0; r < features.size(); ++r) {
+                const float c =
+                    gallery_test::Cosine(features[r].ptr<float>(), query);
+                auto it = std::find_if(best.begin(), best.end(),
+                                       [&](const auto &entry) {
+                                           return entry.second == names[r];
+                                       });
+                if (it == best.end())
+                    best.emplace_back(c, names[r]);
+                else
+                    it->first = std::max(it->first, c);
+            }
+            std::sort(best.begin(), best.end(), std::greater<>());
+
+            const auto &candidates = results[q].candidates;
+            ASSERT_EQ(candidates.size(), static_cast<size_t>(ktop_k));
+            for (int i = 0; i < ktop_k; ++i) {
+                EXPECT_EQ(gallery.name(candidates[i].index), best[i].second);
+                EXPECT_NEAR(candidates[i].score,
+                            CosineToScore(best[i].first, type), 1e-4);
+                if (i == 0)
+                    continue;
+                // 余弦从大到小，L2距离从小到大
+                if (cosine)
+                    EXPECT_GE(candidates[i - 1].score, candidates[i].score);
+                else
+                    EXPECT_LE(candidates[i - 1].score, candidates[i].score);
+                for (int j = 0; j < i; ++j)
+                    EXPECT_NE(gallery.name(candidates[j].index),
+                              gallery.name(candidates[i].index));
+            }
+        }
+        EXPECT_EQ(gallery.name(results[0].candidates[0].index), names[5]);
+        EXPECT_NEAR(results[0].candidates[0].score, cosine ? 1.f : 0.f,
+                    1e-3);
+    }
+}
+
+TEST(Gallery, RemoveIfRewritesNameOffsets) {
+    std::mt19937 rng(3);
+    Gallery gallery;
+    const std::vector<std::string> names = {"a", "bb", "ccc", "", "eeeee",
+                                            "ffffff"};
+    std::vector<cv::Mat> features;
+    for (const auto &name : names) {
+        features.push_back(gallery_test::RandomFeature(rng));
+        gallery.add(name, features.back());
+    }
+    EXPECT_EQ(gallery.removeIf([](size_t row) { return row % 2 == 0; }), 3u);
+    ASSERT_EQ(gallery.size(), 3u);
+    const uint64_t *offsets = gallery.nameOffsets();
+    EXPECT_EQ(offsets[0], 0u);
+    size_t expected_offset = 0;
+    for (size_t i = 0; i < gallery.size(); ++i) {
+        const auto &name = names[2 * i + 1];
+        EXPECT_EQ(gallery.name(i), name);
+        expected_offset += name.size();
+        EXPECT_EQ(offsets[i + 1], expected_offset);
+        // 特征行随名字一起前移
+        EXPECT_NEAR(gallery_test::Cosine(gallery.row(i),
+                                         features[2 * i + 1].ptr<float>()),
+                    1.f, 1e-5);
+    }
+    EXPECT_EQ(std::string(gallery.nameData(), expected_offset), "bbffffff");
+
+    // 删除后仍可继续添加
+    gallery.add("g", features[0]);
+    EXPECT_EQ(gallery.name(3), "g");
+    EXPECT_EQ(gallery.removeIf([](size_t) { return true; }), 4u);
+    EXPECT_TRUE(gallery.empty());
+}
+
+TEST(GalleryStore, PublishedIndexPrunesLikeFullScan) {
+    std::mt19937 rng(13);
+    GalleryStore store(cv::makePtr<BruteForceIndex>());
+    store.update([&](GalleryIndex &index) {
+        for (int i = 0; i < 200; ++i)
+            index.add("id" + std::to_string(i % 23),
+                      gallery_test::RandomFeature(rng));
+    });
+    cv::Mat queries(8, gallery_test::kdim, CV_32F);
+    for (int q = 0; q < queries.rows; ++q) {
+        const cv::Mat feature = gallery_test::RandomFeature(rng);
+        std::copy_n(feature.ptr<float>(), gallery_test::kdim,
+                    queries.ptr<float>(q));
+    }
+    const auto snapshot = store.acquire();
+    cv::Mat packed;
+    snapshot->packQueries(queries, packed);
+    GallerySearchParams params;
+    params.top_k = 3;
+    std::vector<GallerySearchResult> full, pruned;
+    snapshot->search(packed, cv::FaceRecognizerSF::DisType::FR_COSINE, params,
+                     full);
+    params.centroid_pruning = true;
+    snapshot->search(packed, cv::FaceRecognizerSF::DisType::FR_COSINE, params,
+                     pruned);
+    ASSERT_EQ(full.size(), pruned.size());
+    for (size_t q = 0; q < full.size(); ++q) {
+        ASSERT_EQ(full[q].candidates.size(), pruned[q].candidates.size());
+        for (size_t i = 0; i < full[q].candidates.size(); ++i) {
+            EXPECT_EQ(snapshot->name(full[q].candidates[i].index),
+                      snapshot->name(pruned[q].candidates[i].index));
+            EXPECT_NEAR(full[q].candidates[i].score,
+                        pruned[q].candidates[i].score, 1e-5);
+        }
+    }
+}
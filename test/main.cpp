@@ -2,6 +2,10 @@
 #include <gtest/gtest.h>
 //
 #include "detector.hpp"
+#include "gallery_file_test.hpp"
+#include "gallery_test.hpp"
+#include "metrics_test.hpp"
+#include "spsc_queue_test.hpp"
 
 int main(int argc, char const *argv[]) {
     printf("Running main() from %s\n", __FILE__);
@@ -0,0 +1,56 @@
+#pragma once
+// gtest
+#include <gtest/gtest.h>
+
+// custom
+#include "metrics.hpp"
+
+TEST(Histogram, EmptyQuantileIsZero) {
+    Histogram histogram;
+    EXPECT_EQ(histogram.quantile(0.0), 0.0);
+    EXPECT_EQ(histogram.quantile(0.5), 0.0);
+    EXPECT_EQ(histogram.quantile(1.0), 0.0);
+    EXPECT_EQ(histogram.count(), 0u);
+}
+
+TEST(Histogram, SmallValuesAreExact) {
+    Histogram histogram;
+    for (uint64_t value = 1; value <= 10; ++value)
+        histogram.record(value);
+    EXPECT_EQ(histogram.count(), 10u);
+    EXPECT_EQ(histogram.sum(), 55u);
+    EXPECT_EQ(histogram.max(), 10u);
+    EXPECT_EQ(histogram.quantile(0.0), 1.0);
+    EXPECT_EQ(histogram.quantile(0.5), 5.0);
+    EXPECT_EQ(histogram.quantile(1.0), 10.0);
+    // 超出0~1的分位按边界处理
+    EXPECT_EQ(histogram.quantile(-1.0), 1.0);
+    EXPECT_EQ(histogram.quantile(2.0), 10.0);
+}
+
+TEST(Histogram, QuantileWithinBucketError) {
+    Histogram histogram;
+    for (uint64_t value = 1000; value < 2000000; value += 997)
+        histogram.record(value);
+    const double min = 1000, max = static_cast<double>(histogram.max());
+    double previous = 0;
+    for (const double q : {0.0, 0.1, 0.5, 0.9, 0.99, 1.0}) {
+        const double value = histogram.quantile(q);
+        // 每个指数16个桶，相对误差不超过1/16
+        const double exact = min + q * (max - min);
+        EXPECT_NEAR(value, exact, exact / Histogram::ksub_bucket_count + 997)
+            << q;
+        EXPECT_GE(value, previous);
+        EXPECT_LE(value, max);
+        previous = value;
+    }
+}
+
+TEST(Histogram, LargeValuesDoNotOverflow) {
+    Histogram histogram;
+    const uint64_t value = ~uint64_t(0);
+    histogram.record(value);
+    EXPECT_EQ(histogram.max(), value);
+    EXPECT_LE(histogram.quantile(1.0), static_cast<double>(value));
+    EXPECT_GT(histogram.quantile(1.0), static_cast<double>(value) / 2);
+}
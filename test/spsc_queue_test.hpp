@@ -0,0 +1,56 @@
+#pragma once
+// std
+#include <thread>
+
+// gtest
+#include <gtest/gtest.h>
+
+// custom
+#include "spsc_queue.hpp"
+
+TEST(SpscQueue, CapacityRoundsUpToPowerOfTwo) {
+    SpscQueue<int> queue(5);
+    EXPECT_EQ(queue.capacity(), 8u);
+}
+
+TEST(SpscQueue, DropOldestKeepsNewest) {
+    SpscQueue<int> queue(4);
+    for (int i = 0; i < 10; ++i)
+        EXPECT_TRUE(queue.push(int(i), kbackpressure_drop_oldest));
+    EXPECT_EQ(queue.dropped(), 6u);
+    EXPECT_EQ(queue.size(), 4u);
+    int item = -1;
+    for (int expected = 6; expected < 10; ++expected) {
+        ASSERT_TRUE(queue.tryPop(item));
+        EXPECT_EQ(item, expected);
+    }
+    EXPECT_FALSE(queue.tryPop(item));
+    EXPECT_EQ(queue.size(), 0u);
+}
+
+TEST(SpscQueue, CloseDrainsRemainingItems) {
+    SpscQueue<int> queue(2);
+    EXPECT_TRUE(queue.push(1, kbackpressure_block));
+    queue.close();
+    EXPECT_FALSE(queue.push(2, kbackpressure_block));
+    int item = 0;
+    EXPECT_TRUE(queue.pop(item));
+    EXPECT_EQ(item, 1);
+    EXPECT_FALSE(queue.pop(item));
+}
+
+TEST(SpscQueue, BlockingPushPreservesOrder) {
+    SpscQueue<int> queue(4);
+    constexpr int kitems = 10000;
+    std::thread producer([&] {
+        for (int i = 0; i < kitems; ++i)
+            queue.push(int(i), kbackpressure_block);
+        queue.close();
+    });
+    int item = 0, expected = 0;
+    while (queue.pop(item))
+        EXPECT_EQ(item, expected++);
+    producer.join();
+    EXPECT_EQ(expected, kitems);
+    EXPECT_EQ(queue.dropped(), 0u);
+}
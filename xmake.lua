@@ -2,6 +2,7 @@
 ----test 模式用于测试
 ----debug 模式用于调试
 ----release 模式用于生成
+----bench 模式用于基准测试
 local target_name = "main"
 
 --基础设置
@@ -48,10 +49,21 @@ add_defines(
 if is_mode("test") then
 	target("test")
 	set_symbols("debug")
-	add_files("test/*.cpp")
+	add_files("test/*.cpp", "src/*.cpp|main.cpp")
 	set_kind("binary")
 	add_syslinks("z", "pthread")
-	add_includedirs("/usr/include", "/usr/local/include", "./include")
+	add_includedirs("/usr/include", "/usr/local/include", "./include", "./test")
+end
+
+----bench
+if is_mode("bench") then
+	set_symbols("debug")
+	set_optimize("fastest")
+	target("bench")
+	set_kind("binary")
+	add_files("bench/*.cpp", "src/*.cpp|main.cpp")
+	add_syslinks("z", "pthread")
+	add_includedirs("/usr/include", "/usr/local/include", "./include", "./bench")
 end
 
 -- xmake自带测试